@@ -0,0 +1,8 @@
+﻿#include "Source/PipelineBenchmark.h"
+
+
+/* console build of the headless pipeline benchmark, the same as VimbaCamJILA --benchmark without the viewer linked in */
+int main(int argc, char *argv[])
+{
+    return PipelineBenchmark::Main(argc, argv);
+}
@@ -2,10 +2,17 @@
 #include "Source\cameraMainWindow.h"
 #include <QApplication>
 #include "Source\Version.h"
+#include "Source\PipelineBenchmark.h"
 
 
 int main(int argc, char *argv[])
 {
+    /* headless pipeline benchmark, see PipelineBenchmark */
+    if (PipelineBenchmark::IsRequested(argc, argv))
+    {
+        return PipelineBenchmark::Main(argc, argv);
+    }
+
     QApplication a(argc, argv);
 
 
@@ -0,0 +1,178 @@
+
+
+#ifndef ANALYSIS_PIPELINE_H_
+#define ANALYSIS_PIPELINE_H_
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSharedPointer>
+#include <QVector>
+#include <functional>
+#include "Helper.h"
+#include "MonoFormat.h"
+#include "BeamMoments.h"
+#include "ShotResults.h"
+
+/** one frame on its way through the analysis stages: conversion -> reductions -> fits -> render prep.
+* every stage fills its own block, a frame is only touched by the stage that holds it.
+* frames are recycled through AnalysisFramePool so the vectors keep their capacity
+*/
+struct AnalysisFrame
+{
+    /* conversion */
+    MonoSamples             m_Samples;
+    int                     m_Width;
+    int                     m_Height;
+    VmbPixelFormatType      m_Format;           // mono format, bayer and packed already resolved
+    VmbUint32_t             m_BitDepth;
+    FrameTrace              m_Trace;
+    tFrameMetadata          m_Metadata;         // as the frame arrived, labels are taken from here and not read from the camera
+    int                     m_OffsetX;          // sensor position of the image, from m_Metadata
+    int                     m_OffsetY;
+    /* reductions */
+    QVector<double>         m_CrxX;             // column sums
+    QVector<double>         m_CrxY;             // row sums
+    QVector<double>         m_KeyX;             // sensor x of every column
+    QVector<double>         m_KeyY;             // sensor y of every row
+    /* moments of the reductions stage, also the initial guess of the 2D fit, and the fits. recorded to ShotResults */
+    tShotResult             m_Shot;
+
+    AnalysisFrame()
+        : m_Width( 0 )
+        , m_Height( 0 )
+        , m_Format( VmbPixelFormatMono8 )
+        , m_BitDepth( 8 )
+        , m_OffsetX( 0 )
+        , m_OffsetY( 0 )
+    {}
+    /**forget the results of the last frame, the buffers are kept*/
+    void Reset()
+    {
+        m_Samples.clear();
+        m_Trace.Clear();
+        m_Shot.m_Moments = tBeamMoments();
+        m_Shot.ClearFits();
+    }
+};
+typedef QSharedPointer<AnalysisFrame> AnalysisFramePtr;
+
+/** free list of analysis frames, Acquire only allocates while the pipeline fills up*/
+class AnalysisFramePool
+{
+    QMutex                      m_Lock;
+    QVector<AnalysisFramePtr>   m_Free;
+    quint64                     m_nAllocated;
+
+    AnalysisFramePool( const AnalysisFramePool& );
+    AnalysisFramePool& operator=( const AnalysisFramePool& );
+public:
+    AnalysisFramePool()
+        : m_nAllocated( 0 )
+    {}
+    AnalysisFramePtr Acquire()
+    {
+        QMutexLocker guard( &m_Lock );
+        if( m_Free.isEmpty() )
+        {
+            ++m_nAllocated;
+            return AnalysisFramePtr( new AnalysisFrame() );
+        }
+        AnalysisFramePtr frame = m_Free.takeLast();
+        return frame;
+    }
+    /**give a frame back, frame is null afterwards*/
+    void Recycle( AnalysisFramePtr &frame )
+    {
+        if( frame.isNull() )
+        {
+            return;
+        }
+        frame->Reset();
+        QMutexLocker guard( &m_Lock );
+        m_Free.append( frame );
+        frame.clear();
+    }
+    /**frames allocated so far, stays constant once every stage is busy*/
+    quint64 Allocated()
+    {
+        QMutexLocker guard( &m_Lock );
+        return m_nAllocated;
+    }
+};
+
+/** worker of one analysis stage.
+* frames are pushed into a bounded queue, when it is full the oldest waiting frame is handed to the drop handler.
+* the worker passes every frame it takes to the process function, which hands it on or retires it
+*/
+class AnalysisStage : public QThread
+{
+public:
+    typedef std::function<void( AnalysisFramePtr& )> Handler;
+private:
+    ConsumerQueue<AnalysisFramePtr>     m_Input;
+    const Handler                       m_Process;
+    const Handler                       m_Drop;
+
+    AnalysisStage( const AnalysisStage& );
+    AnalysisStage& operator=( const AnalysisStage& );
+public:
+    /**nQueueSize frames wait at most, at least 1*/
+    AnalysisStage( size_t nQueueSize, const Handler &process, const Handler &drop )
+        : m_Input( nQueueSize )
+        , m_Process( process )
+        , m_Drop( drop )
+    {}
+    ~AnalysisStage()
+    {
+        StopProcessing();
+    }
+    /**queue a frame, frame is null afterwards. a stopped stage drops it*/
+    void Push( AnalysisFramePtr &frame )
+    {
+        m_Input.Enqueue( std::move( frame ), m_Drop );
+        if( !frame.isNull() )
+        {
+            m_Drop( frame );
+        }
+    }
+    /**queue a frame without dropping an older one, sleeps until the worker takes a frame while the queue is full.
+    * frame is null afterwards, a stopped stage drops it
+    */
+    void PushWait( AnalysisFramePtr &frame )
+    {
+        while( !m_Input.EnqueueIfFree( std::move( frame ) ) )
+        {
+            if( m_Input.IsStopping() )
+            {
+                m_Drop( frame );
+                return;
+            }
+            /* the timeout only bounds a missed stop, a taken frame wakes it */
+            m_Input.WaitFree( 100 );
+        }
+    }
+    void StartProcessing()
+    {
+        m_Input.StartProcessing();
+        start();
+    }
+    /**stop the worker, frames still waiting are dropped without the handler*/
+    void StopProcessing()
+    {
+        m_Input.StopProcessing();
+        wait();
+    }
+protected:
+    virtual void run()
+    {
+        AnalysisFramePtr frame;
+        while( m_Input.WaitData( frame ) )
+        {
+            m_Process( frame );
+            frame.clear();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,425 @@
+
+
+#include "BeamMoments.h"
+#include "CpuDispatch.h"
+
+#include <QThread>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const int       SIMD_MAX_WIDTH      = 32768;        // x * ( v - base ) has to stay below 2^31 in the vector kernel
+    const double    INTEGRATION_AREA    = 3.0;          // side of the integration area in beam diameters, ISO 11146-3
+
+    /** integer sums of one row span, x counted from the frame's left edge, d = v - base above the threshold*/
+    struct tRowSums
+    {
+        quint64     m_nW;       // sum d
+        quint64     m_nXW;      // sum x * d
+        quint64     m_nXXW;     // sum x^2 * d
+    };
+
+    /** sums of an area, in double from the rows on, they exceed 64 bits for large frames*/
+    struct tAreaSums
+    {
+        double      m_dW;
+        double      m_dX;
+        double      m_dY;
+        double      m_dXX;
+        double      m_dYY;
+        double      m_dXY;
+
+        tAreaSums()
+            : m_dW( 0.0 ), m_dX( 0.0 ), m_dY( 0.0 ), m_dXX( 0.0 ), m_dYY( 0.0 ), m_dXY( 0.0 )
+        {}
+        void AddRow( const tRowSums &row, int y )
+        {
+            const double dW = static_cast<double>( row.m_nW );
+            m_dW    += dW;
+            m_dX    += static_cast<double>( row.m_nXW );
+            m_dXX   += static_cast<double>( row.m_nXXW );
+            m_dY    += y * dW;
+            m_dYY   += static_cast<double>( y ) * y * dW;
+            m_dXY   += y * static_cast<double>( row.m_nXW );
+        }
+        void Add( const tAreaSums &other )
+        {
+            m_dW    += other.m_dW;
+            m_dX    += other.m_dX;
+            m_dY    += other.m_dY;
+            m_dXX   += other.m_dXX;
+            m_dYY   += other.m_dYY;
+            m_dXY   += other.m_dXY;
+        }
+    };
+
+    /** the pixels summed in a pass: the whole frame or the integration area, a rectangle along the principal axes.
+    *  row y covers the columns [first, last) Span returns */
+    struct tArea
+    {
+        int         m_nWidth;
+        int         m_nTop;             // rows [m_nTop, m_nBottom)
+        int         m_nBottom;
+        int         m_nLeft;            // bounding columns, for the decision to split the pass
+        int         m_nRight;
+        bool        m_bRect;
+        double      m_dX;               // centre and axes of the rectangle
+        double      m_dY;
+        double      m_dCos;
+        double      m_dSin;
+        double      m_dHalfMajor;
+        double      m_dHalfMinor;
+
+        /* the whole frame */
+        tArea( int nWidth, int nHeight )
+            : m_nWidth( nWidth ), m_nTop( 0 ), m_nBottom( nHeight ), m_nLeft( 0 ), m_nRight( nWidth ), m_bRect( false )
+            , m_dX( 0.0 ), m_dY( 0.0 ), m_dCos( 1.0 ), m_dSin( 0.0 ), m_dHalfMajor( 0.0 ), m_dHalfMinor( 0.0 )
+        {}
+        /* the integration area of the beam m, clipped to the frame */
+        tArea( int nWidth, int nHeight, const tBeamMoments &m )
+            : m_nWidth( nWidth ), m_bRect( true )
+            , m_dX( m.m_dCentroidX ), m_dY( m.m_dCentroidY ), m_dCos( cos( m.m_dAngle ) ), m_dSin( sin( m.m_dAngle ) )
+            , m_dHalfMajor( std::max( 0.5 * INTEGRATION_AREA * m.m_dMajor, 1.0 ) )
+            , m_dHalfMinor( std::max( 0.5 * INTEGRATION_AREA * m.m_dMinor, 1.0 ) )
+        {
+            const double dExtentX = fabs( m_dCos ) * m_dHalfMajor + fabs( m_dSin ) * m_dHalfMinor;
+            const double dExtentY = fabs( m_dSin ) * m_dHalfMajor + fabs( m_dCos ) * m_dHalfMinor;
+            m_nTop      = clip( static_cast<int>( ceil( m_dY - dExtentY ) ), nHeight );
+            m_nBottom   = clip( static_cast<int>( floor( m_dY + dExtentY ) ) + 1, nHeight );
+            m_nLeft     = clip( static_cast<int>( ceil( m_dX - dExtentX ) ), nWidth );
+            m_nRight    = clip( static_cast<int>( floor( m_dX + dExtentX ) ) + 1, nWidth );
+        }
+        static int clip( int n, int nMax )
+        {
+            return std::min( std::max( n, 0 ), nMax );
+        }
+        /* |u| <= half major and |w| <= half minor with u, w the pixel's position along the axes, solved for x */
+        void Span( int y, int &first, int &last ) const
+        {
+            if( !m_bRect )
+            {
+                first   = 0;
+                last    = m_nWidth;
+                return;
+            }
+            const double dy = y - m_dY;
+            double lo = -HUGE_VAL;
+            double hi = HUGE_VAL;
+            const auto limit = [&lo, &hi]( double dFactor, double dFrom, double dTo )
+            {
+                /* dFrom <= dx * dFactor <= dTo */
+                if( fabs( dFactor ) < 1.0e-12 )
+                {
+                    if( dFrom > 0.0 || dTo < 0.0 )
+                    {
+                        hi = -HUGE_VAL;
+                    }
+                    return;
+                }
+                const double a = dFrom / dFactor;
+                const double b = dTo / dFactor;
+                lo = std::max( lo, std::min( a, b ) );
+                hi = std::min( hi, std::max( a, b ) );
+            };
+            limit( m_dCos, -m_dHalfMajor - dy * m_dSin, m_dHalfMajor - dy * m_dSin );
+            limit( m_dSin, dy * m_dCos - m_dHalfMinor, dy * m_dCos + m_dHalfMinor );
+            if( lo > hi )
+            {
+                first = last = 0;
+                return;
+            }
+            first   = clip( static_cast<int>( ceil( m_dX + lo ) ), m_nWidth );
+            last    = clip( static_cast<int>( floor( m_dX + hi ) ) + 1, m_nWidth );
+        }
+    };
+
+    template <typename T>
+    using RowKernel = void (*)( const T *row, int first, int last, unsigned base, unsigned threshold, tRowSums &sums );
+
+    /** adds the span [first, last) of row to sums*/
+    template <typename T>
+    void rowSumsScalar( const T *row, int first, int last, unsigned base, unsigned threshold, tRowSums &sums )
+    {
+        quint64 w = 0, xw = 0, xxw = 0;
+        for( int x = first; x < last; ++x )
+        {
+            const unsigned v = row[x];
+            const quint64 d = v >= threshold ? v - base : 0;
+            w   += d;
+            xw  += d * x;
+            xxw += d * x * x;
+        }
+        sums.m_nW   += w;
+        sums.m_nXW  += xw;
+        sums.m_nXXW += xxw;
+    }
+
+#ifdef CPU_HAS_X86
+    CPU_TARGET("avx2") inline __m256i load8( const quint8 *p )
+    {
+        return _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( p ) ) );
+    }
+    CPU_TARGET("avx2") inline __m256i load8( const ushort *p )
+    {
+        return _mm256_cvtepu16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) ) );
+    }
+
+    /* 8 pixels at a time in 32 bit lanes: d masked by the threshold, x * d still fits, x^2 * d and the sums over
+    *  the row go to 64 bit lanes, the even and odd 32 bit lanes separately */
+    template <typename T>
+    CPU_TARGET("avx2") void rowSumsAVX2( const T *row, int first, int last, unsigned base, unsigned threshold, tRowSums &sums )
+    {
+        const __m256i   vBase       = _mm256_set1_epi32( static_cast<int>( base ) );
+        const __m256i   vThreshold  = _mm256_set1_epi32( static_cast<int>( threshold ) - 1 );
+        const __m256i   vStep       = _mm256_set1_epi32( 8 );
+        const __m256i   vLow        = _mm256_set1_epi64x( 0xffffffff );
+        __m256i         x           = _mm256_add_epi32( _mm256_set1_epi32( first ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+        __m256i         accW        = _mm256_setzero_si256();
+        __m256i         accXW       = _mm256_setzero_si256();
+        __m256i         accXXW      = _mm256_setzero_si256();
+        int i = first;
+        for( ; i + 8 <= last; i += 8 )
+        {
+            const __m256i v     = load8( row + i );
+            const __m256i d     = _mm256_and_si256( _mm256_cmpgt_epi32( v, vThreshold ), _mm256_sub_epi32( v, vBase ) );
+            const __m256i xd    = _mm256_mullo_epi32( x, d );
+            accW    = _mm256_add_epi32( accW, d );
+            accXW   = _mm256_add_epi64( accXW, _mm256_add_epi64( _mm256_and_si256( xd, vLow ), _mm256_srli_epi64( xd, 32 ) ) );
+            accXXW  = _mm256_add_epi64( accXXW, _mm256_add_epi64( _mm256_mul_epu32( x, xd ),
+                                                                  _mm256_mul_epu32( _mm256_srli_epi64( x, 32 ), _mm256_srli_epi64( xd, 32 ) ) ) );
+            x       = _mm256_add_epi32( x, vStep );
+        }
+        /* a lane of accW holds at most SIMD_MAX_WIDTH / 8 values below 2^16 */
+        quint32 w[8];
+        quint64 xw[4], xxw[4];
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( w ), accW );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( xw ), accXW );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( xxw ), accXXW );
+        for( int k = 0; k < 8; ++k )
+        {
+            sums.m_nW += w[k];
+        }
+        for( int k = 0; k < 4; ++k )
+        {
+            sums.m_nXW  += xw[k];
+            sums.m_nXXW += xxw[k];
+        }
+        rowSumsScalar( row, i, last, base, threshold, sums );
+    }
+#endif
+
+    /** helpers of the row blocks, a quarter of the cores: the calling thread runs alone on up to 7 cores */
+    class MomentPool : public QThreadPool
+    {
+    public:
+        MomentPool()
+        {
+            setMaxThreadCount( std::max( 1, QThread::idealThreadCount() / 4 ) );
+        }
+    };
+
+    QThreadPool* momentPool()
+    {
+        static MomentPool pool;
+        return &pool;
+    }
+
+    template <typename T>
+    RowKernel<T> rowKernel( bool bSimd, int nWidth )
+    {
+#ifdef CPU_HAS_X86
+        if( bSimd && nWidth <= SIMD_MAX_WIDTH && cpu_has_avx2() )
+        {
+            return rowSumsAVX2<T>;
+        }
+#endif
+        return rowSumsScalar<T>;
+    }
+
+    /** one pass: the sums of all pixels in area, in row blocks on the moments' pool if the area is large.
+    *  the rows are added up in order afterwards, the result does not depend on how they were split */
+    template <typename T>
+    tAreaSums sumArea( const T *pixels, const tArea &area, unsigned base, unsigned threshold, RowKernel<T> kernel, bool bThreads )
+    {
+        const int nRows = area.m_nBottom - area.m_nTop;
+        if( nRows <= 0 )
+        {
+            return tAreaSums();
+        }
+        QVector<tRowSums> rowSums( nRows );
+        tRowSums *pRowSums = rowSums.data();
+        forRowBlocks( static_cast<size_t>( nRows ), static_cast<size_t>( nRows ) * ( area.m_nRight - area.m_nLeft ), bThreads,
+                      [pixels, &area, base, threshold, kernel, pRowSums]( size_t nFirstRow, size_t nLastRow )
+        {
+            for( size_t i = nFirstRow; i < nLastRow; ++i )
+            {
+                const int y = area.m_nTop + static_cast<int>( i );
+                tRowSums &row = pRowSums[i];
+                row.m_nW = row.m_nXW = row.m_nXXW = 0;
+                int first, last;
+                area.Span( y, first, last );
+                if( first < last )
+                {
+                    kernel( pixels + static_cast<size_t>( y ) * area.m_nWidth, first, last, base, threshold, row );
+                }
+            }
+        }, momentPool() );
+        tAreaSums sums;
+        for( int i = 0; i < nRows; ++i )
+        {
+            sums.AddRow( rowSums.at( i ), area.m_nTop + i );
+        }
+        return sums;
+    }
+
+    /** mean and standard deviation of the four corners*/
+    template <typename T>
+    void cornerStatistics( const T *pixels, int nWidth, int nHeight, double dFraction, double &dMean, double &dDeviation )
+    {
+        const int nCornerWidth  = std::max( 1, std::min( nWidth / 2, static_cast<int>( lround( dFraction * nWidth ) ) ) );
+        const int nCornerHeight = std::max( 1, std::min( nHeight / 2, static_cast<int>( lround( dFraction * nHeight ) ) ) );
+        quint64 nSum = 0, nSquares = 0, nCount = 0;
+        for( int y : { 0, nHeight - nCornerHeight } )
+        {
+            for( int x : { 0, nWidth - nCornerWidth } )
+            {
+                for( int j = y; j < y + nCornerHeight; ++j )
+                {
+                    const T *row = pixels + static_cast<size_t>( j ) * nWidth;
+                    for( int i = x; i < x + nCornerWidth; ++i )
+                    {
+                        const quint64 v = row[i];
+                        nSum        += v;
+                        nSquares    += v * v;
+                    }
+                }
+                nCount += static_cast<quint64>( nCornerWidth ) * nCornerHeight;
+            }
+        }
+        dMean       = static_cast<double>( nSum ) / nCount;
+        dDeviation  = sqrt( std::max( static_cast<double>( nSquares ) / nCount - dMean * dMean, 0.0 ) );
+    }
+
+    /** centroid, second moments, diameters and angle from the sums, in frame pixels. false without signal*/
+    bool momentsFromSums( const tAreaSums &sums, tBeamMoments &m )
+    {
+        if( sums.m_dW <= 0.0 )
+        {
+            return false;
+        }
+        m.m_dTotal      = sums.m_dW;
+        m.m_dCentroidX  = sums.m_dX / sums.m_dW;
+        m.m_dCentroidY  = sums.m_dY / sums.m_dW;
+        m.m_dSigmaXX    = std::max( sums.m_dXX / sums.m_dW - m.m_dCentroidX * m.m_dCentroidX, 0.0 );
+        m.m_dSigmaYY    = std::max( sums.m_dYY / sums.m_dW - m.m_dCentroidY * m.m_dCentroidY, 0.0 );
+        m.m_dSigmaXY    = sums.m_dXY / sums.m_dW - m.m_dCentroidX * m.m_dCentroidY;
+        /* ISO 11146-1: d = 2 sqrt( 2 ) ( sxx + syy +- ( ( sxx - syy )^2 + 4 sxy^2 )^1/2 )^1/2 */
+        const double dSum   = m.m_dSigmaXX + m.m_dSigmaYY;
+        const double dDiff  = m.m_dSigmaXX - m.m_dSigmaYY;
+        const double dRoot  = sqrt( dDiff * dDiff + 4.0 * m.m_dSigmaXY * m.m_dSigmaXY );
+        m.m_dMajor      = 2.0 * sqrt( 2.0 ) * sqrt( dSum + dRoot );
+        m.m_dMinor      = 2.0 * sqrt( 2.0 ) * sqrt( std::max( dSum - dRoot, 0.0 ) );
+        m.m_dAngle      = 0.5 * atan2( 2.0 * m.m_dSigmaXY, dDiff );
+        return true;
+    }
+
+    bool settled( const tBeamMoments &last, const tBeamMoments &next, double dTolerance )
+    {
+        const double dScale = std::max( next.m_dMinor, 1.0 );
+        return      fabs( next.m_dCentroidX - last.m_dCentroidX ) <= dTolerance * dScale
+                &&  fabs( next.m_dCentroidY - last.m_dCentroidY ) <= dTolerance * dScale
+                &&  fabs( next.m_dMajor - last.m_dMajor ) <= dTolerance * std::max( next.m_dMajor, 1.0 )
+                &&  fabs( next.m_dMinor - last.m_dMinor ) <= dTolerance * dScale;
+    }
+
+    template <typename T>
+    tBeamMoments computeMoments( const T *pixels, int nWidth, int nHeight, const tMomentSettings &settings )
+    {
+        tBeamMoments result;
+        cornerStatistics( pixels, nWidth, nHeight, settings.CornerFraction, result.m_dBackground, result.m_dNoise );
+        /* the background is taken off in whole counts, half a count at most against a noise of usually several */
+        const unsigned base         = static_cast<unsigned>( lround( result.m_dBackground ) );
+        const unsigned threshold    = std::max( base, static_cast<unsigned>( ceil( result.m_dBackground + settings.NoiseThreshold * result.m_dNoise ) ) );
+        const RowKernel<T> kernel   = rowKernel<T>( settings.Simd, nWidth );
+
+        tBeamMoments m = result;
+        if( !momentsFromSums( sumArea( pixels, tArea( nWidth, nHeight ), base, threshold, kernel, settings.Threads ), m ) )
+        {
+            return result;
+        }
+        m.m_bValid = true;
+        for( int i = 0; i < settings.MaxIterations && !m.m_bConverged; ++i )
+        {
+            tBeamMoments next = m;
+            if( !momentsFromSums( sumArea( pixels, tArea( nWidth, nHeight, m ), base, threshold, kernel, settings.Threads ), next ) )
+            {
+                break;
+            }
+            ++next.m_nIterations;
+            next.m_bConverged = settled( m, next, settings.Tolerance );
+            m = next;
+        }
+        return m;
+    }
+}
+
+tBeamMoments beam_moments( const MonoSamples &samples, int nWidth, int nHeight, int nOffsetX, int nOffsetY, const tMomentSettings &settings )
+{
+    if( nWidth <= 0 || nHeight <= 0 || samples.isEmpty() )
+    {
+        return tBeamMoments();
+    }
+    const size_t nPixels = static_cast<size_t>( nWidth ) * nHeight;
+    tBeamMoments m;
+    if( 1 == samples.m_bytesPerSample )
+    {
+        if( static_cast<size_t>( samples.m_uint8.size() ) < nPixels )
+        {
+            return m;
+        }
+        m = computeMoments( samples.m_uint8.constData(), nWidth, nHeight, settings );
+    }
+    else
+    {
+        if( static_cast<size_t>( samples.m_uint16.size() ) < nPixels )
+        {
+            return m;
+        }
+        m = computeMoments( samples.m_uint16.constData(), nWidth, nHeight, settings );
+    }
+    m.m_dCentroidX += nOffsetX;
+    m.m_dCentroidY += nOffsetY;
+    return m;
+}
+
+bool beam_moments_gaussian( const tBeamMoments &moments, QVector<double> &para )
+{
+    /* the exponent a dx^2 + 2 b dx dy + c dy^2 is half the inverse of the covariance, the volume A 2 pi det^1/2 the total */
+    const double dDet = moments.m_dSigmaXX * moments.m_dSigmaYY - moments.m_dSigmaXY * moments.m_dSigmaXY;
+    if( !moments.m_bValid || !( dDet > 0.0 ) )
+    {
+        return false;
+    }
+    para.resize( 7 );
+    para[0] = moments.m_dTotal / ( 2.0 * M_PI * sqrt( dDet ) );
+    para[1] = moments.m_dCentroidX;
+    para[2] = moments.m_dCentroidY;
+    para[3] = moments.m_dSigmaYY / ( 2.0 * dDet );
+    para[4] = -moments.m_dSigmaXY / ( 2.0 * dDet );
+    para[5] = moments.m_dSigmaXX / ( 2.0 * dDet );
+    para[6] = moments.m_dBackground;
+    return true;
+}
+
+const char* beam_moments_kernel_name()
+{
+#ifdef CPU_HAS_X86
+    if( cpu_has_avx2() )
+    {
+        return "AVX2";
+    }
+#endif
+    return "Scalar";
+}
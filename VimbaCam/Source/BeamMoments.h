@@ -0,0 +1,81 @@
+
+
+#ifndef BEAM_MOMENTS_H_
+#define BEAM_MOMENTS_H_
+
+#include "MonoFormat.h"
+
+/** beam width by the second moment method of ISO 11146, the closed form counterpart of the 2D gaussian fit.
+* the background is the mean of the four frame corners, pixels less than NoiseThreshold deviations of the corners
+* above it count as 0. the first pass takes the whole frame, every further pass only the integration area of
+* three times the beam diameters around the centroid, aligned with the principal axes, until the centroid and
+* the diameters settle. each pass is one sweep over its rows with integer sums per row: AVX2 or scalar,
+* whatever the cpu supports, large areas in row blocks on a pool of their own of a quarter of the cores, so the
+* moments of the next frame do not take the threads of the fits running on the global pool.
+*/
+struct tMomentSettings
+{
+    double                  CornerFraction;     // side of each corner the background is taken from, fraction of the frame side
+    double                  NoiseThreshold;     // in standard deviations of the corner pixels
+    int                     MaxIterations;      // passes over the integration area after the first one
+    double                  Tolerance;          // relative change of centroid and diameters that ends the refinement
+    bool                    Simd;               // the vector kernel if the cpu supports it
+    bool                    Threads;            // large areas in row blocks on the moments' thread pool
+
+    tMomentSettings()
+        : CornerFraction    ( 0.05 )
+        , NoiseThreshold    ( 3.0 )
+        , MaxIterations     ( 10 )
+        , Tolerance         ( 1.0e-3 )
+        , Simd              ( true )
+        , Threads           ( true )
+    {}
+};
+
+/** the beam of one frame, positions in sensor pixels*/
+struct tBeamMoments
+{
+    bool                    m_bValid;           // there was signal above the threshold
+    bool                    m_bConverged;       // the integration area settled within MaxIterations
+    int                     m_nIterations;      // passes over the integration area
+    double                  m_dCentroidX;
+    double                  m_dCentroidY;
+    double                  m_dSigmaXX;         // second moments about the centroid, pixels^2
+    double                  m_dSigmaYY;
+    double                  m_dSigmaXY;
+    double                  m_dMajor;           // D4sigma diameters along the principal axes
+    double                  m_dMinor;
+    double                  m_dAngle;           // of the major axis from the x axis, radians
+    double                  m_dBackground;      // mean of the corners
+    double                  m_dNoise;           // standard deviation of the corners
+    double                  m_dTotal;           // background free signal in the integration area
+
+    tBeamMoments()
+        : m_bValid          ( false )
+        , m_bConverged      ( false )
+        , m_nIterations     ( 0 )
+        , m_dCentroidX      ( 0.0 )
+        , m_dCentroidY      ( 0.0 )
+        , m_dSigmaXX        ( 0.0 )
+        , m_dSigmaYY        ( 0.0 )
+        , m_dSigmaXY        ( 0.0 )
+        , m_dMajor          ( 0.0 )
+        , m_dMinor          ( 0.0 )
+        , m_dAngle          ( 0.0 )
+        , m_dBackground     ( 0.0 )
+        , m_dNoise          ( 0.0 )
+        , m_dTotal          ( 0.0 )
+    {}
+};
+
+/** beam moments of a nWidth x nHeight frame whose first pixel sits at ( nOffsetX, nOffsetY ) on the sensor*/
+tBeamMoments    beam_moments                ( const MonoSamples &samples, int nWidth, int nHeight, int nOffsetX, int nOffsetY,
+                                              const tMomentSettings &settings = tMomentSettings() );
+/** initial parameters A, x0, y0, a, b, c, D of Gaussian2DFit for the gaussian with the same moments,
+* false without a valid beam or if it has no extent along one of its axes
+*/
+bool            beam_moments_gaussian       ( const tBeamMoments &moments, QVector<double> &para );
+/** name of the kernel beam_moments uses on this cpu with Simd set*/
+const char*     beam_moments_kernel_name    ();
+
+#endif
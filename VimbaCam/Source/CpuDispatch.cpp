@@ -0,0 +1,90 @@
+#include "CpuDispatch.h"
+
+#ifdef CPU_HAS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+    struct CpuFeatures
+    {
+        bool        m_bSSSE3;
+        bool        m_bAVX2;
+    };
+
+#ifdef CPU_HAS_X86
+    void cpuid( int leaf, int subLeaf, unsigned int regs[4] )
+    {
+#ifdef _MSC_VER
+        int tmp[4];
+        __cpuidex( tmp, leaf, subLeaf );
+        for( int i = 0; i < 4; ++i )
+        {
+            regs[i] = static_cast<unsigned int>( tmp[i] );
+        }
+#else
+        __cpuid_count( leaf, subLeaf, regs[0], regs[1], regs[2], regs[3] );
+#endif
+    }
+
+    /* xcr0 bits of the register state the os saves, only read if osxsave is set */
+    unsigned long long xgetbv0()
+    {
+#ifdef _MSC_VER
+        return _xgetbv( 0 );
+#else
+        unsigned int lo, hi;
+        __asm__ __volatile__( "xgetbv" : "=a"( lo ), "=d"( hi ) : "c"( 0 ) );
+        return ( static_cast<unsigned long long>( hi ) << 32 ) | lo;
+#endif
+    }
+
+    CpuFeatures detectFeatures()
+    {
+        CpuFeatures features = { false, false };
+        unsigned int regs[4];
+        cpuid( 0, 0, regs );
+        const unsigned int maxLeaf = regs[0];
+        if( maxLeaf < 1 )
+        {
+            return features;
+        }
+        cpuid( 1, 0, regs );
+        features.m_bSSSE3   = ( regs[2] & ( 1u << 9 ) ) != 0;
+        const bool bOSXSave = ( regs[2] & ( 1u << 27 ) ) != 0;
+        const bool bAVX     = ( regs[2] & ( 1u << 28 ) ) != 0;
+        if( bAVX && bOSXSave && ( xgetbv0() & 0x6 ) == 0x6 && maxLeaf >= 7 )
+        {
+            cpuid( 7, 0, regs );
+            features.m_bAVX2 = ( regs[1] & ( 1u << 5 ) ) != 0;
+        }
+        return features;
+    }
+#else
+    CpuFeatures detectFeatures()
+    {
+        CpuFeatures features = { false, false };
+        return features;
+    }
+#endif
+
+    const CpuFeatures& features()
+    {
+        static const CpuFeatures detected = detectFeatures();
+        return detected;
+    }
+}
+
+bool cpu_has_ssse3()
+{
+    return features().m_bSSSE3;
+}
+
+bool cpu_has_avx2()
+{
+    return features().m_bAVX2;
+}
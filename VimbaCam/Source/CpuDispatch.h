@@ -0,0 +1,74 @@
+
+
+#ifndef CPU_DISPATCH_H_
+#define CPU_DISPATCH_H_
+
+#include <QFuture>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent>
+#include <algorithm>
+#include <atomic>
+
+/** instruction set dispatch and row parallel loops of the analysis kernels.
+* vector kernels are compiled for their instruction set with CPU_TARGET and only called after cpu_has_* said so,
+* the rest of the file stays at the baseline of the build
+*/
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_HAS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define CPU_TARGET(x)
+#else
+#define CPU_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+/** the cpu supports SSSE3, checked once*/
+bool            cpu_has_ssse3       ();
+/** the cpu supports AVX2 and the os saves the ymm registers, checked once*/
+bool            cpu_has_avx2        ();
+
+const size_t    ROW_BLOCKS_MIN_PIXELS   = 64 * 1024;    // smaller loops run on the calling thread alone
+const size_t    ROW_BLOCKS_PER_THREAD   = 4;
+
+/** rows( first, last ) over the rows [0, nRows) of nPixels, in blocks if bThreads and nPixels reach ROW_BLOCKS_MIN_PIXELS.
+* the calling thread takes part, threads of pPool help as they come free: a busy pool leaves the blocks to the
+* calling thread instead of holding it up, and never more than pPool->maxThreadCount() threads work on one loop.
+* returns when all rows are done
+*/
+template <typename ROWS>
+void forRowBlocks( size_t nRows, size_t nPixels, bool bThreads, ROWS rows, QThreadPool *pPool = QThreadPool::globalInstance() )
+{
+    const size_t nThreads = static_cast<size_t>( std::max( 1, pPool->maxThreadCount() ) );
+    if( !bThreads || nThreads < 2 || nRows < 2 || nPixels < ROW_BLOCKS_MIN_PIXELS )
+    {
+        rows( size_t( 0 ), nRows );
+        return;
+    }
+    /* a few blocks per thread, so a thread busy with something else does not hold up the rest */
+    const size_t nBlocks = std::min( nRows, nThreads * ROW_BLOCKS_PER_THREAD );
+    std::atomic<size_t> nNext( 0 );
+    const auto work = [&rows, &nNext, nRows, nBlocks]()
+    {
+        for( size_t k = nNext++; k < nBlocks; k = nNext++ )
+        {
+            rows( nRows * k / nBlocks, nRows * ( k + 1 ) / nBlocks );
+        }
+    };
+    const int nHelpers = static_cast<int>( std::min( nThreads, nBlocks ) - 1 );
+    QVector<QFuture<void> > helpers;
+    helpers.reserve( nHelpers );
+    for( int i = 0; i < nHelpers; ++i )
+    {
+        helpers.append( QtConcurrent::run( pPool, work ) );
+    }
+    work();
+    /* a helper the pool has not started yet is run here and finds no block left */
+    for( QFuture<void> &helper : helpers )
+    {
+        helper.waitForFinished();
+    }
+}
+
+#endif
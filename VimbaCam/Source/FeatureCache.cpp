@@ -0,0 +1,208 @@
+
+
+#include "FeatureCache.h"
+#include <QMutexLocker>
+
+using AVT::VmbAPI::FeaturePtr;
+
+/* the Vimba observer outlives the cache as long as a feature still holds it, Detach cuts it off */
+class FeatureCache::Invalidator : public AVT::VmbAPI::IFeatureObserver
+{
+    QMutex          m_Lock;
+    FeatureCache   *m_pCache;
+public:
+    explicit Invalidator( FeatureCache *pCache ) : m_pCache( pCache ) {}
+    void Detach()
+    {
+        QMutexLocker guard( &m_Lock );
+        m_pCache = NULL;
+    }
+    virtual void FeatureChanged( const FeaturePtr &feature )
+    {
+        QMutexLocker guard( &m_Lock );
+        if( NULL != m_pCache )
+        {
+            m_pCache->featureChanged( feature );
+        }
+    }
+};
+
+namespace
+{
+    VmbInt64_t&     valueOf( VmbInt64_t *, VmbInt64_t &n, double &, bool &, std::string & )     { return n; }
+    double&         valueOf( double *, VmbInt64_t &, double &d, bool &, std::string & )         { return d; }
+    bool&           valueOf( bool *, VmbInt64_t &, double &, bool &b, std::string & )           { return b; }
+    std::string&    valueOf( std::string *, VmbInt64_t &, double &, bool &, std::string &s )    { return s; }
+}
+
+FeatureCache::FeatureCache( const AVT::VmbAPI::CameraPtr &pCam )
+    : m_pCam            ( pCam )
+    , m_nHits           ( 0 )
+    , m_nMisses         ( 0 )
+    , m_nInvalidations  ( 0 )
+{
+    m_pInvalidator = new Invalidator( this );
+    SP_SET( m_pObserver, m_pInvalidator );
+}
+
+/* detach first: a notification in flight holds the invalidator's lock and then takes m_Lock */
+FeatureCache::~FeatureCache()
+{
+    m_pInvalidator->Detach();
+    for( QMap<QString, Entry>::iterator i = m_Entries.begin(); i != m_Entries.end(); ++i )
+    {
+        if( i.value().m_bCacheable )
+        {
+            i.value().m_pFeature->UnregisterObserver( m_pObserver );
+        }
+    }
+}
+
+/* the name lookup and the flags are answered from the camera's feature tree, not the device */
+bool FeatureCache::resolve( const QString &sName, FeaturePtr &pFeature )
+{
+    QMutexLocker resolveGuard( &m_ResolveLock );
+    {
+        QMutexLocker guard( &m_Lock );
+        QMap<QString, Entry>::const_iterator i = m_Entries.constFind( sName );
+        if( m_Entries.constEnd() != i )
+        {
+            pFeature = i.value().m_pFeature;
+            return true;
+        }
+    }
+    if( SP_ISNULL( m_pCam ) || VmbErrorSuccess != m_pCam->GetFeatureByName( sName.toStdString().c_str(), pFeature ) )
+    {
+        return false;
+    }
+    /* same rule as the tree: volatile features without a polling time have to be polled */
+    VmbFeatureFlagsType flags       = (VmbFeatureFlagsType)0UL;
+    VmbUint32_t         pollingTime = 0;
+    bool bCacheable =       VmbErrorSuccess == pFeature->GetFlags( flags )
+                        &&  VmbErrorSuccess == pFeature->GetPollingTime( pollingTime )
+                        &&  !( ( VmbFeatureFlagsVolatile & flags ) && 0 == pollingTime );
+    if( bCacheable )
+    {
+        bCacheable = VmbErrorSuccess == pFeature->RegisterObserver( m_pObserver );
+    }
+
+    Entry entry;
+    entry.m_pFeature    = pFeature;
+    entry.m_bCacheable  = bCacheable;
+    QMutexLocker guard( &m_Lock );
+    m_Entries.insert( sName, entry );
+    return true;
+}
+
+template <typename T>
+VmbErrorType FeatureCache::get( const char *pName, T &value )
+{
+    const QString sName( pName );
+    FeaturePtr pFeature;
+    if( !resolve( sName, pFeature ) )
+    {
+        return VmbErrorNotFound;
+    }
+    quint64 nGeneration = 0;
+    {
+        QMutexLocker guard( &m_Lock );
+        Entry &entry = m_Entries[sName];
+        if( entry.m_bValid )
+        {
+            value = valueOf( &value, entry.m_nValue, entry.m_dValue, entry.m_bValue, entry.m_sValue );
+            m_nHits.fetch_add( 1, std::memory_order_relaxed );
+            return VmbErrorSuccess;
+        }
+        nGeneration = entry.m_nGeneration;
+    }
+    m_nMisses.fetch_add( 1, std::memory_order_relaxed );
+    const VmbErrorType error = pFeature->GetValue( value );
+    if( VmbErrorSuccess != error )
+    {
+        return error;
+    }
+    QMutexLocker guard( &m_Lock );
+    Entry &entry = m_Entries[sName];
+    if( entry.m_bCacheable && nGeneration == entry.m_nGeneration )
+    {
+        valueOf( &value, entry.m_nValue, entry.m_dValue, entry.m_bValue, entry.m_sValue ) = value;
+        entry.m_bValid = true;
+    }
+    return VmbErrorSuccess;
+}
+
+VmbErrorType FeatureCache::GetFeature( const char *pName, FeaturePtr &pFeature )
+{
+    return resolve( QString( pName ), pFeature ) ? VmbErrorSuccess : VmbErrorNotFound;
+}
+
+VmbErrorType FeatureCache::GetValue( const char *pName, VmbInt64_t &nValue )
+{
+    return get( pName, nValue );
+}
+
+VmbErrorType FeatureCache::GetValue( const char *pName, double &dValue )
+{
+    return get( pName, dValue );
+}
+
+VmbErrorType FeatureCache::GetValue( const char *pName, bool &bValue )
+{
+    return get( pName, bValue );
+}
+
+VmbErrorType FeatureCache::GetValue( const char *pName, std::string &sValue )
+{
+    return get( pName, sValue );
+}
+
+void FeatureCache::Invalidate( const QString &sName )
+{
+    QMutexLocker guard( &m_Lock );
+    QMap<QString, Entry>::iterator i = m_Entries.find( sName );
+    if( m_Entries.end() != i )
+    {
+        i.value().m_bValid = false;
+        ++i.value().m_nGeneration;
+        m_nInvalidations.fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+
+void FeatureCache::InvalidateAll()
+{
+    QMutexLocker guard( &m_Lock );
+    for( QMap<QString, Entry>::iterator i = m_Entries.begin(); i != m_Entries.end(); ++i )
+    {
+        i.value().m_bValid = false;
+        ++i.value().m_nGeneration;
+    }
+}
+
+/* Vimba's notification thread. GetName is local, the new value is only read on the next access */
+void FeatureCache::featureChanged( const FeaturePtr &pFeature )
+{
+    std::string sName;
+    if( !SP_ISNULL( pFeature ) && VmbErrorSuccess == pFeature->GetName( sName ) )
+    {
+        Invalidate( QString::fromStdString( sName ) );
+    }
+}
+
+int FeatureCache::Features() const
+{
+    QMutexLocker guard( &m_Lock );
+    return m_Entries.size();
+}
+
+QString FeatureCache::Summary() const
+{
+    const quint64 nHits     = Hits();
+    const quint64 nMisses   = Misses();
+    const quint64 nReads    = nHits + nMisses;
+    return QString( "Feature cache: %1 features, %2 hits, %3 misses (%4% hit), %5 invalidations" )
+        .arg( Features() )
+        .arg( nHits )
+        .arg( nMisses )
+        .arg( 0 == nReads ? 0.0 : 100.0 * nHits / nReads, 0, 'f', 1 )
+        .arg( Invalidations() );
+}
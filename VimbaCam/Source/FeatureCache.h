@@ -0,0 +1,81 @@
+
+
+#ifndef FEATURECACHE_H
+#define FEATURECACHE_H
+
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QSharedPointer>
+#include <string>
+#include <atomic>
+
+#include <VimbaCPP/Include/Camera.h>
+#include <VimbaCPP/Include/Feature.h>
+#include <VimbaCPP/Include/IFeatureObserver.h>
+
+/** feature values of one camera, read from the device once and kept until the feature reports a change.
+* each feature is resolved by name once; the cache registers its own observer on it, the tree's FeatureObserver
+* only observes features while they are expanded. volatile features without a polling time never notify,
+* they are read on every access and counted as misses.
+* the Get functions may be called from any thread, a miss reads the device outside the lock
+*/
+class FeatureCache
+{
+    struct Entry
+    {
+        AVT::VmbAPI::FeaturePtr     m_pFeature;
+        bool                        m_bCacheable;       // the feature notifies its changes
+        bool                        m_bValid;
+        quint64                     m_nGeneration;      // bumped by every change, a read that raced one is not stored
+        VmbInt64_t                  m_nValue;
+        double                      m_dValue;
+        bool                        m_bValue;
+        std::string                 m_sValue;
+        Entry() : m_bCacheable( false ), m_bValid( false ), m_nGeneration( 0 ), m_nValue( 0 ), m_dValue( 0.0 ), m_bValue( false ) {}
+    };
+    class Invalidator;
+
+    AVT::VmbAPI::CameraPtr                  m_pCam;
+    Invalidator                            *m_pInvalidator;     // owned by m_pObserver, detached on destruction
+    AVT::VmbAPI::IFeatureObserverPtr        m_pObserver;
+    QMutex                                  m_ResolveLock;      // one thread resolves and registers at a time
+    mutable QMutex                          m_Lock;             // entries, never held across a Vimba call
+    QMap<QString, Entry>                    m_Entries;
+    std::atomic<quint64>                    m_nHits;
+    std::atomic<quint64>                    m_nMisses;
+    std::atomic<quint64>                    m_nInvalidations;
+
+    FeatureCache( const FeatureCache& );
+    FeatureCache& operator=( const FeatureCache& );
+
+    bool                    resolve         ( const QString &sName, AVT::VmbAPI::FeaturePtr &pFeature );
+    template <typename T>
+    VmbErrorType            get             ( const char *pName, T &value );
+    void                    featureChanged  ( const AVT::VmbAPI::FeaturePtr &pFeature );
+public:
+    /**pCam may be null for frame sources without a camera, every Get then fails with VmbErrorNotFound*/
+    explicit FeatureCache( const AVT::VmbAPI::CameraPtr &pCam );
+    ~FeatureCache();
+
+    /**the feature pointer, resolved on the first request. VmbErrorNotFound if the camera has no such feature*/
+    VmbErrorType            GetFeature      ( const char *pName, AVT::VmbAPI::FeaturePtr &pFeature );
+    /**the feature's value, from the device only on the first read and after a change*/
+    VmbErrorType            GetValue        ( const char *pName, VmbInt64_t &nValue );
+    VmbErrorType            GetValue        ( const char *pName, double &dValue );
+    VmbErrorType            GetValue        ( const char *pName, bool &bValue );
+    VmbErrorType            GetValue        ( const char *pName, std::string &sValue );
+    /**force the next read of the feature, or of all features, to go to the device*/
+    void                    Invalidate      ( const QString &sName );
+    void                    InvalidateAll   ();
+
+    quint64                 Hits            () const    { return m_nHits.load( std::memory_order_relaxed ); }
+    quint64                 Misses          () const    { return m_nMisses.load( std::memory_order_relaxed ); }
+    quint64                 Invalidations   () const    { return m_nInvalidations.load( std::memory_order_relaxed ); }
+    int                     Features        () const;
+    /**short one line form for the logger*/
+    QString                 Summary         () const;
+};
+typedef QSharedPointer<FeatureCache> FeatureCachePtr;
+
+#endif
@@ -0,0 +1,69 @@
+#include "FitWarmStart.h"
+
+FitWarmStart::FitWarmStart()
+    : m_Rss(0), m_Valid(false)
+{
+    resetCounters();
+}
+
+bool FitWarmStart::seed(const QRect& roi, QVector<double>& para) const
+{
+    if (!m_Valid || roi != m_Roi)
+        return false;
+    para = m_Para;
+    return true;
+}
+
+bool FitWarmStart::accept(bool converged, double rss)
+{
+    /* the seed sits in a local minimum or the beam jumped, the cold guess starts from where the beam is now */
+    if (!converged || rss > RESET_RSS_RATIO * m_Rss)
+    {
+        m_Valid = false;
+        ++m_Resets;
+        return false;
+    }
+    return true;
+}
+
+void FitWarmStart::record(const QRect& roi, bool warm, bool converged, double rss, size_t iterations, const QVector<double>& para)
+{
+    if (warm)
+    {
+        ++m_WarmFits;
+        m_WarmIterations += iterations;
+    }
+    else
+    {
+        ++m_ColdFits;
+        m_ColdIterations += iterations;
+    }
+    m_Valid = converged;
+    if (converged)
+    {
+        m_Para = para;
+        m_Roi = roi;
+        m_Rss = rss;
+    }
+}
+
+void FitWarmStart::resetCounters()
+{
+    m_WarmFits = 0;
+    m_WarmIterations = 0;
+    m_ColdFits = 0;
+    m_ColdIterations = 0;
+    m_Resets = 0;
+    m_Expired = 0;
+}
+
+QString FitWarmStart::summary(const QString& sName) const
+{
+    const auto mean = [](quint64 iterations, quint64 fits) { return fits > 0 ? double(iterations) / fits : 0.; };
+    return QString("%1: %2 warm started fits, %3 iterations on average; %4 cold, %5 iterations on average; %6 warm fits redone cold; %7 stopped at the time budget")
+        .arg(sName)
+        .arg(m_WarmFits).arg(mean(m_WarmIterations, m_WarmFits), 0, 'f', 1)
+        .arg(m_ColdFits).arg(mean(m_ColdIterations, m_ColdFits), 0, 'f', 1)
+        .arg(m_Resets)
+        .arg(m_Expired);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+/* warm start of a gaussian fit: the beam barely moves between frames, so the parameters of the last converged fit
+* are a far better initial guess than one built from the frame alone, and the solver is done in a few iterations.
+* the seed is dropped when the ROI changes or a fit does not converge; a warm fit that does not converge, or whose
+* residual rises above RESET_RSS_RATIO times the one of the seed, is done again from the cold guess.
+* a warm fit stopped on its time budget is not redone, a cold one would get a budget of its own */
+class FitWarmStart
+{
+public:
+    static constexpr double RESET_RSS_RATIO = 4.;
+
+private:
+    QVector<double> m_Para;
+    QRect m_Roi;
+    double m_Rss;
+    bool m_Valid;
+
+    /* since resetCounters */
+    quint64 m_WarmFits;
+    quint64 m_WarmIterations;
+    quint64 m_ColdFits;
+    quint64 m_ColdIterations;
+    quint64 m_Resets;
+    quint64 m_Expired;
+
+    bool seed(const QRect& roi, QVector<double>& para) const;
+    bool accept(bool converged, double rss);
+    void record(const QRect& roi, bool warm, bool converged, double rss, size_t iterations, const QVector<double>& para);
+
+public:
+    FitWarmStart();
+
+    /* solve fit on roi, from the last converged parameters if bWarm and there are any, else from cold.
+    *  FIT is Gaussian1DFit or Gaussian2DFit, its data already set */
+    template <class FIT>
+    void solve(FIT& fit, bool bWarm, const QRect& roi, const QVector<double>& cold)
+    {
+        QVector<double> para;
+        bool warm = bWarm && seed(roi, para);
+        fit.set_initialP(warm ? para : cold);
+        fit.solve_system();
+        if (fit.expired())
+        {
+            /* the best parameters so far are the result, record drops the seed as the fit did not converge */
+            ++m_Expired;
+        }
+        else if (warm && !accept(fit.converged(), fit.getRss()))
+        {
+            warm = false;
+            fit.set_initialP(cold);
+            fit.solve_system();
+            if (fit.expired())
+                ++m_Expired;
+        }
+        record(roi, warm, fit.converged(), fit.getRss(), fit.getIterations(), fit.fittedPara());
+    }
+    void invalidate() { m_Valid = false; }
+    quint64 fitCount() const { return m_WarmFits + m_ColdFits; }
+    void resetCounters();
+    /* one line: fits and mean iterations, warm and cold, the warm fits redone and the fits stopped on the time budget */
+    QString summary(const QString& sName) const;
+};
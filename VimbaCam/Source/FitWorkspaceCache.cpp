@@ -0,0 +1,117 @@
+#include "FitWorkspaceCache.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+namespace
+{
+    struct IdleWorkspace
+    {
+        gsl_multifit_nlinear_parameters params;
+        size_t n;
+        size_t p;
+        gsl_multifit_nlinear_workspace* work;
+    };
+
+    /* oldest released first */
+    struct Cache
+    {
+        QMutex lock;
+        QVector<IdleWorkspace> idle;
+        FitWorkspaceCache::Counters counters;
+
+        Cache() : counters{0, 0, 0, 0} {}
+        ~Cache()
+        {
+            for (const IdleWorkspace& entry : idle)
+                gsl_multifit_nlinear_free(entry.work);
+        }
+    };
+
+    Cache& cache()
+    {
+        static Cache instance;
+        return instance;
+    }
+
+    /* the state of the method depends on all of the parameters, not only on the trust region subproblem */
+    bool sameParameters(const gsl_multifit_nlinear_parameters& l, const gsl_multifit_nlinear_parameters& r)
+    {
+        return l.trs == r.trs && l.scale == r.scale && l.solver == r.solver && l.fdtype == r.fdtype
+            && l.factor_up == r.factor_up && l.factor_down == r.factor_down && l.avmax == r.avmax
+            && l.h_df == r.h_df && l.h_fvv == r.h_fvv;
+    }
+}
+
+gsl_multifit_nlinear_workspace* FitWorkspaceCache::acquire(
+    const gsl_multifit_nlinear_parameters& params, size_t n, size_t p)
+{
+    Cache& c = cache();
+    {
+        QMutexLocker guard(&c.lock);
+        /* the most recently released first, that is usually the one the caller just gave back */
+        for (int i = c.idle.size() - 1; i >= 0; --i)
+        {
+            const IdleWorkspace& entry = c.idle.at(i);
+            if (entry.n == n && entry.p == p && sameParameters(entry.params, params))
+            {
+                gsl_multifit_nlinear_workspace* work = entry.work;
+                c.idle.remove(i);
+                ++c.counters.reused;
+                return work;
+            }
+        }
+        ++c.counters.allocated;
+    }
+    /* the allocation outside the lock, it is the slow part */
+    return gsl_multifit_nlinear_alloc(gsl_multifit_nlinear_trust, &params, n, p);
+}
+
+void FitWorkspaceCache::release(const gsl_multifit_nlinear_parameters& params, gsl_multifit_nlinear_workspace* work)
+{
+    if (work == nullptr)
+        return;
+    IdleWorkspace entry;
+    entry.params = params;
+    entry.n = gsl_multifit_nlinear_residual(work)->size;
+    entry.p = gsl_multifit_nlinear_position(work)->size;
+    entry.work = work;
+
+    gsl_multifit_nlinear_workspace* evicted = nullptr;
+    Cache& c = cache();
+    {
+        QMutexLocker guard(&c.lock);
+        c.idle.append(entry);
+        if (c.idle.size() > MAX_IDLE)
+        {
+            evicted = c.idle.first().work;
+            c.idle.removeFirst();
+            ++c.counters.freed;
+        }
+    }
+    if (evicted != nullptr)
+        gsl_multifit_nlinear_free(evicted);
+}
+
+FitWorkspaceCache::Counters FitWorkspaceCache::counters()
+{
+    Cache& c = cache();
+    QMutexLocker guard(&c.lock);
+    Counters counters = c.counters;
+    counters.idle = c.idle.size();
+    return counters;
+}
+
+void FitWorkspaceCache::clear()
+{
+    QVector<IdleWorkspace> idle;
+    Cache& c = cache();
+    {
+        QMutexLocker guard(&c.lock);
+        idle.swap(c.idle);
+        c.counters.freed += idle.size();
+    }
+    for (const IdleWorkspace& entry : idle)
+        gsl_multifit_nlinear_free(entry.work);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <gsl/gsl_multifit_nlinear.h>
+
+#include <QtGlobal>
+
+/* gsl nonlinear least squares workspaces kept for reuse, shared by all fits of the process.
+* a workspace is sized by the number of residuals n and parameters p, the n x p jacobian of a full frame 2D fit
+* alone is tens of megabytes. a fit takes one for its data size and gives it back when the size changes or the
+* fit is destroyed; the next fit of that size with the same parameters gets it again instead of a new allocation.
+* at most MAX_IDLE workspaces are kept back, the longest unused are freed first */
+class FitWorkspaceCache
+{
+public:
+    enum
+    {
+        MAX_IDLE = 4
+    };
+
+    struct Counters
+    {
+        quint64 allocated;  /* gsl_multifit_nlinear_alloc calls */
+        quint64 reused;     /* workspaces handed out again */
+        quint64 freed;
+        int idle;           /* kept back now */
+    };
+
+    /* a workspace for n residuals and p parameters with the trust region method and params */
+    static gsl_multifit_nlinear_workspace* acquire(const gsl_multifit_nlinear_parameters& params, size_t n, size_t p);
+    /* give back a workspace from acquire, params as given there. null is ignored */
+    static void release(const gsl_multifit_nlinear_parameters& params, gsl_multifit_nlinear_workspace* work);
+    static Counters counters();
+    /* free the idle workspaces */
+    static void clear();
+};
@@ -0,0 +1,224 @@
+
+
+#include "FrameBurst.h"
+#include "FrameRecorder.h"
+#include "ImageProcessingThread.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <cstring>
+
+FrameBurst::FrameBurst()
+    : m_nCapacity       ( 0 )
+    , m_State           ( State_Idle )
+    , m_nCaptured       ( 0 )
+    , m_nPublished      ( 0 )
+    , m_nIncomplete     ( 0 )
+    , m_nFailed         ( 0 )
+    , m_bFullBitDepth   ( false )
+    , m_bAbort          ( false )
+{
+}
+
+FrameBurst::~FrameBurst()
+{
+    /* the file is still written, only the analysis is cut short */
+    m_bAbort.store( true, std::memory_order_relaxed );
+    wait();
+}
+
+/* GUI thread. the buffers are touched once so the capture does not run into page faults */
+bool FrameBurst::Start( int nFrames, VmbUint32_t nFrameSize, const QString &sFileName )
+{
+    if( IsActive() || isRunning() || nFrames <= 0 || 0 == nFrameSize )
+    {
+        return false;
+    }
+    try
+    {
+        QVector<tFrameInfo> frames( nFrames );
+        for( int i = 0; i < nFrames; ++i )
+        {
+            const FrameDataPtr pData( new VmbUchar_t[nFrameSize], DeleteArray<VmbUchar_t> );
+            memset( pData.data(), 0, nFrameSize );
+            frames[i] = tFrameInfo( BaseFrame( VmbPixelFormatMono8, 0, 0, 0, false ), pData );
+        }
+        m_Frames.swap( frames );
+    }
+    catch( const std::bad_alloc& )
+    {
+        return false;
+    }
+    m_nCapacity     = nFrameSize;
+    m_sFileName     = sFileName;
+    m_nCaptured     = 0;
+    m_nPublished.store( 0, std::memory_order_relaxed );
+    m_nIncomplete.store( 0, std::memory_order_relaxed );
+    m_nFailed.store( 0, std::memory_order_relaxed );
+    m_State.store( State_Capturing, std::memory_order_release );
+    return true;
+}
+
+tFrameInfo* FrameBurst::Begin( const BaseFrame &info )
+{
+    if( State_Capturing != state() )
+    {
+        return NULL;
+    }
+    if( info.Size() > m_nCapacity )
+    {
+        CountFailed();
+        return NULL;
+    }
+    tFrameInfo &frame = m_Frames[m_nCaptured];
+    static_cast<BaseFrame&>( frame ) = info;
+    frame.Trace().Clear();
+    return &frame;
+}
+
+void FrameBurst::Commit()
+{
+    ++m_nCaptured;
+    m_nPublished.store( m_nCaptured, std::memory_order_release );
+    if( m_nCaptured == m_Frames.size() )
+    {
+        m_State.store( State_Captured, std::memory_order_release );
+    }
+}
+
+void FrameBurst::CountIncomplete()
+{
+    if( State_Capturing == state() )
+    {
+        m_nIncomplete.fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+
+void FrameBurst::CountFailed()
+{
+    if( State_Capturing == state() )
+    {
+        m_nFailed.fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+
+void FrameBurst::EndCapture()
+{
+    int expected = State_Capturing;
+    m_State.compare_exchange_strong( expected, State_Captured, std::memory_order_acq_rel );
+}
+
+/* GUI thread */
+bool FrameBurst::Flush( const QSharedPointer<ImageProcessingThread> &pProcessing, bool bFullBitDepth )
+{
+    if( State_Captured != state() || isRunning() )
+    {
+        return false;
+    }
+    if( 0 == Captured() )
+    {
+        release();
+        m_State.store( State_Idle, std::memory_order_release );
+        return false;
+    }
+    m_pProcessing   = pProcessing;
+    m_bFullBitDepth = bFullBitDepth;
+    m_bAbort.store( false, std::memory_order_relaxed );
+    m_State.store( State_Flushing, std::memory_order_release );
+    start( QThread::LowPriority );
+    return true;
+}
+
+void FrameBurst::release()
+{
+    m_Frames.clear();
+    m_Frames.squeeze();
+    m_nCapacity = 0;
+}
+
+QString FrameBurst::CaptureSummary() const
+{
+    const int nCaptured = Captured();
+    if( 0 == nCaptured )
+    {
+        return QString( "Burst: no frames captured" );
+    }
+    const tFrameInfo &first = m_Frames.at( 0 );
+    const tFrameInfo &last  = m_Frames.at( nCaptured - 1 );
+    const double dSeconds   = ( last.Trace().Stamp( FrameStage_Received ) - first.Trace().Stamp( FrameStage_Received ) ) * 1.0e-9;
+    const double dFPS       = dSeconds > 0.0 ? ( nCaptured - 1 ) / dSeconds : 0.0;
+    /* the camera counts every frame it sends, a gap in the ids is a frame lost on the way */
+    quint64 nMissing = 0;
+    const VmbUint64_t nFirstID  = first.Metadata().m_nFrameID;
+    const VmbUint64_t nLastID   = last.Metadata().m_nFrameID;
+    if( nLastID >= nFirstID && nLastID - nFirstID + 1 > static_cast<VmbUint64_t>( nCaptured ) )
+    {
+        nMissing = nLastID - nFirstID + 1 - nCaptured;
+    }
+    const quint64 nIncomplete   = m_nIncomplete.load( std::memory_order_relaxed );
+    const quint64 nFailed       = m_nFailed.load( std::memory_order_relaxed );
+    return QString( "Burst: %1 of %2 frames in %3 s, %4 fps; %5 lost (%6 missing ids, %7 incomplete, %8 not copied), %9 MB" )
+           .arg( nCaptured ).arg( m_Frames.size() ).arg( dSeconds, 0, 'f', 3 ).arg( dFPS, 0, 'f', 1 )
+           .arg( nMissing + nIncomplete + nFailed ).arg( nMissing ).arg( nIncomplete ).arg( nFailed )
+           .arg( static_cast<double>( m_nCapacity ) * nCaptured / ( 1024.0 * 1024.0 ), 0, 'f', 1 );
+}
+
+/* burst thread: one frame at a time, each only once the conversion and reductions queues are empty,
+* so the drop-oldest queues never drop a frame of the burst. the reductions stage waits for room in the fit queue for
+* burst frames, so every one is fitted and its result recorded to the shot results; only the plot skips frames */
+int FrameBurst::analyze()
+{
+    const int nCaptured = Captured();
+    int nFed = 0;
+    for( ; nFed < nCaptured; ++nFed )
+    {
+        /* woken as the stages take frames, the timeout only bounds how late an abort is seen */
+        while(      !m_bAbort.load( std::memory_order_relaxed )
+                &&  m_pProcessing->isRunning()
+                &&  !m_pProcessing->waitIdle( 50 ) )
+        {
+        }
+        if( m_bAbort.load( std::memory_order_relaxed ) || !m_pProcessing->isRunning() )
+        {
+            break;
+        }
+        /* a fresh trace, the latency statistics measure the analysis and not the time the frame waited in memory */
+        tFrameInfo frame( m_Frames.at( nFed ) );
+        frame.Trace().Clear();
+        frame.Trace().Mark( FrameStage_Received );
+        frame.Trace().Mark( FrameStage_Queued );
+        frame.Metadata().m_bBurst = true;
+        m_pProcessing->setThreadFrame( frame, m_bFullBitDepth );
+    }
+    return nFed;
+}
+
+void FrameBurst::run()
+{
+    const int nCaptured = Captured();
+    QElapsedTimer timer;
+    timer.start();
+    const int nAnalyzed = NULL != m_pProcessing ? analyze() : 0;
+    const double dAnalysis = timer.elapsed() * 1.0e-3;
+    m_pProcessing.clear();
+    m_Frames.resize( nCaptured );
+    timer.start();
+    QString sError;
+    const bool bOk = FrameRecorder::WriteFrames( m_sFileName, m_Frames, sError );
+    const double dWrite = timer.elapsed() * 1.0e-3;
+    release();
+    {
+        QMutexLocker guard( &m_ResultLock );
+        m_sResult = bOk ? QString( "Burst flushed: %1 of %2 frames analyzed in %3 s, written in %4 s to %5" )
+                          .arg( nAnalyzed ).arg( nCaptured ).arg( dAnalysis, 0, 'f', 2 ).arg( dWrite, 0, 'f', 2 ).arg( QDir::toNativeSeparators( m_sFileName ) )
+                        : QString( "ERROR: burst of %1 frames not written to %2, %3" )
+                          .arg( nCaptured ).arg( QDir::toNativeSeparators( m_sFileName ) ).arg( sError );
+    }
+    m_State.store( State_Idle, std::memory_order_release );
+}
+
+QString FrameBurst::FlushResult() const
+{
+    QMutexLocker guard( &m_ResultLock );
+    return m_sResult;
+}
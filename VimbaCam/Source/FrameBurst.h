@@ -0,0 +1,98 @@
+
+
+#ifndef FRAMEBURST_H
+#define FRAMEBURST_H
+
+#include <QThread>
+#include <QString>
+#include <QMutex>
+#include <QVector>
+#include <QSharedPointer>
+#include <atomic>
+
+#include "Helper.h"
+
+class ImageProcessingThread;
+
+/** captures a burst of frames into buffers allocated up front, faster than the analysis, the display or the disk could take them.
+* while the burst is captured the frame callback only copies into the next buffer and re-queues the camera frame,
+* nothing is handed to the processing, histogram or recorder threads. once all buffers are filled Flush feeds the
+* captured frames to the analysis as fast as it takes them, without queue drops, and writes them to a FrameRecorder
+* file on the burst's own thread. the results of every analysed frame end up in the viewer's shot results
+*/
+class FrameBurst : public QThread
+{
+public:
+    enum State
+    {
+        State_Idle      = 0,
+        State_Capturing = 1,    // the callback fills the buffers
+        State_Captured  = 2,    // all buffers filled or capture ended, waiting for Flush
+        State_Flushing  = 3,    // analysis and file written on the burst thread
+    };
+
+private:
+    QVector<tFrameInfo>         m_Frames;           // one preallocated buffer per frame, the first m_nCaptured hold frames
+    VmbUint32_t                 m_nCapacity;        // bytes per buffer
+    QString                     m_sFileName;
+    std::atomic<int>            m_State;
+
+    /* written by the frame callback only while capturing */
+    int                         m_nCaptured;
+    std::atomic<int>            m_nPublished;       // m_nCaptured as far as the frames are complete
+    std::atomic<quint64>        m_nIncomplete;
+    std::atomic<quint64>        m_nFailed;          // not copied: too large for the buffers or not readable
+
+    /* the flush */
+    QSharedPointer<ImageProcessingThread>   m_pProcessing;
+    bool                        m_bFullBitDepth;
+    std::atomic<bool>           m_bAbort;
+    mutable QMutex              m_ResultLock;
+    QString                     m_sResult;
+
+    FrameBurst( const FrameBurst& );
+    FrameBurst& operator=( const FrameBurst& );
+
+    void                release         ();
+    int                 analyze         ();
+protected:
+    virtual void run();
+public:
+    FrameBurst();
+    ~FrameBurst();
+
+    /**allocate nFrames buffers of nFrameSize bytes and start capturing into them with the next frame.
+    * false if a burst is still running or the memory is not available
+    */
+    bool                Start           ( int nFrames, VmbUint32_t nFrameSize, const QString &sFileName );
+    /**frame callback: the buffer for the next frame with info set and a fresh trace, null if the burst is not
+    * capturing or the frame does not fit. the frame data is to be copied into it, then Commit called
+    */
+    tFrameInfo*         Begin           ( const BaseFrame &info );
+    /**frame callback: the frame given by Begin is complete, the burst is captured with the last buffer*/
+    void                Commit          ();
+    /**frame callback: a frame arrived incomplete*/
+    void                CountIncomplete ();
+    /**frame callback: a frame could not be copied*/
+    void                CountFailed     ();
+    /**end the capture with the frames taken so far. must not run alongside the callback, FrameObserver calls it under its stopping lock*/
+    void                EndCapture      ();
+    /**feed the captured frames to pProcessing if it is running, write them to the file and release the buffers, in the background.
+    * false if there is no captured burst
+    */
+    bool                Flush           ( const QSharedPointer<ImageProcessingThread> &pProcessing, bool bFullBitDepth );
+
+    State               state           () const    { return static_cast<State>( m_State.load( std::memory_order_acquire ) ); }
+    /**capturing or flushing, the live pipeline gets no frames meanwhile*/
+    bool                IsActive        () const    { return State_Idle != state(); }
+    QString             FileName        () const    { return m_sFileName; }
+    int                 Requested       () const    { return m_Frames.size(); }
+    int                 Captured        () const    { return m_nPublished.load( std::memory_order_acquire ); }
+    /**one line report of the capture: frames, achieved rate and losses. valid once captured*/
+    QString             CaptureSummary  () const;
+    /**one line outcome of the last finished flush*/
+    QString             FlushResult     () const;
+};
+typedef QSharedPointer<FrameBurst> FrameBurstPtr;
+
+#endif
@@ -0,0 +1,69 @@
+
+#include "FrameDropStats.h"
+
+quint64 FrameDropStats::Lost() const
+{
+    return    Drops( FrameDrop_Incomplete )
+            + Drops( FrameDrop_CopyFailed )
+            + Drops( FrameDrop_QueueOverflow )
+            + Drops( FrameDrop_Analysis );
+}
+
+void FrameDropStats::Reset()
+{
+    m_Received.store( 0, std::memory_order_relaxed );
+    for( int i = 0; i < FrameDrop_Count; ++i )
+    {
+        m_Drops[i].store( 0, std::memory_order_relaxed );
+    }
+    m_WindowReceived    = 0;
+    m_WindowDrops       = 0;
+    m_Warned            = false;
+}
+
+/* the counters of the other stages lag a few frames behind the callback, over a window that does not matter */
+bool FrameDropStats::CheckWindow( double dThreshold, double &dWindowRatio )
+{
+    const quint64 nReceived = Received();
+    if( nReceived < m_WindowReceived + WINDOW_FRAMES )
+    {
+        return false;
+    }
+    const quint64 nLost = Lost();
+    dWindowRatio        = static_cast<double>( nLost - m_WindowDrops ) / ( nReceived - m_WindowReceived );
+    m_WindowReceived    = nReceived;
+    m_WindowDrops       = nLost;
+    if( m_Warned )
+    {
+        m_Warned = dWindowRatio >= 0.5 * dThreshold;
+        return false;
+    }
+    m_Warned = dWindowRatio > dThreshold;
+    return m_Warned;
+}
+
+QString FrameDropStats::ReasonName( FrameDropReason reason )
+{
+    switch( reason )
+    {
+    case FrameDrop_Incomplete:      return "Inc";
+    case FrameDrop_CopyFailed:      return "Cpy";
+    case FrameDrop_QueueOverflow:   return "Que";
+    case FrameDrop_Analysis:        return "Ana";
+    case FrameDrop_Fit:             return "Fit";
+    case FrameDrop_Display:         return "Plt";
+    case FrameDrop_Burst:           return "Bst";
+    default:                        return "Unknown";
+    }
+}
+
+QString FrameDropStats::Summary() const
+{
+    QString sSummary( "Drop" );
+    for( int i = 0; i < FrameDrop_Count; ++i )
+    {
+        const FrameDropReason reason = static_cast<FrameDropReason>( i );
+        sSummary += " " + ReasonName( reason ) + ":" + QString::number( Drops( reason ) );
+    }
+    return sSummary;
+}
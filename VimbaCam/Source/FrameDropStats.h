@@ -0,0 +1,62 @@
+
+
+#ifndef FRAMEDROPSTATS_H
+#define FRAMEDROPSTATS_H
+
+#include <QString>
+#include <QSharedPointer>
+#include <QtGlobal>
+#include <atomic>
+
+/** places where a frame can leave the pipeline before it reaches the screen*/
+enum FrameDropReason
+{
+    FrameDrop_Incomplete    = 0,    // driver delivered an incomplete frame, re-queued as is
+    FrameDrop_CopyFailed    = 1,    // no buffer for the copy or lease
+    FrameDrop_QueueOverflow = 2,    // oldest frame dropped by the full processing queue
+    FrameDrop_Analysis      = 3,    // unsupported format or size, or pushed out of the full reductions queue
+    FrameDrop_Fit           = 4,    // reduced, but pushed out of the full fit queue: the fits are slower than the frame rate
+    FrameDrop_Display       = 5,    // analysed, but not plotted: the display rate is lower than the frame rate
+    FrameDrop_Burst         = 6,    // not analysed: the live view pauses while a captured burst is analysed and written
+    FrameDrop_Count         = 7,
+};
+
+/** lock free drop counters of one viewer's pipeline.
+* Count may be called from any thread, CheckWindow only from the frame callback
+*/
+class FrameDropStats
+{
+    std::atomic<quint64>    m_Received;                     // every frame the source delivered, complete or not
+    std::atomic<quint64>    m_Drops[FrameDrop_Count];
+    /* drop ratio window, only touched by the frame callback */
+    quint64                 m_WindowReceived;
+    quint64                 m_WindowDrops;
+    bool                    m_Warned;                       // above threshold, waiting for the ratio to recover
+
+    FrameDropStats( const FrameDropStats& );
+    FrameDropStats& operator=( const FrameDropStats& );
+public:
+    /**frames per window the drop ratio is evaluated on*/
+    enum { WINDOW_FRAMES = 200 };
+
+    FrameDropStats()                                { Reset(); }
+    void                    CountReceived()                 { m_Received.fetch_add( 1, std::memory_order_relaxed ); }
+    void                    Count( FrameDropReason reason, quint64 n = 1 ) { m_Drops[reason].fetch_add( n, std::memory_order_relaxed ); }
+    quint64                 Received() const                { return m_Received.load( std::memory_order_relaxed ); }
+    quint64                 Drops( FrameDropReason reason ) const { return m_Drops[reason].load( std::memory_order_relaxed ); }
+    /**frames lost against the user's will, fit and display skips depend on the chosen analysis and burst pauses on the user's
+    * burst, they are not counted
+    */
+    quint64                 Lost() const;
+    void                    Reset();
+    /**call once per received frame. true once per crossing when the lost ratio of the last window
+    * went above dThreshold, it has to fall below half of it before the next warning
+    */
+    bool                    CheckWindow( double dThreshold, double &dWindowRatio );
+    static QString          ReasonName( FrameDropReason reason );
+    /**short one line form for the status bar*/
+    QString                 Summary() const;
+};
+typedef QSharedPointer<FrameDropStats> FrameDropStatsPtr;
+
+#endif
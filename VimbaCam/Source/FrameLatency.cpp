@@ -0,0 +1,190 @@
+
+#include "FrameLatency.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+quint64 FrameTrace::Now()
+{
+    return static_cast<quint64>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+void FrameTrace::Clear()
+{
+    for( int i = 0; i < FrameStage_Count; ++i )
+    {
+        m_Stamps[i] = 0;
+    }
+}
+
+int LatencyHistogram::bucketOf( quint64 ns )
+{
+    if( ns < SUB_BUCKETS )
+    {
+        return static_cast<int>( ns );
+    }
+    int msb = 0;
+    while( ( ns >> ( msb + 1 ) ) != 0 )
+    {
+        ++msb;
+    }
+    const int sub = static_cast<int>( ( ns >> ( msb - SUB_BUCKET_BITS ) ) & ( SUB_BUCKETS - 1 ) );
+    return ( msb - SUB_BUCKET_BITS + 1 ) * SUB_BUCKETS + sub;
+}
+
+/* centre of a bucket in ns */
+double LatencyHistogram::bucketMid( int bucket )
+{
+    if( bucket < SUB_BUCKETS )
+    {
+        return bucket;
+    }
+    const int       shift = bucket / SUB_BUCKETS - 1;
+    const double    lower = std::ldexp( static_cast<double>( SUB_BUCKETS + bucket % SUB_BUCKETS ), shift );
+    return lower + std::ldexp( 0.5, shift );
+}
+
+void LatencyHistogram::Record( quint64 ns )
+{
+    m_Buckets[bucketOf( ns )].fetch_add( 1, std::memory_order_relaxed );
+    m_Count.fetch_add( 1, std::memory_order_relaxed );
+    m_SumNs.fetch_add( ns, std::memory_order_relaxed );
+    quint64 max = m_MaxNs.load( std::memory_order_relaxed );
+    while( ns > max && !m_MaxNs.compare_exchange_weak( max, ns, std::memory_order_relaxed ) )
+    {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for( int i = 0; i < BUCKET_COUNT; ++i )
+    {
+        m_Buckets[i].store( 0, std::memory_order_relaxed );
+    }
+    m_Count.store( 0, std::memory_order_relaxed );
+    m_SumNs.store( 0, std::memory_order_relaxed );
+    m_MaxNs.store( 0, std::memory_order_relaxed );
+}
+
+double LatencyHistogram::Mean() const
+{
+    const quint64 count = Count();
+    return count != 0 ? m_SumNs.load( std::memory_order_relaxed ) / 1000.0 / count : 0.0;
+}
+
+/* works on a snapshot of the buckets, records running concurrently only shift the result by a few samples */
+double LatencyHistogram::Percentile( double p ) const
+{
+    quint32 snapshot[BUCKET_COUNT];
+    quint64 total = 0;
+    for( int i = 0; i < BUCKET_COUNT; ++i )
+    {
+        snapshot[i] = m_Buckets[i].load( std::memory_order_relaxed );
+        total += snapshot[i];
+    }
+    if( 0 == total )
+    {
+        return 0.0;
+    }
+    const quint64 rank = std::max<quint64>( 1, static_cast<quint64>( std::ceil( p * total ) ) );
+    quint64 seen = 0;
+    for( int i = 0; i < BUCKET_COUNT; ++i )
+    {
+        seen += snapshot[i];
+        if( seen >= rank )
+        {
+            return bucketMid( i ) / 1000.0;
+        }
+    }
+    return Max();
+}
+
+void FrameLatencyStats::Record( const FrameTrace &trace )
+{
+    if( !trace.IsValid() )
+    {
+        return;
+    }
+    quint64 previous = trace.Stamp( FrameStage_Received );
+    for( int i = FrameStage_Received + 1; i < FrameStage_Count; ++i )
+    {
+        const FrameStage stage = static_cast<FrameStage>( i );
+        if( trace.Reached( stage ) )
+        {
+            const quint64 stamp = trace.Stamp( stage );
+            m_Stages[stage].Record( stamp >= previous ? stamp - previous : 0 );
+            previous = stamp;
+        }
+    }
+    if( trace.Reached( FrameStage_Plotted ) )
+    {
+        m_Total.Record( previous - trace.Stamp( FrameStage_Received ) );
+    }
+}
+
+void FrameLatencyStats::Reset()
+{
+    for( int i = 0; i < FrameStage_Count; ++i )
+    {
+        m_Stages[i].Reset();
+    }
+    m_Total.Reset();
+}
+
+QString FrameLatencyStats::StageName( FrameStage stage )
+{
+    switch( stage )
+    {
+    case FrameStage_Received:   return "Received";
+    case FrameStage_Queued:     return "Copy/Queue";
+    case FrameStage_Dequeued:   return "Queue wait";
+    case FrameStage_Converted:  return "Conversion";
+    case FrameStage_Handoff:    return "Handoff";
+    case FrameStage_Projected:  return "Projections";
+    case FrameStage_Fitted:     return "Fits";
+    case FrameStage_Rendered:   return "Render prep";
+    case FrameStage_Plotted:    return "Replot";
+    default:                    return "Unknown";
+    }
+}
+
+QString FrameLatencyStats::Report() const
+{
+    QString sReport;
+    QTextStream out( &sReport );
+    out << QString( "%1%2%3%4%5%6%7\n" )
+           .arg( "Stage", -14 ).arg( "Count", 10 ).arg( "p50 [us]", 12 ).arg( "p90 [us]", 12 )
+           .arg( "p99 [us]", 12 ).arg( "max [us]", 12 ).arg( "mean [us]", 12 );
+    for( int i = FrameStage_Received + 1; i <= FrameStage_Count; ++i )
+    {
+        /* the last row is receive to plot */
+        const bool              bIsTotal    = i == FrameStage_Count;
+        const LatencyHistogram &histogram   = bIsTotal ? m_Total : m_Stages[i];
+        out << QString( "%1%2%3%4%5%6%7\n" )
+               .arg( bIsTotal ? QString( "Total" ) : StageName( static_cast<FrameStage>( i ) ), -14 )
+               .arg( histogram.Count(), 10 )
+               .arg( histogram.Percentile( 0.50 ), 12, 'f', 1 )
+               .arg( histogram.Percentile( 0.90 ), 12, 'f', 1 )
+               .arg( histogram.Percentile( 0.99 ), 12, 'f', 1 )
+               .arg( histogram.Max(), 12, 'f', 1 )
+               .arg( histogram.Mean(), 12, 'f', 1 );
+    }
+    out.flush();
+    return sReport;
+}
+
+bool FrameLatencyStats::WriteReport( const QString &sFileName ) const
+{
+    QFile file( sFileName );
+    if( !file.open( QIODevice::WriteOnly | QIODevice::Text ) )
+    {
+        return false;
+    }
+    QTextStream out( &file );
+    out << Report();
+    return out.status() == QTextStream::Ok;
+}
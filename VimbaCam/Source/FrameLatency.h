@@ -0,0 +1,102 @@
+
+
+#ifndef FRAMELATENCY_H
+#define FRAMELATENCY_H
+
+#include <QString>
+#include <QSharedPointer>
+#include <QtGlobal>
+#include <atomic>
+
+/** pipeline stages a frame passes from the camera to the screen, in order*/
+enum FrameStage
+{
+    FrameStage_Received     = 0,    // FrameObserver::FrameReceived entered
+    FrameStage_Queued       = 1,    // copied or leased and handed to the processing queue
+    FrameStage_Dequeued     = 2,    // taken from the queue by ImageProcessingThread
+    FrameStage_Converted    = 3,    // analysis buffer built
+    FrameStage_Handoff      = 4,    // taken over by the reductions stage of ImageCalculatingThread
+    FrameStage_Projected    = 5,    // cross sections done
+    FrameStage_Fitted       = 6,    // 1D and 2D fits done
+    FrameStage_Rendered     = 7,    // colormap, graphs and fit labels filled
+    FrameStage_Plotted      = 8,    // replot in ViewerWidget done
+    FrameStage_Count        = 9,
+};
+
+/** monotonic timestamps of one frame per stage, 0 for stages the frame did not reach*/
+class FrameTrace
+{
+    quint64                 m_Stamps[FrameStage_Count];     // steady clock in ns
+public:
+    FrameTrace()                                    { Clear(); }
+    /**steady clock in ns*/
+    static quint64          Now();
+    /**stamp a stage with the current time*/
+    void                    Mark( FrameStage stage )        { m_Stamps[stage] = Now(); }
+    /**stamp a stage with a time taken earlier*/
+    void                    Mark( FrameStage stage, quint64 stamp ) { m_Stamps[stage] = stamp; }
+    quint64                 Stamp( FrameStage stage ) const { return m_Stamps[stage]; }
+    bool                    Reached( FrameStage stage ) const { return m_Stamps[stage] != 0; }
+    /**a trace is only valid if the frame was stamped on arrival*/
+    bool                    IsValid() const                 { return Reached( FrameStage_Received ); }
+    void                    Clear();
+};
+
+/** lock free latency histogram.
+* log-linear buckets with 8 steps per octave, so percentiles are exact to about 6%;
+* Record is a few relaxed atomic adds and may be called from any thread
+*/
+class LatencyHistogram
+{
+    enum { SUB_BUCKET_BITS = 3, SUB_BUCKETS = 1 << SUB_BUCKET_BITS, BUCKET_COUNT = ( 64 - SUB_BUCKET_BITS + 1 ) * SUB_BUCKETS };
+    std::atomic<quint32>    m_Buckets[BUCKET_COUNT];
+    std::atomic<quint64>    m_Count;
+    std::atomic<quint64>    m_SumNs;
+    std::atomic<quint64>    m_MaxNs;
+
+    LatencyHistogram( const LatencyHistogram& );
+    LatencyHistogram& operator=( const LatencyHistogram& );
+
+    static int              bucketOf( quint64 ns );
+    static double           bucketMid( int bucket );
+public:
+    LatencyHistogram()                              { Reset(); }
+    void                    Record( quint64 ns );
+    void                    Reset();
+    quint64                 Count() const                   { return m_Count.load( std::memory_order_relaxed ); }
+    /**mean in us*/
+    double                  Mean() const;
+    /**max in us*/
+    double                  Max() const                     { return m_MaxNs.load( std::memory_order_relaxed ) / 1000.0; }
+    /**percentile in us for p in [0,1]*/
+    double                  Percentile( double p ) const;
+};
+
+/** latency statistics of one viewer's pipeline.
+* every stage keeps the time from the previous stage the frame reached, total keeps receive to plot
+* of the frames that made it to the screen
+*/
+class FrameLatencyStats
+{
+    LatencyHistogram        m_Stages[FrameStage_Count];     // index 0 is unused, the receive stage has no predecessor
+    LatencyHistogram        m_Total;
+
+    FrameLatencyStats( const FrameLatencyStats& );
+    FrameLatencyStats& operator=( const FrameLatencyStats& );
+public:
+    FrameLatencyStats()
+    {}
+    /**record a trace that left the pipeline, at whatever stage that happened*/
+    void                    Record( const FrameTrace &trace );
+    void                    Reset();
+    const LatencyHistogram& Stage( FrameStage stage ) const { return m_Stages[stage]; }
+    const LatencyHistogram& Total() const                   { return m_Total; }
+    static QString          StageName( FrameStage stage );
+    /**table of count, p50, p90, p99, max and mean per stage*/
+    QString                 Report() const;
+    /**write Report to a text file, false if it could not be written*/
+    bool                    WriteReport( const QString &sFileName ) const;
+};
+typedef QSharedPointer<FrameLatencyStats> FrameLatencyStatsPtr;
+
+#endif
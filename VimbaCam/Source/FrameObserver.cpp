@@ -5,18 +5,24 @@
 
 #include "FrameObserver.h"
 #include "VmbImageTransformHelper.hpp"
-#include <QFile>
+#include <QDir>
 #include <QMetaType>
 #include <QTextStream>
+#include "memcpy_threaded.h"
 #include <math.h>
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 FrameObserver::FrameObserver ( CameraPtr pCam )
     : IFrameObserver                ( pCam )
     , m_nFramesCounter              ( 0 )
-    , m_nRawImagesToSave            ( 0 )
-    , m_nRawImagesCounter           ( 0 )
+    , m_nCameraFrameID              ( 0 )
+    , m_nPublishedFrames            ( 0 )
+    , m_pRecorder                   ( new FrameRecorder() )
+    , m_ReportedRecorderState       ( FrameRecorder::State_Idle )
+    , m_bRecorderDropsReported      ( false )
     , m_bIsReset                    ( false )
     , m_EmitFrame                   ( true )
     , m_nFrames                     ( MAX_FRAMES_TO_COUNT )
@@ -24,10 +30,27 @@ FrameObserver::FrameObserver ( CameraPtr pCam )
     , m_bColorInterpolation         ( true )
     , m_IsStopping                  ( false )
     , m_bTransferFullBitDepthImage  ( false )
+    , m_bZeroCopy                   ( false )
     , m_pCam                        ( pCam )
+    , m_pFramePool                  ( new FramePool() )
+    , m_pLatencyStats               ( new FrameLatencyStats() )
+    , m_pDropStats                  ( new FrameDropStats() )
+    , m_pFeatureCache               ( new FeatureCache( pCam ) )
+    , m_pPretrigger                 ( new PretriggerBuffer() )
+    , m_pBurst                      ( new FrameBurst() )
+    , m_dExposureTime               ( 0.0 )
+    , m_dGain                       ( 0.0 )
+    , m_bChunkModeActive            ( false )
 { 
     m_pImageProcessingThread    = QSharedPointer<ImageProcessingThread>(new ImageProcessingThread());
+    m_pImageProcessingThread->setLatencyStats( m_pLatencyStats );
+    m_pImageProcessingThread->setDropStats( m_pDropStats );
     m_pHistogramThread          = QSharedPointer<HistogramThread>(new HistogramThread());
+    m_pStatisticsTimer          = new QTimer( this );
+    connect( m_pStatisticsTimer, SIGNAL( timeout() ), this, SLOT( publishStatistics() ) );
+    connect( m_pStatisticsTimer, SIGNAL( timeout() ), this, SLOT( refreshFrameSettings() ) );
+    connect( m_pPretrigger.data(), SIGNAL( finished() ), this, SLOT( reportPretriggerDump() ) );
+    connect( m_pBurst.data(), SIGNAL( finished() ), this, SLOT( reportBurstFlush() ) );
 
     connect ( m_pImageProcessingThread.data(), SIGNAL ( frameReadyFromThread (QImage, const QString &, const QString &, const QString &) ), 
               this, SLOT ( getFrameFromThread (QImage, const QString &, const QString &, const QString &) ) );
@@ -52,6 +75,7 @@ FrameObserver::FrameObserver ( CameraPtr pCam )
 
     // register tFrameInfo type to use with frameReadyFromObserver signal
     qRegisterMetaType< tFrameInfo >("tFrameInfo");
+    qRegisterMetaType< tFrameStatistics >("tFrameStatistics");
 
     connect ( m_pHistogramThread.data(), SIGNAL ( histogramDataFromThread ( const QVector<QVector <quint32> > &, const QString &, const double &, const double &, const QVector<QStringList> & )), 
               this, SLOT ( getHistogramDataFromThread ( const QVector<QVector <quint32> > &, const QString &, const double &, const double &, const QVector<QStringList>& )) );
@@ -67,50 +91,275 @@ FrameObserver::~FrameObserver ( void )
 
 void FrameObserver::FrameReceived ( const AVT::VmbAPI::FramePtr frame  )
 {    
+    const quint64 nReceivedStamp = FrameTrace::Now();
     QMutexLocker guard ( &m_StoppingLock );
     if( m_IsStopping )
     {
         return;
     }
+    countReceived();
     VmbFrameStatusType statusType = VmbFrameStatusInvalid;
-    if( VmbErrorSuccess == frame->GetReceiveStatus(statusType) )
+    if( VmbErrorSuccess != frame->GetReceiveStatus(statusType) )
     {
-        /* ignore any incompletely frame */
-        if( VmbFrameStatusComplete != statusType )
+        statusType = VmbFrameStatusInvalid;
+    }
+    /* ignore any incompletely frame */
+    if( VmbFrameStatusComplete != statusType )
+    {
+        m_pDropStats->Count( FrameDrop_Incomplete );
+        m_pBurst->CountIncomplete();
+    }
+    else
+    {
+        VmbUint64_t camera_frame_id;
+        frame->GetFrameID( camera_frame_id );
+        countFrame( camera_frame_id );
+        if( m_pBurst->IsActive() )
         {
-            m_pCam->QueueFrame(frame);
-            return; 
+            /* copied into the burst or, while the burst is flushed, skipped; either way straight back to the camera */
+            captureBurst( frame, nReceivedStamp );
         }
+        else if( m_EmitFrame && setFrame( frame, nReceivedStamp ) )
+        {
+            /* leased, the last consumer re-queues it */
+            return;
+        }
+    }
+    m_pCam->QueueFrame(frame);
+}
 
-        m_nFramesCounter++;
-        emit setFrameCounter ( m_nFramesCounter );
-        
-        m_FPSReceived.count( m_nFramesCounter );
-        VmbUint64_t camera_frame_id;
-        frame->GetFrameID( camera_frame_id );
-        m_FPSCamera.count( camera_frame_id ); 
-        static const char token[] = {'-','\\','|','/'}; //quite interesting :) -zzp
-        QString fps(token[ m_nFramesCounter%4] );
-        if( m_FPSReceived.isValid() )
+/* entry for frame sources other than Vimba, the data is handed on as is */
+void FrameObserver::FrameReceived( const tFrameInfo &frame, VmbUint64_t nFrameID )
+{
+    const quint64 nReceivedStamp = FrameTrace::Now();
+    QMutexLocker guard ( &m_StoppingLock );
+    if( m_IsStopping )
+    {
+        return;
+    }
+    countReceived();
+    countFrame( nFrameID );
+    if( m_pBurst->IsActive() )
+    {
+        captureBurst( frame, nFrameID, nReceivedStamp );
+    }
+    else if( m_EmitFrame )
+    {
+        try
         {
-            
-            fps = QString("Rcv:") + QString::number( static_cast<size_t>(m_FPSReceived.CurrentFPS()*100)/100.0 );
-            if( m_FPSCamera.isValid() )
-            {
-                fps += " Cam:" + QString::number(static_cast<size_t>(m_FPSCamera.CurrentFPS()*100)/100.0 );
-            }
-            if( m_pImageProcessingThread->getFPSCounter().isValid() )
+            tFrameInfo tmpInfo( frame );
+            tmpInfo.Trace().Mark( FrameStage_Received, nReceivedStamp );
+            tmpInfo.Metadata().m_nFrameID = nFrameID;
+            /* without a camera there are no settings, a replayed frame keeps the recorded ones */
+            if( !SP_ISNULL( m_pCam ) )
             {
-                fps += " Dis:" + QString::number(static_cast<size_t>(m_pImageProcessingThread->getFPSCounter().CurrentFPS()*100)/100.0 );
+                stampSettings( tmpInfo, FramePtr() );
             }
+            dispatchFrame( tmpInfo );
         }
-        emit setCurrentFPS( fps );
-        if( m_EmitFrame )
+        catch (...)
         {
-            setFrame( frame );
+            /* the frame is dropped, as a Vimba frame that could not be copied */
+            m_pDropStats->Count( FrameDrop_CopyFailed );
         }
     }
-    m_pCam->QueueFrame(frame);
+}
+
+/* only lock free stores on the delivery thread, publishStatistics picks the counters up */
+void FrameObserver::countFrame( VmbUint64_t nCameraFrameID )
+{
+    m_nFramesCounter.fetch_add( 1, std::memory_order_relaxed );
+    m_nCameraFrameID.store( nCameraFrameID, std::memory_order_relaxed );
+}
+
+/* GUI thread, every STATISTICS_INTERVAL while capturing. the fps counters only ever run here */
+void FrameObserver::publishStatistics( void )
+{
+    tFrameStatistics statistics;
+    statistics.m_nFrames = m_nFramesCounter.load( std::memory_order_relaxed );
+    if( statistics.m_nFrames != m_nPublishedFrames )
+    {
+        m_nPublishedFrames = statistics.m_nFrames;
+        m_FPSReceived.count( statistics.m_nFrames );
+        m_FPSCamera.count( m_nCameraFrameID.load( std::memory_order_relaxed ) );
+    }
+    if( m_FPSReceived.isValid() )
+    {
+        statistics.m_dReceivedFPS = m_FPSReceived.CurrentFPS();
+        if( m_FPSCamera.isValid() )
+        {
+            statistics.m_dCameraFPS = m_FPSCamera.CurrentFPS();
+        }
+        if( m_pImageProcessingThread->getFPSCounter().isValid() )
+        {
+            statistics.m_dDisplayFPS = m_pImageProcessingThread->getFPSCounter().CurrentFPS();
+        }
+    }
+    statistics.m_sDrops = m_pDropStats->Summary();
+    statistics.m_sRecorder = m_pRecorder->Summary();
+    reportRecorder();
+    reportBurst();
+    emit frameStatistics( statistics );
+}
+
+/* GUI thread. logs the first backpressure drop of a recording and how it ended, the status bar shows the rest */
+void FrameObserver::reportRecorder( void )
+{
+    if( !m_bRecorderDropsReported && 0 != m_pRecorder->Dropped() )
+    {
+        m_bRecorderDropsReported = true;
+        emit logging( QString( "WARNING: the raw recording skips frames, the disk does not keep up (%1)" ).arg( m_pRecorder->Summary() ) );
+    }
+    const FrameRecorder::State state = m_pRecorder->state();
+    if( state == m_ReportedRecorderState )
+    {
+        return;
+    }
+    m_ReportedRecorderState = state;
+    if( FrameRecorder::State_Closed == state )
+    {
+        emit logging( QString( "Raw recording closed: %1 of %2 frames written, %3 skipped, %4 MB" )
+                      .arg( m_pRecorder->Written() ).arg( m_pRecorder->Requested() ).arg( m_pRecorder->Dropped() )
+                      .arg( m_pRecorder->BytesWritten() / ( 1024.0 * 1024.0 ), 0, 'f', 1 ) );
+    }
+    else if( FrameRecorder::State_Failed == state )
+    {
+        emit logging( "ERROR: raw recording failed, " + m_pRecorder->ErrorString() );
+    }
+}
+
+/* GUI thread. a captured burst is reported and handed to its flush, the live pipeline stays paused until that is done */
+void FrameObserver::reportBurst( void )
+{
+    if( FrameBurst::State_Captured != m_pBurst->state() )
+    {
+        return;
+    }
+    emit logging( m_pBurst->CaptureSummary() );
+    /* false without frames, the summary said so */
+    m_pBurst->Flush( m_pImageProcessingThread, m_bTransferFullBitDepthImage );
+}
+
+/* GUI thread, every STATISTICS_INTERVAL while capturing. the only place the frame settings are read from the camera */
+void FrameObserver::refreshFrameSettings( void )
+{
+    if( SP_ISNULL( m_pCam ) )
+    {
+        return;
+    }
+    /* the cache only goes to the camera after a setting changed */
+    double dValue = 0.0;
+    if( VmbErrorSuccess == m_pFeatureCache->GetValue( "ExposureTimeAbs", dValue ) )
+    {
+        m_dExposureTime.store( dValue, std::memory_order_relaxed );
+    }
+    if( VmbErrorSuccess == m_pFeatureCache->GetValue( "Gain", dValue ) )
+    {
+        m_dGain.store( dValue, std::memory_order_relaxed );
+    }
+    bool bChunkModeActive = false;
+    if( VmbErrorSuccess == m_pFeatureCache->GetValue( "ChunkModeActive", bChunkModeActive ) )
+    {
+        m_bChunkModeActive.store( bChunkModeActive, std::memory_order_relaxed );
+    }
+}
+
+/* delivery thread: exposure and gain of the frame's chunk data if the camera sends it, else the cached settings.
+* chunk features are parsed from the frame buffer, there is no device access */
+void FrameObserver::stampSettings( tFrameInfo &info, const FramePtr &frame )
+{
+    tFrameMetadata &metadata = info.Metadata();
+    metadata.m_dExposureTime    = m_dExposureTime.load( std::memory_order_relaxed );
+    metadata.m_dGain            = m_dGain.load( std::memory_order_relaxed );
+    if( SP_ISNULL( frame ) || !m_bChunkModeActive.load( std::memory_order_relaxed ) )
+    {
+        return;
+    }
+    AVT::VmbAPI::AncillaryDataPtr pChunk;
+    if( VmbErrorSuccess != frame->GetAncillaryData( pChunk ) || SP_ISNULL( pChunk ) || VmbErrorSuccess != pChunk->Open() )
+    {
+        return;
+    }
+    AVT::VmbAPI::FeaturePtr pFeature;
+    double dValue = 0.0;
+    if( VmbErrorSuccess == pChunk->GetFeatureByName( "ChunkExposureTime", pFeature ) && VmbErrorSuccess == pFeature->GetValue( dValue ) )
+    {
+        metadata.m_dExposureTime    = dValue;
+        metadata.m_bChunkData       = true;
+    }
+    if( VmbErrorSuccess == pChunk->GetFeatureByName( "ChunkGain", pFeature ) && VmbErrorSuccess == pFeature->GetValue( dValue ) )
+    {
+        metadata.m_dGain            = dValue;
+        metadata.m_bChunkData       = true;
+    }
+    pChunk->Close();
+}
+
+/* delivery thread: the frame only goes into the next preallocated buffer of the burst, nothing else runs for it */
+void FrameObserver::captureBurst( const FramePtr &frame, quint64 nReceivedStamp )
+{
+    if( FrameBurst::State_Capturing != m_pBurst->state() )
+    {
+        /* the burst is analysed and written, the live view skips the frame */
+        m_pDropStats->Count( FrameDrop_Burst );
+        return;
+    }
+    try
+    {
+        const BaseFrame info( frame, m_bColorInterpolation );
+        VmbUchar_t *pData = NULL;
+        if( VmbErrorSuccess != frame->GetImage( pData ) )
+        {
+            throw std::runtime_error( "could not get frame data" );
+        }
+        tFrameInfo *pSlot = m_pBurst->Begin( info );
+        if( NULL == pSlot )
+        {
+            return;
+        }
+        memcpy_threaded( pSlot->Data(), pData, info.Size() );
+        pSlot->Trace().Mark( FrameStage_Received, nReceivedStamp );
+        stampSettings( *pSlot, frame );
+        m_pBurst->Commit();
+    }
+    catch (...)
+    {
+        m_pBurst->CountFailed();
+    }
+}
+
+void FrameObserver::captureBurst( const tFrameInfo &frame, VmbUint64_t nFrameID, quint64 nReceivedStamp )
+{
+    if( FrameBurst::State_Capturing != m_pBurst->state() )
+    {
+        m_pDropStats->Count( FrameDrop_Burst );
+        return;
+    }
+    tFrameInfo *pSlot = m_pBurst->Begin( frame );
+    if( NULL == pSlot )
+    {
+        return;
+    }
+    memcpy_threaded( pSlot->Data(), frame.Data(), frame.Size() );
+    pSlot->Metadata().m_nFrameID = nFrameID;
+    pSlot->Trace().Mark( FrameStage_Received, nReceivedStamp );
+    if( !SP_ISNULL( m_pCam ) )
+    {
+        stampSettings( *pSlot, FramePtr() );
+    }
+    m_pBurst->Commit();
+}
+
+/* every frame the source delivers, complete or not. warns once per window the lost ratio crosses the threshold */
+void FrameObserver::countReceived( void )
+{
+    m_pDropStats->CountReceived();
+    double dRatio = 0.0;
+    if( m_pDropStats->CheckWindow( DROP_WARNING_RATIO, dRatio ) )
+    {
+        emit logging( QString( "WARNING: %1% of the last %2 frames were lost (%3)" )
+                      .arg( dRatio * 100.0, 0, 'f', 1 ).arg( static_cast<int>( FrameDropStats::WINDOW_FRAMES ) ).arg( m_pDropStats->Summary() ) );
+    }
 }
 
 void FrameObserver::enableHistogram ( bool bIsHistogramEnabled )
@@ -137,9 +386,22 @@ void FrameObserver::setEmitFrame( bool bEmitFrame )
 {
     m_EmitFrame = bEmitFrame;
 }
-void FrameObserver::setDisplayInterval ( unsigned int nInterval )
+void FrameObserver::enableZeroCopy( bool bIsZeroCopyEnabled )
+{
+    m_bZeroCopy = bIsZeroCopyEnabled;
+}
+
+bool FrameObserver::isZeroCopyEnabled( void ) const
+{
+    return m_bZeroCopy;
+}
+
+/* drops buffers of the previous payload size and preallocates the ones for the next capture */
+void FrameObserver::reserveFramePool( VmbUint32_t nPayloadSize, int nBufferCount )
 {
-    m_pImageProcessingThread->LimitFrameRate( nInterval != 0  );
+    m_pFramePool->Clear();
+    m_pFramePool->ResetStatistics();
+    m_pFramePool->Reserve( nPayloadSize, nBufferCount );
 }
 
 void FrameObserver::resetFrameCounter ( bool bIsRestart )
@@ -151,51 +413,147 @@ void FrameObserver::resetFrameCounter ( bool bIsRestart )
     
     m_nFrames                   = MAX_FRAMES_TO_COUNT;
     m_bIsReset = true;
-    emit setCurrentFPS ( "-" );
+    m_FPSReceived.stop();
+    m_FPSCamera.stop();
+    m_nPublishedFrames          = m_nFramesCounter.load( std::memory_order_relaxed );
+    publishStatistics();
 }
 
-bool FrameObserver::setFrame (const AVT::VmbAPI::FramePtr &frame )
+/* returns true if the frame buffer got leased to the consumers, it must not be re-queued by the caller then */
+bool FrameObserver::setFrame (const AVT::VmbAPI::FramePtr &frame, quint64 nReceivedStamp )
 {
+    bool bIsLeased = false;
     try
     {
-        tFrameInfo tmpInfo( frame, m_bColorInterpolation );
-        m_pImageProcessingThread->setThreadFrame( tmpInfo, m_bTransferFullBitDepthImage);
-        if(m_bIsHistogramEnabled)
-        {
-            m_pHistogramThread->setThreadFrame ( tmpInfo );
-            m_pHistogramThread->start();
-        }
-
-        /* saving Raw Data */
-        if( m_nRawImagesToSave > 0)
-        {
-            m_nRawImagesCounter++;
-            QString s = m_sPathDestination;
-            s.append("\\");
-            s.append(m_sRawImagesName).append(QString::number(m_nRawImagesCounter)).append(".bin");
-            m_nRawImagesToSave--;
-
-            QFile rawFile(s);
-            rawFile.open(QIODevice::WriteOnly);
-            QDataStream out(&rawFile);
-            out.writeRawData((const char*)tmpInfo.Data(), tmpInfo.Size() );
-            rawFile.close();
-        }
+        tFrameInfo tmpInfo = m_bZeroCopy ? tFrameInfo( frame, m_bColorInterpolation, m_pCam, m_pSession )
+                                         : tFrameInfo( frame, m_bColorInterpolation, m_pFramePool );
+        bIsLeased = m_bZeroCopy;
+        tmpInfo.Trace().Mark( FrameStage_Received, nReceivedStamp );
+        stampSettings( tmpInfo, frame );
+        dispatchFrame( tmpInfo );
     }
     catch (...)
     {
-        return false;
+        /* an already created lease still re-queues the frame when released */
+        m_pDropStats->Count( FrameDrop_CopyFailed );
     }
         
+    return bIsLeased;
+}
+
+/* hands the frame to the processing and histogram threads and the raw data writer */
+void FrameObserver::dispatchFrame( tFrameInfo &tmpInfo )
+{
+    tmpInfo.Trace().Mark( FrameStage_Queued );
+    m_pImageProcessingThread->setThreadFrame( tmpInfo, m_bTransferFullBitDepthImage);
+    if(m_bIsHistogramEnabled)
+    {
+        m_pHistogramThread->setThreadFrame ( tmpInfo );
+        m_pHistogramThread->start();
+    }
+
+    /* saving Raw Data, only a reference is queued */
+    m_pRecorder->Record( tmpInfo );
+
+    /* pre-trigger window, keeps the reference; leased buffers are copied as they belong to the camera queue */
+    m_pPretrigger->Push( tmpInfo, m_bZeroCopy ? m_pFramePool : FramePoolPtr() );
+}
+
+/* GUI thread. the callback keeps running, only the hand over to the recorder is serialized with it */
+bool FrameObserver::saveRawData ( unsigned int nNumberOfRawImagesToSave, const QString& sPath, const QString &sFileName, bool bUnbuffered )
+{
+    {
+        QMutexLocker guard( &m_StoppingLock );
+        m_pRecorder->StopAccepting();
+    }
+    VmbInt64_t nPayload = 0;
+    AVT::VmbAPI::FeaturePtr pFeature;
+    if(     !SP_ISNULL( m_pCam )
+        &&  VmbErrorSuccess == m_pCam->GetFeatureByName( "PayloadSize", pFeature ) )
+    {
+        pFeature->GetValue( nPayload );
+    }
+    const QString sFile = QDir( sPath ).filePath( sFileName );
+    const bool bStarted = m_pRecorder->Start( sFile, nNumberOfRawImagesToSave, static_cast<VmbUint32_t>( nPayload ), bUnbuffered );
+    m_ReportedRecorderState     = m_pRecorder->state();
+    m_bRecorderDropsReported    = false;
+    if( !bStarted )
+    {
+        emit logging( "ERROR: raw recording not started, " + m_pRecorder->ErrorString() );
+        return false;
+    }
+    emit logging( QString( "Recording %1 raw frames to %2" ).arg( nNumberOfRawImagesToSave ).arg( QDir::toNativeSeparators( sFile ) ) );
+    return true;
+}
+
+void FrameObserver::enablePretrigger( double dSeconds, quint64 nMaxBytes )
+{
+    m_pPretrigger->Configure( dSeconds, nMaxBytes );
+    if( m_pPretrigger->IsEnabled() )
+    {
+        emit logging( QString( "Pre-trigger buffer keeps the last %1 s, at most %2 MB" ).arg( dSeconds ).arg( nMaxBytes >> 20 ) );
+    }
+    else
+    {
+        emit logging( "Pre-trigger buffer off" );
+    }
+}
+
+bool FrameObserver::dumpPretrigger( const QString &sFileName )
+{
+    const int       nFrames     = m_pPretrigger->Frames();
+    const double    dSeconds    = m_pPretrigger->Seconds();
+    if( !m_pPretrigger->Dump( sFileName ) )
+    {
+        emit logging( m_pPretrigger->isRunning() ? QString( "ERROR: pre-trigger dump not started, the previous one is still being written" )
+                                                 : QString( "ERROR: pre-trigger dump not started, the buffer holds no frames" ) );
+        return false;
+    }
+    emit logging( QString( "Dumping %1 pre-trigger frames, %2 s, to %3" ).arg( nFrames ).arg( dSeconds, 0, 'f', 2 ).arg( QDir::toNativeSeparators( sFileName ) ) );
+    return true;
+}
+
+/* GUI thread, the dump thread finished */
+void FrameObserver::reportPretriggerDump( void )
+{
+    emit logging( m_pPretrigger->DumpResult() );
+}
+
+/* GUI thread. the payload size sizes the buffers, as for a raw recording */
+bool FrameObserver::startBurst( int nFrames, const QString &sFileName )
+{
+    if( m_pBurst->IsActive() )
+    {
+        emit logging( "ERROR: burst not started, the previous one is still being captured or written" );
+        return false;
+    }
+    VmbInt64_t nPayload = 0;
+    AVT::VmbAPI::FeaturePtr pFeature;
+    if(     !SP_ISNULL( m_pCam )
+        &&  VmbErrorSuccess == m_pCam->GetFeatureByName( "PayloadSize", pFeature ) )
+    {
+        pFeature->GetValue( nPayload );
+    }
+    if( nPayload <= 0 )
+    {
+        emit logging( "ERROR: burst not started, the frame size is not known without a camera" );
+        return false;
+    }
+    const double dMB = static_cast<double>( nPayload ) * nFrames / ( 1024.0 * 1024.0 );
+    if( !m_pBurst->Start( nFrames, static_cast<VmbUint32_t>( nPayload ), sFileName ) )
+    {
+        emit logging( QString( "ERROR: burst not started, %1 MB for %2 frames not available" ).arg( dMB, 0, 'f', 1 ).arg( nFrames ) );
+        return false;
+    }
+    emit logging( QString( "Burst of %1 frames, %2 MB in memory; the live view pauses until it is written to %3" )
+                  .arg( nFrames ).arg( dMB, 0, 'f', 1 ).arg( QDir::toNativeSeparators( sFileName ) ) );
     return true;
 }
 
-void FrameObserver::saveRawData ( unsigned int nNumberOfRawImagesToSave, const QString& sPath, const QString &sFileName )
+/* GUI thread, the burst thread finished */
+void FrameObserver::reportBurstFlush( void )
 {
-    m_nRawImagesCounter = 0;
-    m_nRawImagesToSave = nNumberOfRawImagesToSave;
-    m_sPathDestination = sPath;
-    m_sRawImagesName   = sFileName;
+    emit logging( m_pBurst->FlushResult() );
 }
 
 
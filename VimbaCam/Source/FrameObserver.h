@@ -12,10 +12,15 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QWaitCondition>
+#include <QTimer>
 
 #include "Helper.h"
 #include "Histogram/HistogramThread.h"
 #include "ImageProcessingThread.h"
+#include "FrameRecorder.h"
+#include "FeatureCache.h"
+#include "PretriggerBuffer.h"
+#include "FrameBurst.h"
 #include <VimbaCPP/Include/IFrameObserver.h>
 #include <VimbaCPP/Include/Frame.h>
 #include <VimbaCPP/Include/Camera.h>
@@ -23,10 +28,31 @@
 
 /* Number of frames in use to count the first FPS since start*/
 const unsigned int MAX_FRAMES_TO_COUNT = 50;
+/* Ratio of lost frames per drop window above which a warning is logged*/
+const double DROP_WARNING_RATIO = 0.05;
+/* Interval in ms the frame counters are published to the GUI*/
+const int STATISTICS_INTERVAL = 100;
 
 using AVT::VmbAPI::CameraPtr;
 using AVT::VmbAPI::FramePtr;
 
+/** snapshot of the frame counters, published to the GUI every STATISTICS_INTERVAL*/
+struct tFrameStatistics
+{
+    unsigned int    m_nFrames;          // frames received since the last restart
+    double          m_dReceivedFPS;     // 0 until measured
+    double          m_dCameraFPS;       // 0 until measured
+    double          m_dDisplayFPS;      // 0 until measured
+    QString         m_sDrops;           // FrameDropStats::Summary
+    QString         m_sRecorder;        // FrameRecorder::Summary, empty while no recording was started
+    tFrameStatistics()
+        : m_nFrames         ( 0 )
+        , m_dReceivedFPS    ( 0.0 )
+        , m_dCameraFPS      ( 0.0 )
+        , m_dDisplayFPS     ( 0.0 )
+    {}
+};
+
 
 class FrameObserver : public QObject, public AVT::VmbAPI::IFrameObserver
 {
@@ -46,16 +72,18 @@ class FrameObserver : public QObject, public AVT::VmbAPI::IFrameObserver
         QSharedPointer<HistogramThread>         m_pHistogramThread;         // histogram calculation thread
 
         unsigned int                            m_nFrames;
-        unsigned int                            m_nFramesCounter;       // nr frames received
+        std::atomic<unsigned int>               m_nFramesCounter;       // nr frames received
+        std::atomic<VmbUint64_t>                m_nCameraFrameID;       // id of the last frame received
+        unsigned int                            m_nPublishedFrames;     // m_nFramesCounter at the last publish
+        QTimer                                 *m_pStatisticsTimer;     // publishes the counters, the callback never emits them itself
 
         QSharedPointer<ImageProcessingThread>   m_pImageProcessingThread;   // Image processing thread
         bool                                    m_bIsReset;
         bool                                    m_EmitFrame;
         /* Saving Raw Data */
-        unsigned int                        m_nRawImagesToSave;
-        unsigned int                        m_nRawImagesCounter;
-        QString                             m_sPathDestination;
-        QString                             m_sRawImagesName;
+        FrameRecorderPtr                    m_pRecorder;                // writes the raw frames off the callback thread
+        FrameRecorder::State                m_ReportedRecorderState;    // state last logged by publishStatistics
+        bool                                m_bRecorderDropsReported;   // backpressure of the current recording logged
 
         /* Histogram */
         bool                                m_bIsHistogramEnabled;
@@ -65,10 +93,51 @@ class FrameObserver : public QObject, public AVT::VmbAPI::IFrameObserver
         QMutex                              m_StoppingLock;
 
         bool                                m_bTransferFullBitDepthImage;
+
+        /* Zero-Copy */
+        bool                                m_bZeroCopy;                // hand out leases on the Vimba buffers instead of copies
+        CaptureSessionPtr                   m_pSession;                 // cleared on stop so late leases are not re-queued
+
+        /* Frame Pool */
+        FramePoolPtr                        m_pFramePool;               // recycled buffers for the frame copies
+
+        /* Latency */
+        FrameLatencyStatsPtr                m_pLatencyStats;            // per stage latencies, shared with the processing and calculating threads
+
+        /* Drops */
+        FrameDropStatsPtr                   m_pDropStats;               // per stage drop counters, shared with the processing and calculating threads
+
+        /* Feature Cache */
+        FeatureCachePtr                     m_pFeatureCache;            // the camera's feature values, shared with the calculating thread
+
+        /* Pre-trigger */
+        PretriggerBufferPtr                 m_pPretrigger;              // frames of the last seconds, dumped on demand
+
+        /* Burst */
+        FrameBurstPtr                       m_pBurst;                   // takes all frames while active, the live pipeline pauses
+
+        /* Frame Settings, read on the GUI thread and stamped on every frame without chunk data */
+        std::atomic<double>                 m_dExposureTime;            // us
+        std::atomic<double>                 m_dGain;                    // dB
+        std::atomic<bool>                   m_bChunkModeActive;         // frames carry exposure and gain in their chunk data
     public:
             void Stopping()
             {
+                {
+                    QMutexLocker guard( &m_StoppingLock );
+                    m_pRecorder->StopAccepting();
+                    m_pBurst->EndCapture();
+                }
+                /* flush outside the lock, the recording is closed before the last statistics go out */
+                m_pRecorder->Stop();
+                if( NULL != m_pSession )
+                {
+                    m_pSession->storeRelease( 0 );
+                }
                 m_pImageProcessingThread->StopProcessing();
+                m_pStatisticsTimer->stop();
+                publishStatistics();
+                emit logging( m_pFeatureCache->Summary() );
                 m_FPSCamera.stop();
                 m_FPSReceived.stop();
                 QMutexLocker guard( &m_StoppingLock );
@@ -78,29 +147,66 @@ class FrameObserver : public QObject, public AVT::VmbAPI::IFrameObserver
             {
                 QMutexLocker guard( &m_StoppingLock );
                 m_IsStopping = false;
+                /* the window of the last acquisition stays dumpable while stopped, a new one starts empty */
+                m_pPretrigger->Clear();
+                m_pSession = CaptureSessionPtr( new QAtomicInt( 1 ) );
+                m_pLatencyStats->Reset();
+                m_pDropStats->Reset();
                 m_pImageProcessingThread->StartProcessing();
+                if( !m_pStatisticsTimer->isActive() )
+                {
+                    refreshFrameSettings();
+                }
+                m_pStatisticsTimer->start( STATISTICS_INTERVAL );
             }
             FrameObserver ( CameraPtr pCam );
            ~FrameObserver ();
 
             virtual void FrameReceived          ( const FramePtr frame );
+            /** entry for frame sources without a Vimba frame, e.g. SimulatedCamera. nFrameID is the source's frame id*/
+            void FrameReceived                  ( const tFrameInfo &frame, VmbUint64_t nFrameID );
             void resetFrameCounter              ( bool bIsRestart );
-            void setDisplayInterval             ( unsigned int nInterval );
-            void saveRawData                    ( unsigned int nNumberOfRawImagesToSave, const QString &sPath, const QString &sFileName);
+            /** record the next nNumberOfRawImagesToSave frames to sPath/sFileName, false if the file could not be created*/
+            bool saveRawData                    ( unsigned int nNumberOfRawImagesToSave, const QString &sPath, const QString &sFileName, bool bUnbuffered = false );
+            /** keep the frames of the last dSeconds, at most nMaxBytes, in memory. 0 seconds releases them*/
+            void enablePretrigger               ( double dSeconds, quint64 nMaxBytes );
+            /** write the frames kept now to sFileName while acquisition goes on, false if there are none or a dump is running*/
+            bool dumpPretrigger                 ( const QString &sFileName );
+            /** capture the next nFrames frames to memory only, then analyze them and write them to sFileName. false if not started*/
+            bool startBurst                     ( int nFrames, const QString &sFileName );
             void enableHistogram                ( bool bIsHistogramEnabled );
             void setColorInterpolation          ( bool bState);
             bool getColorInterpolation          ( void );
             void enableFullBitDepthTransfer     ( bool bIsFullBitDepthEnabled );
             void setEmitFrame                   ( bool bEmitFrame );
+            void enableZeroCopy                 ( bool bIsZeroCopyEnabled );
+            bool isZeroCopyEnabled              ( void ) const;
+            void reserveFramePool               ( VmbUint32_t nPayloadSize, int nBufferCount );
+            const FramePoolPtr& framePool       ( void ) const { return m_pFramePool; }
+            const FrameLatencyStatsPtr& latencyStats ( void ) const { return m_pLatencyStats; }
+            const FrameDropStatsPtr& dropStats  ( void ) const { return m_pDropStats; }
+            const FeatureCachePtr& featureCache ( void ) const { return m_pFeatureCache; }
             
             const QSharedPointer<ImageProcessingThread>& ImageProcessThreadPtr() const { return m_pImageProcessingThread; }
             
 protected:
            
     private:
-            bool setFrame                       ( const FramePtr &frame );
+            bool setFrame                       ( const FramePtr &frame, quint64 nReceivedStamp );
+            void dispatchFrame                  ( tFrameInfo &tmpInfo );
+            void countFrame                     ( VmbUint64_t nCameraFrameID );
+            void countReceived                  ( void );
+            void stampSettings                  ( tFrameInfo &info, const FramePtr &frame );
+            void captureBurst                   ( const FramePtr &frame, quint64 nReceivedStamp );
+            void captureBurst                   ( const tFrameInfo &frame, VmbUint64_t nFrameID, quint64 nReceivedStamp );
+            void reportBurst                    ( void );
+            void reportRecorder                 ( void );
             
     private slots:
+            void publishStatistics              ( void );
+            void refreshFrameSettings           ( void );
+            void reportPretriggerDump           ( void );
+            void reportBurstFlush               ( void );
             void getFrameFromThread             ( QImage image, const QString &sFormat, const QString &sHeight, const QString &sWidth );
             void getFrameFromThread             ( QVector<ushort> vec1d, const QString& sFormat, const QString& sHeight, const QString& sWidth);
             void getFrameFromThread             ( std::vector<ushort> vec1d, const QString& sFormat, const QString& sHeight, const QString& sWidth);
@@ -114,8 +220,8 @@ protected:
             void frameReadyFromObserver              ( std::vector<ushort> vec1d, const QString& sFormat, const QString& sHeight, const QString& sWidth);
 
             void frameReadyFromObserverFullBitDepth  ( tFrameInfo mFullImageInfo );
-            void setCurrentFPS                       ( const QString &sFPS );
-            void setFrameCounter                     ( const unsigned int &nFrame );
+            void frameStatistics                     ( const tFrameStatistics &statistics );
+            void logging                             ( const QString &sMessage );
             void histogramDataFromObserver           ( const QVector<QVector <quint32> > &histData, const QString &sHistogramTitle, 
                                                        const double &nMaxHeight_YAxis, const double &nMaxWidth_XAxis, const QVector <QStringList> &statistics );
 
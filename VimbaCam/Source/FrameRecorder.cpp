@@ -0,0 +1,540 @@
+
+#include "FrameRecorder.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /* the file and buffer calls of the recorder, unbuffered writes need page aligned blocks on both */
+#ifdef _WIN32
+    typedef HANDLE          tFileHandle;
+    const tFileHandle       NO_FILE = INVALID_HANDLE_VALUE;
+
+    unsigned long lastError()
+    {
+        return static_cast<unsigned long>( GetLastError() );
+    }
+    VmbUchar_t* allocBlock( size_t nSize )
+    {
+        return static_cast<VmbUchar_t*>( VirtualAlloc( NULL, nSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE ) );
+    }
+    void freeBlock( VmbUchar_t *pData )
+    {
+        VirtualFree( pData, 0, MEM_RELEASE );
+    }
+    tFileHandle createFile( const QString &sNativeName, bool bUnbuffered )
+    {
+        return CreateFileW( reinterpret_cast<LPCWSTR>( sNativeName.utf16() ), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | ( bUnbuffered ? FILE_FLAG_NO_BUFFERING : 0 ), NULL );
+    }
+    /** best effort, the file size stays as it is*/
+    void reserveFile( tFileHandle hFile, quint64 nSize )
+    {
+        FILE_ALLOCATION_INFO allocation;
+        allocation.AllocationSize.QuadPart = nSize;
+        SetFileInformationByHandle( hFile, FileAllocationInfo, &allocation, sizeof( allocation ) );
+    }
+    bool truncateFile( tFileHandle hFile, quint64 nSize )
+    {
+        FILE_END_OF_FILE_INFO endOfFile;
+        endOfFile.EndOfFile.QuadPart = nSize;
+        return FALSE != SetFileInformationByHandle( hFile, FileEndOfFileInfo, &endOfFile, sizeof( endOfFile ) );
+    }
+    void closeHandle( tFileHandle hFile )
+    {
+        CloseHandle( hFile );
+    }
+    /** positioned write on a synchronous handle*/
+    bool writeAt( tFileHandle hFile, const void *pData, size_t nSize, quint64 nOffset )
+    {
+        OVERLAPPED position;
+        memset( &position, 0, sizeof( position ) );
+        position.Offset         = static_cast<DWORD>( nOffset );
+        position.OffsetHigh     = static_cast<DWORD>( nOffset >> 32 );
+        DWORD nWritten = 0;
+        return WriteFile( hFile, pData, static_cast<DWORD>( nSize ), &nWritten, &position ) && nWritten == nSize;
+    }
+#else
+    typedef int             tFileHandle;
+    const tFileHandle       NO_FILE = -1;
+
+    unsigned long lastError()
+    {
+        return static_cast<unsigned long>( errno );
+    }
+    VmbUchar_t* allocBlock( size_t nSize )
+    {
+        void *pData = NULL;
+        return 0 == posix_memalign( &pData, FrameRecorder::SECTOR_SIZE, nSize ) ? static_cast<VmbUchar_t*>( pData ) : NULL;
+    }
+    void freeBlock( VmbUchar_t *pData )
+    {
+        free( pData );
+    }
+    tFileHandle createFile( const QString &sNativeName, bool bUnbuffered )
+    {
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if( bUnbuffered )
+        {
+            flags |= O_DIRECT;
+        }
+#endif
+        const tFileHandle hFile = open( QFile::encodeName( sNativeName ).constData(), flags, 0644 );
+#ifdef F_NOCACHE
+        if( NO_FILE != hFile && bUnbuffered )
+        {
+            fcntl( hFile, F_NOCACHE, 1 );
+        }
+#endif
+        (void)bUnbuffered;
+        return hFile;
+    }
+    /** best effort, the file size stays as it is*/
+    void reserveFile( tFileHandle hFile, quint64 nSize )
+    {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+        fallocate( hFile, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>( nSize ) );
+#else
+        (void)hFile;
+        (void)nSize;
+#endif
+    }
+    bool truncateFile( tFileHandle hFile, quint64 nSize )
+    {
+        return 0 == ftruncate( hFile, static_cast<off_t>( nSize ) );
+    }
+    void closeHandle( tFileHandle hFile )
+    {
+        close( hFile );
+    }
+    bool writeAt( tFileHandle hFile, const void *pData, size_t nSize, quint64 nOffset )
+    {
+        const char *pSource = static_cast<const char*>( pData );
+        while( nSize > 0 )
+        {
+            const ssize_t nWritten = pwrite( hFile, pSource, nSize, static_cast<off_t>( nOffset ) );
+            if( nWritten <= 0 )
+            {
+                if( nWritten < 0 && EINTR == errno )
+                {
+                    continue;
+                }
+                return false;
+            }
+            pSource += nWritten;
+            nOffset += nWritten;
+            nSize   -= static_cast<size_t>( nWritten );
+        }
+        return true;
+    }
+#endif
+}
+
+/** one of the preallocated write buffers, page aligned so it can be written unbuffered*/
+struct FrameRecorder::WriteBlock
+{
+    VmbUchar_t         *m_pData;                // BLOCK_SIZE bytes
+    size_t              m_nUsed;                // bytes filled by the recorder thread
+    size_t              m_nWriteSize;           // bytes the writer writes, m_nUsed rounded up for unbuffered files
+    quint64             m_nOffset;              // file offset of m_pData[0]
+};
+
+/** writes the full blocks in file order and hands them back to the recorder thread*/
+class FrameRecorder::Writer : public QThread
+{
+    FrameRecorder      &m_Recorder;
+public:
+    explicit Writer( FrameRecorder &recorder )
+        : m_Recorder( recorder )
+    {}
+protected:
+    virtual void run()
+    {
+        m_Recorder.writeBlocks();
+    }
+};
+
+FrameRecorder::FrameRecorder()
+    : m_Frames( QUEUE_SIZE )
+    , m_FreeBlocks( BLOCK_COUNT )
+    , m_FullBlocks( BLOCK_COUNT + 1 )
+    , m_hFile( NO_FILE )
+    , m_pCurrent( NULL )
+    , m_nFileSize( 0 )
+    , m_bUnbuffered( false )
+    , m_nRemaining( 0 )
+    , m_nRequested( 0 )
+    , m_nAccepted( 0 )
+    , m_nDropped( 0 )
+    , m_nHighWater( 0 )
+    , m_nWritten( 0 )
+    , m_nBytesWritten( 0 )
+    , m_State( State_Idle )
+{
+    m_pWriter = QSharedPointer<Writer>( new Writer( *this ) );
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    Stop();
+    m_Frames.StopProcessing();
+    for( int i = 0; i < m_Blocks.size(); ++i )
+    {
+        freeBlock( m_Blocks[i]->m_pData );
+        delete m_Blocks[i];
+    }
+}
+
+bool FrameRecorder::Start( const QString &sFileName, unsigned int nFrames, VmbUint32_t nFrameSize, bool bUnbuffered )
+{
+    Stop();
+    {
+        QMutexLocker guard( &m_ErrorLock );
+        m_sError.clear();
+    }
+    m_State.store( State_Idle, std::memory_order_release );
+    for( int i = m_Blocks.size(); i < BLOCK_COUNT; ++i )
+    {
+        VmbUchar_t *pData = allocBlock( BLOCK_SIZE );
+        if( NULL == pData )
+        {
+            fail( QString( "could not allocate the recording buffers, error %1" ).arg( lastError() ) );
+            return false;
+        }
+        WriteBlock *pBlock  = new WriteBlock();
+        pBlock->m_pData     = pData;
+        m_Blocks.append( pBlock );
+    }
+    m_Frames.StartProcessing();
+    m_FullBlocks.StartProcessing();
+    m_FreeBlocks.StartProcessing();
+    for( int i = 0; i < m_Blocks.size(); ++i )
+    {
+        m_Blocks[i]->m_nUsed = 0;
+        m_FreeBlocks.Enqueue( m_Blocks[i] );
+    }
+
+    const QString sNativeName = QDir::toNativeSeparators( sFileName );
+    m_hFile = createFile( sNativeName, bUnbuffered );
+    if( NO_FILE == m_hFile )
+    {
+        fail( QString( "could not create %1, error %2" ).arg( sNativeName ).arg( lastError() ) );
+        return false;
+    }
+    m_bUnbuffered = bUnbuffered;
+    /* reserve the whole recording up front so the file does not fragment while it grows, best effort */
+    const quint64 nFrameRecord = sizeof( tRecordFrameHeader ) + ( static_cast<quint64>( nFrameSize ) + 7 ) / 8 * 8 + sizeof( tRecordIndexEntry );
+    reserveFile( m_hFile, sizeof( tRecordFileHeader ) + nFrames * nFrameRecord + sizeof( tRecordFileTrailer ) );
+
+    m_Index.resize( 0 );
+    m_Index.reserve( nFrames );
+    m_nFileSize = 0;
+    m_FreeBlocks.WaitData( m_pCurrent );
+    const tRecordFileHeader header = FileHeader();
+    append( &header, sizeof( header ) );
+
+    m_nRequested.store( nFrames, std::memory_order_relaxed );
+    m_nAccepted.store( 0, std::memory_order_relaxed );
+    m_nDropped.store( 0, std::memory_order_relaxed );
+    m_nHighWater.store( 0, std::memory_order_relaxed );
+    m_nWritten.store( 0, std::memory_order_relaxed );
+    m_nBytesWritten.store( 0, std::memory_order_relaxed );
+    m_State.store( State_Recording, std::memory_order_release );
+    m_pWriter->start();
+    start();
+    m_nRemaining.store( nFrames, std::memory_order_release );
+    return true;
+}
+
+/* frame callback, the only writer of m_nRemaining while it is not 0 */
+bool FrameRecorder::Record( const tFrameInfo &frame )
+{
+    const quint64 nRemaining = m_nRemaining.load( std::memory_order_acquire );
+    if( 0 == nRemaining )
+    {
+        return false;
+    }
+    m_nRemaining.store( nRemaining - 1, std::memory_order_relaxed );
+    RecorderItem item;
+    item.m_Frame        = frame;
+    item.m_nSequence    = m_nAccepted.fetch_add( 1, std::memory_order_relaxed ) + 1;
+    const quint64 nWaiting = item.m_nSequence - Written() - Dropped();
+    if( nWaiting > HighWater() )
+    {
+        m_nHighWater.store( nWaiting, std::memory_order_relaxed );
+    }
+    m_Frames.Enqueue( std::move( item ), [this]( RecorderItem& ) { m_nDropped.fetch_add( 1, std::memory_order_relaxed ); } );
+    return true;
+}
+
+void FrameRecorder::Stop()
+{
+    StopAccepting();
+    if( isRunning() )
+    {
+        /* the end marker queues behind the frames still waiting, they get written first */
+        m_Frames.Enqueue( RecorderItem(), [this]( RecorderItem& ) { m_nDropped.fetch_add( 1, std::memory_order_relaxed ); } );
+        wait();
+    }
+}
+
+QString FrameRecorder::ErrorString() const
+{
+    QMutexLocker guard( &m_ErrorLock );
+    return m_sError;
+}
+
+QString FrameRecorder::Summary() const
+{
+    const State currentState = state();
+    if( State_Idle == currentState )
+    {
+        return QString();
+    }
+    if( State_Failed == currentState )
+    {
+        return "Rec:failed";
+    }
+    QString sSummary = QString( "Rec:%1/%2" ).arg( Written() ).arg( Requested() );
+    if( 0 != Dropped() )
+    {
+        sSummary += QString( " RecDrop:%1" ).arg( Dropped() );
+    }
+    if( State_Recording == currentState )
+    {
+        sSummary += QString( " RecQ:%1/%2" ).arg( HighWater() ).arg( static_cast<int>( QUEUE_SIZE ) );
+    }
+    return sSummary;
+}
+
+/* the first error is kept, later ones are usually caused by it */
+void FrameRecorder::fail( const QString &sError )
+{
+    QMutexLocker guard( &m_ErrorLock );
+    if( m_sError.isEmpty() )
+    {
+        m_sError = sError;
+    }
+    m_State.store( State_Failed, std::memory_order_release );
+}
+
+/* recorder thread: copy into the current block, full blocks go to the writer */
+void FrameRecorder::append( const void *pData, size_t nSize )
+{
+    const VmbUchar_t *pSource = static_cast<const VmbUchar_t*>( pData );
+    while( nSize > 0 )
+    {
+        const size_t nCopy = std::min( nSize, static_cast<size_t>( BLOCK_SIZE ) - m_pCurrent->m_nUsed );
+        memcpy( m_pCurrent->m_pData + m_pCurrent->m_nUsed, pSource, nCopy );
+        m_pCurrent->m_nUsed += nCopy;
+        m_nFileSize         += nCopy;
+        pSource             += nCopy;
+        nSize               -= nCopy;
+        if( BLOCK_SIZE == m_pCurrent->m_nUsed )
+        {
+            submitCurrent( BLOCK_SIZE );
+            /* waits only if all blocks are with the writer, the frame queue takes up the slack meanwhile */
+            m_FreeBlocks.WaitData( m_pCurrent );
+            m_pCurrent->m_nUsed = 0;
+        }
+    }
+}
+
+void FrameRecorder::submitCurrent( size_t nSize )
+{
+    m_pCurrent->m_nOffset       = m_nFileSize - m_pCurrent->m_nUsed;
+    m_pCurrent->m_nWriteSize    = nSize;
+    m_FullBlocks.Enqueue( m_pCurrent );
+    m_pCurrent = NULL;
+}
+
+void FrameRecorder::closeFile()
+{
+    if( State_Recording == state() )
+    {
+        const tRecordFileTrailer trailer = FileTrailer( m_nFileSize, m_Index.size() );
+        append( m_Index.constData(), m_Index.size() * sizeof( tRecordIndexEntry ) );
+        append( &trailer, sizeof( trailer ) );
+    }
+    /* the last block is partial, unbuffered it is written in whole sectors and the file is cut back afterwards */
+    size_t nSize = m_pCurrent->m_nUsed;
+    if( m_bUnbuffered )
+    {
+        const size_t nPadded = ( nSize + SECTOR_SIZE - 1 ) / SECTOR_SIZE * SECTOR_SIZE;
+        memset( m_pCurrent->m_pData + nSize, 0, nPadded - nSize );
+        nSize = nPadded;
+    }
+    if( nSize > 0 )
+    {
+        submitCurrent( nSize );
+    }
+    else
+    {
+        m_FreeBlocks.Enqueue( m_pCurrent );
+        m_pCurrent = NULL;
+    }
+    m_FullBlocks.Enqueue( static_cast<WriteBlock*>( NULL ) );
+    m_pWriter->wait();
+
+    if( !truncateFile( m_hFile, m_nFileSize ) )
+    {
+        fail( QString( "could not set the recording file size, error %1" ).arg( lastError() ) );
+    }
+    closeHandle( m_hFile );
+    m_hFile = NO_FILE;
+    int expected = State_Recording;
+    m_State.compare_exchange_strong( expected, State_Closed, std::memory_order_acq_rel );
+}
+
+tRecordFileHeader FrameRecorder::FileHeader()
+{
+    tRecordFileHeader header;
+    memcpy( header.m_Magic, "VCRAWREC", sizeof( header.m_Magic ) );
+    header.m_nVersion           = 1;
+    header.m_nFrameHeaderSize   = sizeof( tRecordFrameHeader );
+    return header;
+}
+
+tRecordFrameHeader FrameRecorder::FrameHeader( const tFrameInfo &frame, quint64 nSequence )
+{
+    tRecordFrameHeader header;
+    header.m_nSequence      = nSequence;
+    header.m_nTimestamp     = frame.Trace().Stamp( FrameStage_Received );
+    header.m_PixelFormat    = frame.PixelFormat();
+    header.m_nWidth         = frame.Width();
+    header.m_nHeight        = frame.Height();
+    header.m_nSize          = frame.Size();
+    const tFrameMetadata &metadata = frame.Metadata();
+    header.m_nFrameID           = metadata.m_nFrameID;
+    header.m_nCameraTimestamp   = metadata.m_nTimestamp;
+    header.m_nOffsetX           = metadata.m_nOffsetX;
+    header.m_nOffsetY           = metadata.m_nOffsetY;
+    header.m_dExposureTime      = metadata.m_dExposureTime;
+    header.m_dGain              = metadata.m_dGain;
+    return header;
+}
+
+tRecordFileTrailer FrameRecorder::FileTrailer( quint64 nIndexOffset, quint64 nFrames )
+{
+    tRecordFileTrailer trailer;
+    trailer.m_nIndexOffset  = nIndexOffset;
+    trailer.m_nFrames       = nFrames;
+    memcpy( trailer.m_Magic, "VCRAWIDX", sizeof( trailer.m_Magic ) );
+    return trailer;
+}
+
+/* buffered sequential writes, the frames are already in memory and nobody waits on them */
+bool FrameRecorder::WriteFrames( const QString &sFileName, QVector<tFrameInfo> &frames, QString &sError )
+{
+    static const char padding[8] = { 0 };
+    QFile file( sFileName );
+    if( !file.open( QIODevice::WriteOnly ) )
+    {
+        sError = file.errorString();
+        return false;
+    }
+    QVector<tRecordIndexEntry> index;
+    index.reserve( frames.size() );
+    const tRecordFileHeader fileHeader = FileHeader();
+    bool bOk = file.write( reinterpret_cast<const char*>( &fileHeader ), sizeof( fileHeader ) ) == sizeof( fileHeader );
+    for( int i = 0; bOk && i < frames.size(); ++i )
+    {
+        const tFrameInfo &frame = frames.at( i );
+        tRecordIndexEntry entry;
+        entry.m_nSequence   = i + 1;
+        entry.m_nOffset     = file.pos();
+        index.append( entry );
+        const tRecordFrameHeader header = FrameHeader( frame, entry.m_nSequence );
+        const qint64 nPadding = ( 8 - frame.Size() % 8 ) % 8;
+        bOk =       file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) ) == sizeof( header )
+                &&  file.write( reinterpret_cast<const char*>( frame.Data() ), frame.Size() ) == static_cast<qint64>( frame.Size() )
+                &&  file.write( padding, nPadding ) == nPadding;
+        /* hand the buffer back as soon as it is written */
+        frames[i] = tFrameInfo();
+    }
+    if( bOk )
+    {
+        const tRecordFileTrailer trailer = FileTrailer( file.pos(), index.size() );
+        const qint64 nIndexSize = index.size() * sizeof( tRecordIndexEntry );
+        bOk =       file.write( reinterpret_cast<const char*>( index.constData() ), nIndexSize ) == nIndexSize
+                &&  file.write( reinterpret_cast<const char*>( &trailer ), sizeof( trailer ) ) == sizeof( trailer );
+    }
+    if( !bOk )
+    {
+        sError = file.errorString();
+    }
+    file.close();
+    return bOk;
+}
+
+/* recorder thread: frames in, records out. after a failure the frames are only counted */
+void FrameRecorder::run()
+{
+    static const char padding[8] = { 0 };
+    RecorderItem item;
+    while( m_Frames.WaitData( item ) && 0 != item.m_nSequence )
+    {
+        const quint64 nSequence = item.m_nSequence;
+        if( State_Recording == state() )
+        {
+            const tFrameInfo &frame = item.m_Frame;
+            const tRecordFrameHeader header = FrameHeader( frame, nSequence );
+            tRecordIndexEntry entry;
+            entry.m_nSequence       = nSequence;
+            entry.m_nOffset         = m_nFileSize;
+            m_Index.append( entry );
+            append( &header, sizeof( header ) );
+            append( frame.Data(), frame.Size() );
+            append( padding, ( 8 - frame.Size() % 8 ) % 8 );
+            m_nWritten.fetch_add( 1, std::memory_order_relaxed );
+        }
+        else
+        {
+            m_nDropped.fetch_add( 1, std::memory_order_relaxed );
+        }
+        /* hand the frame buffer back before waiting for the next one */
+        item = RecorderItem();
+        if( nSequence == Requested() )
+        {
+            break;
+        }
+    }
+    closeFile();
+}
+
+/* writer thread */
+void FrameRecorder::writeBlocks()
+{
+    WriteBlock *pBlock = NULL;
+    while( m_FullBlocks.WaitData( pBlock ) && NULL != pBlock )
+    {
+        if( State_Failed != state() )
+        {
+            /* positioned writes, the blocks arrive in file order anyway */
+            if( !writeAt( m_hFile, pBlock->m_pData, pBlock->m_nWriteSize, pBlock->m_nOffset ) )
+            {
+                fail( QString( "writing the recording failed at offset %1, error %2" ).arg( pBlock->m_nOffset ).arg( lastError() ) );
+            }
+            else
+            {
+                m_nBytesWritten.fetch_add( pBlock->m_nWriteSize, std::memory_order_relaxed );
+            }
+        }
+        pBlock->m_nUsed = 0;
+        m_FreeBlocks.Enqueue( pBlock );
+    }
+}
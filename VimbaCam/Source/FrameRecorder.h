@@ -0,0 +1,162 @@
+
+
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <QThread>
+#include <QString>
+#include <QMutex>
+#include <QVector>
+#include <QSharedPointer>
+#include <atomic>
+
+#include "Helper.h"
+
+/** raw frame recording file, little endian, append only:
+*   tRecordFileHeader
+*   per frame: tRecordFrameHeader followed by the frame data, padded to 8 bytes
+*   index: one tRecordIndexEntry per frame written
+*   tRecordFileTrailer, the last bytes of the file
+* a file without a valid trailer was not closed, its frames can still be read sequentially
+*/
+#pragma pack( push, 1 )
+struct tRecordFileHeader
+{
+    char                m_Magic[8];             // "VCRAWREC"
+    quint32             m_nVersion;
+    quint32             m_nFrameHeaderSize;     // sizeof tRecordFrameHeader
+};
+struct tRecordFrameHeader
+{
+    quint64             m_nSequence;            // 1 based number of the frame accepted for recording, gaps are dropped frames
+    quint64             m_nTimestamp;           // FrameTrace::Now when the frame was received, in ns
+    quint32             m_PixelFormat;
+    quint32             m_nWidth;
+    quint32             m_nHeight;
+    quint32             m_nSize;                // bytes of frame data following the header
+    quint64             m_nFrameID;             // tFrameMetadata of the frame
+    quint64             m_nCameraTimestamp;
+    quint32             m_nOffsetX;
+    quint32             m_nOffsetY;
+    double              m_dExposureTime;
+    double              m_dGain;
+};
+struct tRecordIndexEntry
+{
+    quint64             m_nSequence;
+    quint64             m_nOffset;              // file offset of the tRecordFrameHeader
+};
+struct tRecordFileTrailer
+{
+    quint64             m_nIndexOffset;
+    quint64             m_nFrames;              // entries in the index
+    char                m_Magic[8];             // "VCRAWIDX"
+};
+#pragma pack( pop )
+
+/** records raw frames to a single file without touching the frame callback's timing.
+* Record only queues a reference to the frame, the recorder thread copies it into one of a few large
+* preallocated blocks and a writer thread writes the full blocks sequentially, optionally unbuffered.
+* when the disk falls behind the frame queue drops the oldest frames; the drops and the queue high water
+* mark are the backpressure report, acquisition itself is never held up
+*/
+class FrameRecorder : public QThread
+{
+public:
+    enum State
+    {
+        State_Idle      = 0,
+        State_Recording = 1,
+        State_Closed    = 2,    // all accepted frames handled and the file closed
+        State_Failed    = 3,    // see ErrorString, the file is closed as far as it got
+    };
+    /* the queue holds references, in zero-copy mode camera buffers, so it stays short; the blocks carry the slack */
+    enum { QUEUE_SIZE = 4, BLOCK_SIZE = 16 * 1024 * 1024, BLOCK_COUNT = 4, SECTOR_SIZE = 4096 };
+
+private:
+    struct RecorderItem
+    {
+        tFrameInfo          m_Frame;
+        quint64             m_nSequence;        // 0 ends the recording
+        RecorderItem() : m_nSequence( 0 ) {}
+    };
+    struct WriteBlock;
+    class Writer;
+
+    ConsumerQueue<RecorderItem>         m_Frames;
+    QVector<WriteBlock*>                m_Blocks;
+    ConsumerQueue<WriteBlock*>          m_FreeBlocks;
+    ConsumerQueue<WriteBlock*>          m_FullBlocks;       // null ends the writer
+    QSharedPointer<Writer>              m_pWriter;
+#ifdef _WIN32
+    void                               *m_hFile;           // HANDLE
+#else
+    int                                 m_hFile;           // file descriptor
+#endif
+    WriteBlock                         *m_pCurrent;         // block the recorder thread fills
+    quint64                             m_nFileSize;        // bytes appended so far
+    bool                                m_bUnbuffered;      // writes bypass the file cache, they have to be sector aligned
+    QVector<tRecordIndexEntry>          m_Index;
+
+    /* written by the frame callback */
+    std::atomic<quint64>                m_nRemaining;       // frames still to accept
+    std::atomic<quint64>                m_nRequested;
+    std::atomic<quint64>                m_nAccepted;
+    std::atomic<quint64>                m_nDropped;
+    std::atomic<quint64>                m_nHighWater;       // max frames waiting in the queue
+    /* written by the recorder and writer threads */
+    std::atomic<quint64>                m_nWritten;
+    std::atomic<quint64>                m_nBytesWritten;
+    std::atomic<int>                    m_State;
+    mutable QMutex                      m_ErrorLock;
+    QString                             m_sError;
+
+    FrameRecorder( const FrameRecorder& );
+    FrameRecorder& operator=( const FrameRecorder& );
+
+    void                append          ( const void *pData, size_t nSize );
+    void                submitCurrent   ( size_t nSize );
+    void                closeFile       ();
+    void                fail            ( const QString &sError );
+    void                writeBlocks     ();
+protected:
+    virtual void run();
+public:
+    FrameRecorder();
+    ~FrameRecorder();
+
+    /**create sFileName and start recording the next nFrames frames handed to Record.
+    * nFrameSize is a hint to preallocate the file, bUnbuffered bypasses the system file cache.
+    * false with ErrorString set if the file could not be created or the buffers not allocated
+    */
+    bool                Start           ( const QString &sFileName, unsigned int nFrames, VmbUint32_t nFrameSize, bool bUnbuffered );
+    /**frame callback: queue frame if frames are still to be recorded, never blocks. true if it was accepted*/
+    bool                Record          ( const tFrameInfo &frame );
+    /**stop accepting frames. must not run alongside Record, FrameObserver calls both under its stopping lock;
+    * once it returned Start and Stop may run while the callback keeps calling Record
+    */
+    void                StopAccepting   ()          { m_nRemaining.store( 0, std::memory_order_release ); }
+    /**stop accepting frames, write what is queued and close the file. blocks until the file is closed*/
+    void                Stop            ();
+
+    State               state           () const    { return static_cast<State>( m_State.load( std::memory_order_acquire ) ); }
+    QString             ErrorString     () const;
+    quint64             Requested       () const    { return m_nRequested.load( std::memory_order_relaxed ); }
+    quint64             Accepted        () const    { return m_nAccepted.load( std::memory_order_relaxed ); }
+    quint64             Written         () const    { return m_nWritten.load( std::memory_order_relaxed ); }
+    quint64             Dropped         () const    { return m_nDropped.load( std::memory_order_relaxed ); }
+    quint64             HighWater       () const    { return m_nHighWater.load( std::memory_order_relaxed ); }
+    quint64             BytesWritten    () const    { return m_nBytesWritten.load( std::memory_order_relaxed ); }
+    /**short one line form for the status bar, empty while idle*/
+    QString             Summary         () const;
+
+    /**the records of the file format, for writers of recordings other than FrameRecorder*/
+    static tRecordFileHeader    FileHeader  ();
+    static tRecordFrameHeader   FrameHeader ( const tFrameInfo &frame, quint64 nSequence );
+    static tRecordFileTrailer   FileTrailer ( quint64 nIndexOffset, quint64 nFrames );
+    /**write frames to a new recording file in one go, each frame is released once written. false with sError set on failure*/
+    static bool                 WriteFrames ( const QString &sFileName, QVector<tFrameInfo> &frames, QString &sError );
+};
+typedef QSharedPointer<FrameRecorder> FrameRecorderPtr;
+
+#endif
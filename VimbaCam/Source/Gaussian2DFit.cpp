@@ -1,20 +1,86 @@
 #include "Gaussian2DFit.h"
+#include "CpuDispatch.h"
+#include "FitWorkspaceCache.h"
 #include <iostream>
 #include <qDebug>
-#include <thread>
-#include <future>
 #include <chrono>
+#include <cmath>
+
+namespace
+{
+    typedef void (*ExpKernel)(const double* x, double* y, size_t n);
+
+    void expScalar(const double* x, double* y, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            y[i] = exp(x[i]);
+    }
+
+#ifdef CPU_HAS_X86
+    /* exp of 4 doubles at a time, the cephes scheme: x = k * ln2 + r with |r| <= ln2 / 2, exp(r) from a
+    *  pade approximant, 2^k put into the exponent bits. x is clamped to [-708, 709], the result stays a normal
+    *  number; relative error within a few ulp of exp. y may be x */
+    CPU_TARGET("avx2") void expAVX2(const double* x, double* y, size_t n)
+    {
+        const __m256d   hi      = _mm256_set1_pd(709.0);
+        const __m256d   lo      = _mm256_set1_pd(-708.0);
+        const __m256d   log2e   = _mm256_set1_pd(1.4426950408889634073599);
+        const __m256d   c1      = _mm256_set1_pd(6.93145751953125E-1);
+        const __m256d   c2      = _mm256_set1_pd(1.42860682030941723212E-6);
+        const __m256d   p0      = _mm256_set1_pd(1.26177193074810590878E-4);
+        const __m256d   p1      = _mm256_set1_pd(3.02994407707441961300E-2);
+        const __m256d   p2      = _mm256_set1_pd(9.99999999999999999910E-1);
+        const __m256d   q0      = _mm256_set1_pd(3.00198505138664455042E-6);
+        const __m256d   q1      = _mm256_set1_pd(2.52448340349684104192E-3);
+        const __m256d   q2      = _mm256_set1_pd(2.27265548208155028766E-1);
+        const __m256d   q3      = _mm256_set1_pd(2.00000000000000000009E0);
+        const __m256d   one     = _mm256_set1_pd(1.0);
+        const __m256d   two     = _mm256_set1_pd(2.0);
+        /* k + 1023 ends up in the low mantissa bits of k + 2^52 + 1023 */
+        const __m256d   bias    = _mm256_set1_pd(4503599627370496.0 + 1023.0);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d v = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(x + i), lo), hi);
+            const __m256d k = _mm256_round_pd(_mm256_mul_pd(v, log2e), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            v = _mm256_sub_pd(_mm256_sub_pd(v, _mm256_mul_pd(k, c1)), _mm256_mul_pd(k, c2));
+            const __m256d xx = _mm256_mul_pd(v, v);
+            const __m256d px = _mm256_mul_pd(v, _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(p0, xx), p1), xx), p2));
+            const __m256d qx = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(q0, xx), q1), xx), q2), xx), q3);
+            const __m256d er = _mm256_add_pd(one, _mm256_mul_pd(two, _mm256_div_pd(px, _mm256_sub_pd(qx, px))));
+            const __m256i e2k = _mm256_slli_epi64(_mm256_castpd_si256(_mm256_add_pd(k, bias)), 52);
+            _mm256_storeu_pd(y + i, _mm256_mul_pd(er, _mm256_castsi256_pd(e2k)));
+        }
+        expScalar(x + i, y + i, n - i);
+    }
+#endif
+
+    /* picked once, on the cpu's support of AVX2 */
+    ExpKernel expKernel()
+    {
+#ifdef CPU_HAS_X86
+        static const ExpKernel kernel = cpu_has_avx2() ? expAVX2 : expScalar;
+        return kernel;
+#else
+        return expScalar;
+#endif
+    }
+}
 
 Gaussian2DFit::Gaussian2DFit(
     size_t n, size_t width, size_t height, double* datax, double* datay, double* dataz,
     double A0, double x00, double y00, double a0, double b0, double c0, double D0,
     size_t max_iter, double ptol, double gtol, double ftol) :
     max_iter(max_iter), ptol(ptol), gtol(gtol), ftol(ftol),
-    info(-1), rss(-1)
+    info(-1), budget_ms(defaultBudgetMs), stopped(false), cancelled(false), rss(-1)
 {
     fdf_params = gsl_multifit_nlinear_default_parameters();
     fdf_params.trs = gsl_multifit_nlinear_trs_lmaccel;
     //fdf_params.trs = gsl_multifit_nlinear_trs_lm;
+    fit_data.simd = true;
+    fit_data.threads = true;
+    fit_data.limited = false;
+    fit_data.cancel = &cancelled;
 
     set_data(n, width, height, datax, datay, dataz, false);
 
@@ -33,11 +99,6 @@ Gaussian2DFit::Gaussian2DFit(
     jacEllipseMinorABC = gsl_vector_alloc(3);
 
     set_initialP(A0, x00, y00, a0, b0, c0, D0);
-
-    work = gsl_multifit_nlinear_alloc(
-        gsl_multifit_nlinear_trust, &fdf_params, n, numOfPara);
-    f = gsl_multifit_nlinear_residual(work);
-    p = gsl_multifit_nlinear_position(work);
 }
 
 double Gaussian2DFit::gaussian2d(const double A, const double x0, const double y0,
@@ -82,59 +143,94 @@ const std::pair<double, double> Gaussian2DFit::MajorMinor95() const
     return std::make_pair(ellipseMajor95, ellipseMinor95);
 }
 
+/* the exp term of pixel (i, j) for the parameters p, shared by f, df and fvv. the driver evaluates df and fvv
+* at the point f was last evaluated at, so each parameter set costs one pass of exp over the image */
+void Gaussian2DFit::evalExp(data* dataf, const gsl_vector* p)
+{
+    double para[numOfPara];
+    for (size_t k = 0; k < numOfPara; ++k)
+        para[k] = gsl_vector_get(p, k);
+    if (dataf->eiValid && std::equal(para, para + numOfPara, dataf->eiPara))
+        return;
+    const double x0 = para[1];
+    const double y0 = para[2];
+    const double a = para[3];
+    const double b = para[4];
+    const double c = para[5];
+    const ExpKernel expRow = dataf->simd ? expKernel() : expScalar;
+    forRowBlocks(dataf->height, dataf->n, dataf->threads, [dataf, x0, y0, a, b, c, expRow](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            const double deltay = dataf->y[i] - y0;
+            const double cyy = c * deltay * deltay;
+            const double bxy = 2. * b * deltay;
+            double* ei = dataf->ei.data() + i * dataf->width;
+            for (size_t j = 0; j < dataf->width; j++)
+            {
+                const double deltax = dataf->x[j] - x0;
+                ei[j] = -a * deltax * deltax - cyy - bxy * deltax;
+            }
+            expRow(ei, ei, dataf->width);
+        } });
+    std::copy(para, para + numOfPara, dataf->eiPara);
+    dataf->eiValid = true;
+}
+
+bool Gaussian2DFit::stopRequested(const data* dataf)
+{
+    return dataf->limited
+        && (dataf->cancel->load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= dataf->deadline);
+}
+
 int Gaussian2DFit::func_f(const gsl_vector* p, void* datafit, gsl_vector* f)
 {
     data* dataf = static_cast<data*>(datafit);
-    const double& A  = gsl_vector_get(p, 0);
-    const double& x0 = gsl_vector_get(p, 1);
-    const double& y0 = gsl_vector_get(p, 2);
-    const double& a  = gsl_vector_get(p, 3);
-    const double& b  = gsl_vector_get(p, 4);
-    const double& c  = gsl_vector_get(p, 5);
-    const double& D  = gsl_vector_get(p, 6);
-
-    for (size_t i = 0; i < dataf->height; ++i)
-    {
-        for (size_t j = 0; j < dataf->width; j++)
-        {
-            double z = gaussian2d(A, x0, y0, a, b, c, D,
-                dataf->x[j], dataf->y[i]);
-            gsl_vector_set(f, i * dataf->width + j, dataf->z[i * dataf->width + j] - z);
-        }  
-    }
+    /* f is evaluated at every trial step, before the step is taken; failing it leaves p at the last accepted point */
+    if (stopRequested(dataf))
+        return GSL_EBADFUNC;
+    const double A = gsl_vector_get(p, 0);
+    const double D = gsl_vector_get(p, 6);
+
+    evalExp(dataf, p);
+    forRowBlocks(dataf->height, dataf->n, dataf->threads, [dataf, f, A, D](size_t first, size_t last) {
+        const size_t stride = f->stride;
+        for (size_t k = first * dataf->width; k < last * dataf->width; ++k)
+            f->data[k * stride] = dataf->z[k] - (A * dataf->ei[k] + D); });
 
     return GSL_SUCCESS;
 }
 
 int Gaussian2DFit::func_df(const gsl_vector* p, void* datafit, gsl_matrix* J)
 {
-    struct data* dataf = (struct data*)datafit;
-    const double& A = gsl_vector_get(p, 0);
-    const double& x0 = gsl_vector_get(p, 1);
-    const double& y0 = gsl_vector_get(p, 2);
-    const double& a = gsl_vector_get(p, 3);
-    const double& b = gsl_vector_get(p, 4);
-    const double& c = gsl_vector_get(p, 5);
-    const double& D = gsl_vector_get(p, 6);
-
+    data* dataf = static_cast<data*>(datafit);
+    const double A = gsl_vector_get(p, 0);
+    const double x0 = gsl_vector_get(p, 1);
+    const double y0 = gsl_vector_get(p, 2);
+    const double a = gsl_vector_get(p, 3);
+    const double b = gsl_vector_get(p, 4);
+    const double c = gsl_vector_get(p, 5);
 
-    for (size_t i = 0; i < dataf->height; ++i)
-    {
-        for (size_t j = 0; j < dataf->width; j++)
+    evalExp(dataf, p);
+    forRowBlocks(dataf->height, dataf->n, dataf->threads, [dataf, J, A, x0, y0, a, b, c](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
         {
-            const double deltax = dataf->x[j] - x0;
             const double deltay = dataf->y[i] - y0;
-            const double ei = exp(-a * deltax * deltax - c * deltay * deltay - 2 * b * deltax * deltay);
-
-            gsl_matrix_set(J, i * dataf->width + j, 0, -ei);
-            gsl_matrix_set(J, i * dataf->width + j, 1, -2 * A * (a * deltax + b * deltay) * ei);
-            gsl_matrix_set(J, i * dataf->width + j, 2, -2 * A * (b * deltax + c * deltay) * ei);
-            gsl_matrix_set(J, i * dataf->width + j, 3, A * deltax * deltax * ei);
-            gsl_matrix_set(J, i * dataf->width + j, 4, 2 * A * deltax * deltay * ei);
-            gsl_matrix_set(J, i * dataf->width + j, 5, A * deltay * deltay * ei);
-            gsl_matrix_set(J, i * dataf->width + j, 6, -1);
-        }
-    }
+            const double* ei = dataf->ei.data() + i * dataf->width;
+            /* the rows of J are contiguous, numOfPara values each */
+            double* row = J->data + i * dataf->width * J->tda;
+            for (size_t j = 0; j < dataf->width; j++, row += J->tda)
+            {
+                const double deltax = dataf->x[j] - x0;
+                const double Aei = A * ei[j];
+                row[0] = -ei[j];
+                row[1] = -2 * (a * deltax + b * deltay) * Aei;
+                row[2] = -2 * (b * deltax + c * deltay) * Aei;
+                row[3] = deltax * deltax * Aei;
+                row[4] = 2 * deltax * deltay * Aei;
+                row[5] = deltay * deltay * Aei;
+                row[6] = -1;
+            }
+        } });
 
     return GSL_SUCCESS;
 }
@@ -143,74 +239,59 @@ int Gaussian2DFit::func_fvv(const gsl_vector* p, const gsl_vector* v,
     void* datafit, gsl_vector* fvv)
 {
     data* dataf = static_cast<data*>(datafit);
-    const double& A = gsl_vector_get(p, 0);
-    const double& x0 = gsl_vector_get(p, 1);
-    const double& y0 = gsl_vector_get(p, 2);
-    const double& a = gsl_vector_get(p, 3);
-    const double& b = gsl_vector_get(p, 4);
-    const double& c = gsl_vector_get(p, 5);
-    const double& D = gsl_vector_get(p, 6);
-
-    const double& vA = gsl_vector_get(v, 0);
-    const double& vx0 = gsl_vector_get(v, 1);
-    const double& vy0 = gsl_vector_get(v, 2);
-    const double& va = gsl_vector_get(v, 3);
-    const double& vb = gsl_vector_get(v, 4);
-    const double& vc = gsl_vector_get(v, 5);
-    const double& vD = gsl_vector_get(v, 6);
-    
-    //gsl_matrix* Dvv = gsl_matrix_alloc(numOfPara, numOfPara);
+    if (stopRequested(dataf))
+        return GSL_EBADFUNC;
+    const double A = gsl_vector_get(p, 0);
+    const double x0 = gsl_vector_get(p, 1);
+    const double y0 = gsl_vector_get(p, 2);
+    const double a = gsl_vector_get(p, 3);
+    const double b = gsl_vector_get(p, 4);
+    const double c = gsl_vector_get(p, 5);
 
-    for (size_t i = 0; i < dataf->height; ++i)
-    {
-        for (size_t j = 0; j < dataf->width; j++)
+    const double vA = gsl_vector_get(v, 0);
+    const double vx0 = gsl_vector_get(v, 1);
+    const double vy0 = gsl_vector_get(v, 2);
+    const double va = gsl_vector_get(v, 3);
+    const double vb = gsl_vector_get(v, 4);
+    const double vc = gsl_vector_get(v, 5);
+
+    /* the second directional derivative of the residual along v in closed form, with the exponent
+    *  Q = a*dx^2 + 2*b*dx*dy + c*dy^2 and its first and second derivatives Q1, Q2 along v:
+    *  fvv = ei * (2*vA*Q1 - A*(Q1^2 - Q2)), Q1 and Q2 are polynomials in dx with per row coefficients */
+    const double alpha = -4. * (va * vx0 + vb * vy0);
+    const double beta = -4. * (vb * vx0 + vc * vy0);
+    const double gamma = 2. * a * vx0 * vx0 + 4. * b * vx0 * vy0 + 2. * c * vy0 * vy0;
+    const double ax = a * vx0 + b * vy0;
+    const double cy = b * vx0 + c * vy0;
+
+    evalExp(dataf, p);
+    forRowBlocks(dataf->height, dataf->n, dataf->threads, [=](size_t first, size_t last) {
+        const size_t stride = fvv->stride;
+        for (size_t i = first; i < last; ++i)
         {
-            const double deltax = dataf->x[j] - x0;
             const double deltay = dataf->y[i] - y0;
-            const double ei = exp(-a * deltax * deltax - c * deltay * deltay - 2. * b * deltax * deltay);
-        
-            double DA_x0 = (-2. * a * deltax - 2. * b * deltay) * ei;
-            double DA_y0 = (-2. * b * deltax - 2. * c * deltay) * ei;
-            double DA_a = deltax * deltax * ei;
-            double DA_b = 2. * deltax * deltay * ei;
-            double DA_c = deltay * deltay * ei;
-
-            double Dx0_x0 = 2. * A * (a - 2. * a * a * deltax * deltax - 4. * a * b * deltax * deltay - 2. * b * b * deltay * deltay) * ei;
-            double Dx0_y0 = 2. * A * (b - 2. * a * b * deltax * deltax - 2. * (b * b + a * c) * deltax * deltay - 2. * b * c * deltay * deltay) * ei;
-            double Dx0_a = 2. * A * deltax * (-1. + a * deltax * deltax + b * deltax * deltay) * ei;
-            double Dx0_b = 2. * A * deltay * (-1. + 2. * a * deltax * deltax + 2. * b * deltax * deltay) * ei;
-            double Dx0_c = 2. * A * deltay * deltay * (a * deltax + b * deltay) * ei;
-
-            double Dy0_y0 = 2. * A * (c - 2. * b * b * deltax * deltax - 4. * b * c * deltax * deltay - 2. * c * c * deltay * deltay) * ei;
-            double Dy0_a = 2. * A * deltax * deltax * (b * deltax + c * deltay) * ei;
-            double Dy0_b = 2. * A * deltax * (-1 + 2. * b * deltax * deltay + 2. * c * deltay * deltay) * ei;
-            double Dy0_c = 2. * A * deltay * (-1 + b * deltax * deltay + c * deltay * deltay) * ei;
-
-            double Da_a = -A * deltax * deltax * deltax * deltax * ei;
-            double Da_b = -2. * A * deltax * deltax * deltax * deltay * ei;
-            double Da_c = -A * deltax * deltax * deltay * deltay * ei;
-
-            double Db_b = -4. * A * deltax * deltax * deltay * deltay * ei;
-            double Db_c = -2. * A * deltax * deltay * deltay * deltay * ei;
-
-            double Dc_c = -A * deltay * deltay * deltay * deltay * ei;
-        
-            double sum =
-                2. * vA * vx0 * DA_x0 + 2. * vA * vy0 * DA_y0 + 2. * vA * va * DA_a + 2. * vA * vb * DA_b + 2. * vA * vc * DA_c +
-                vx0 * vx0 * Dx0_x0 + 2. * vx0 * vy0 * Dx0_y0 + 2. * vx0 * va * Dx0_a + 2. * vx0 * vb * Dx0_b + 2. * vx0 * vc * Dx0_c +
-                vy0 * vy0 * Dy0_y0 + 2. * vy0 * va * Dy0_a + 2. * vy0 * vb * Dy0_b + 2. * vy0 * vc * Dy0_c +
-                va * va * Da_a + 2. * va * vb * Da_b + 2. * va * vc * Da_c +
-                vb * vb * Db_b + 2. * vb * vc * Db_c +
-                vc * vc * Dc_c;
-
-            gsl_vector_set(fvv, i * dataf->width + j, sum);
-        }
-    }
-
+            const double q1 = 2. * (vb * deltay - ax);
+            const double q0 = (vc * deltay - 2. * cy) * deltay;
+            const double r0 = beta * deltay + gamma;
+            const double* ei = dataf->ei.data() + i * dataf->width;
+            double* out = fvv->data + i * dataf->width * stride;
+            for (size_t j = 0; j < dataf->width; j++, out += stride)
+            {
+                const double deltax = dataf->x[j] - x0;
+                const double Q1 = (va * deltax + q1) * deltax + q0;
+                const double Q2 = alpha * deltax + r0;
+                *out = (2. * vA * Q1 - A * (Q1 * Q1 - Q2)) * ei[j];
+            }
+        } });
 
     return GSL_SUCCESS;
 }
 
+const char* Gaussian2DFit::expKernelName()
+{
+    return expKernel() == expScalar ? "Scalar" : "AVX2";
+}
+
 void Gaussian2DFit::solve_system()
 {
     double rss0, rcond;
@@ -222,26 +303,40 @@ void Gaussian2DFit::solve_system()
     gsl_blas_ddot(f, f, &rss0);
     rss0 *= 1.0 / static_cast<double>(fit_data.n - numOfPara);
 
-    /* iterate until convergence */
-
-
-    std::packaged_task<int()> task(std::bind(
-        &gsl_multifit_nlinear_driver,max_iter, ptol, gtol, ftol, nullptr, nullptr, &info, work));
-    auto future = task.get_future();
-    std::thread thrd(std::move(task));
-    if (future.wait_for(std::chrono::milliseconds(300)) == std::future_status::timeout)
+    /* iterate until convergence, the loop of gsl_multifit_nlinear_driver on the calling thread with the budget
+    *  checked between iterations and, through f and fvv, within them. the driver's callback cannot end it */
+    const auto start = std::chrono::steady_clock::now();
+    fit_data.deadline = budget_ms > 0
+        ? start + std::chrono::microseconds(static_cast<long long>(budget_ms * 1000.))
+        : std::chrono::steady_clock::time_point::max();
+    fit_data.limited = true;
+    stopped = false;
+    info = 0;
+    int status = GSL_CONTINUE;
+    for (size_t iter = 0; status == GSL_CONTINUE && iter < max_iter; ++iter)
     {
-        //thrd.detach();
-        //thrd.~thread();
-        thrd.join();
-        throw std::runtime_error("Timeout");
-        //return;
+        if (stopRequested(&fit_data))
+        {
+            stopped = true;
+            break;
+        }
+        status = gsl_multifit_nlinear_iterate(work);
+        if (stopRequested(&fit_data))
+        {
+            stopped = true;
+            break;
+        }
+        /* no step that lowers the cost from the initial guess, more iterations will not find one either */
+        if (status == GSL_ENOPROG && iter == 0)
+        {
+            info = status;
+            break;
+        }
+        status = gsl_multifit_nlinear_test(ptol, gtol, ftol, &info, work);
     }
-    else{ thrd.detach(); }
-    
-
-    
-
+    fit_data.limited = false;
+    if (stopped)
+        info = 0;
 
     /* store final cost */
     gsl_blas_ddot(f, f, &rss);
@@ -344,11 +439,13 @@ void Gaussian2DFit::set_data(size_t n, size_t width, size_t height,
     fit_data.z = dataz;
     fit_data.width = width;
     fit_data.height = height;
+    fit_data.ei.resize(n);
+    fit_data.eiValid = false;
 
     fdf.n = n;
-    if (free) { gsl_multifit_nlinear_free(work); }
-    work = gsl_multifit_nlinear_alloc(
-        gsl_multifit_nlinear_trust, &fdf_params, n, numOfPara);
+    /* the workspace goes back to the cache and comes out again unless the size changed */
+    if (free) { FitWorkspaceCache::release(fdf_params, work); }
+    work = FitWorkspaceCache::acquire(fdf_params, n, numOfPara);
     f = gsl_multifit_nlinear_residual(work);
     p = gsl_multifit_nlinear_position(work);
 }
@@ -367,7 +464,7 @@ void Gaussian2DFit::set_initialP(double A0, double x00, double y00,
 
 Gaussian2DFit::~Gaussian2DFit()
 {
-    gsl_multifit_nlinear_free(work);
+    FitWorkspaceCache::release(fdf_params, work);
     gsl_vector_free(p0);
     gsl_vector_free(confid95);
     gsl_vector_free(jacEllipseMajorABC);
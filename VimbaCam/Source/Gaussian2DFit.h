@@ -6,10 +6,18 @@
 #include <QVector>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <tuple>
+#include <vector>
 
 class Gaussian2DFit
 {
+    enum
+    {
+        numOfPara = 7
+    };
+
     struct data
     {
         double* x;
@@ -19,11 +27,20 @@ class Gaussian2DFit
         double* z;
         size_t width;
         size_t height;
-    };
 
-    enum
-    {
-        numOfPara = 7
+        /* exp term of every pixel, computed by whichever of f, df and fvv runs first for a parameter set */
+        std::vector<double> ei;
+        double eiPara[numOfPara];
+        bool eiValid;
+
+        bool simd;      /* batched exp with the vector kernel the cpu supports */
+        bool threads;   /* large images are evaluated in row blocks on the global thread pool */
+
+        /* set by solve_system once the solver is initialized: f and fvv fail once cancel is set or the deadline
+        *  passed, so an iteration in progress ends after its current evaluation */
+        bool limited;
+        const std::atomic<bool>* cancel;
+        std::chrono::steady_clock::time_point deadline;
     };
     /* model function: A *exp(-a*(x-x0)^2 - 2*b*(x-x0)*(y-y0) - c*(y-y0)^2) + d, 
     see more detail https://en.wikipedia.org/wiki/Gaussian_function#Two-dimensional_Gaussian_function*/
@@ -45,6 +62,9 @@ private:
     double                           ftol;
 
     int                              info;/*fiting stop reason, for debug*/
+    double                           budget_ms; /* time limit of one solve_system, 0 is none */
+    bool                             stopped; /* the last solve_system ran out of time or was cancelled */
+    std::atomic<bool>                cancelled;
     double                           rss; /*mean of sum of residual square, dof corrected*/
     
     gsl_vector*                      confid95;
@@ -54,6 +74,8 @@ private:
     double                           ellipseMinor95;
 
 public:
+    static constexpr double defaultBudgetMs = 300.; /* longer and the fit holds up the frames behind it */
+
     Gaussian2DFit() {};
     Gaussian2DFit(size_t n, size_t width, size_t height, double* datax, double* datay, double* dataz,
         double A0, double x00, double y00, double a0, double b0, double c0, double D0, 
@@ -63,8 +85,26 @@ public:
     void set_data(double* datay);
     void set_data(size_t n, size_t width, size_t height, double* datax, double* datay, double* dataz, bool free = true);
     void set_initialP(double A0, double x00, double y00, double a0, double b0, double c0, double D0);
+    void set_initialP(const QVector<double>& para) {
+        set_initialP(para.at(0), para.at(1), para.at(2), para.at(3), para.at(4), para.at(5), para.at(6)); }
 
     int getInfo() const { return info; }
+    /* the last solve_system stopped on one of the tolerances, not on max_iter, its budget or a failed first step */
+    bool converged() const { return !stopped && info >= 1 && info <= 3; }
+    double getRss() const { return rss; }
+    /* limits of one solve_system, 0 ms is no time limit. a solve that runs out of either stops
+    *  with the best parameters found so far, the trust region method never moves to a worse point */
+    void setBudget(double ms, size_t iterations) { budget_ms = ms; max_iter = iterations; }
+    /* from any thread: a running solve_system stops after its current evaluation, and until cleared
+    *  the following ones stop at the initial guess, so whoever sets it clears it once its solves are done */
+    void setCancelled(bool cancel) { cancelled.store(cancel); }
+    /* the last solve_system ended on the time budget or a cancel instead of converging or running out of iterations */
+    bool expired() const { return stopped; }
+    size_t getIterations() const { return gsl_multifit_nlinear_niter(work); }
+    /* how f, df and fvv are evaluated, both on by default; for comparisons */
+    void setEvaluation(bool simd, bool threads) { fit_data.simd = simd; fit_data.threads = threads; }
+    /* name of the exp kernel the simd evaluation uses on this cpu */
+    static const char* expKernelName();
 
     static double gaussian2d(const double A, const double x0, const double y0, 
         const double a, const double b, const double c, const double D, 
@@ -82,6 +122,9 @@ private:
     static int func_fvv(const gsl_vector* p, const gsl_vector* v,
         void* datafit, gsl_vector* fvv);
 
+    static bool stopRequested(const data* dataf);
+    static void evalExp(data* dataf, const gsl_vector* p);
+
     void inline errorPropaABC(double a, double b, double c, gsl_vector* ellipseJac, 
         bool Major = true);/*for calculating jac of the transformed gaussian arg, now is a classical form of ellipse*/
 };
@@ -4,10 +4,111 @@
 #include <QtEndian>
 #include <QStringList>
 
+#include <algorithm>
+
 #include "memcpy_threaded.h"
 
+FramePool::FramePool( int maxFreePerSize )
+    : m_MaxFreePerSize( maxFreePerSize )
+{
+}
+
+FramePool::~FramePool()
+{
+    Clear();
+}
+
+void FramePool::Reserve( VmbUint32_t size, int count )
+{
+    QMutexLocker local_lock( &m_Lock );
+    if( !m_ReservedSizes.contains( size ) )
+    {
+        m_ReservedSizes.push_back( size );
+        std::sort( m_ReservedSizes.begin(), m_ReservedSizes.end() );
+    }
+    QList<VmbUchar_t*> &freeBuffers = m_FreeBuffers[size];
+    while( freeBuffers.size() < count )
+    {
+        freeBuffers.push_back( new VmbUchar_t[size] );
+    }
+}
+
+VmbUchar_t* FramePool::Take( VmbUint32_t &size )
+{
+    VmbUchar_t *pBuffer = NULL;
+    {
+        QMutexLocker local_lock( &m_Lock );
+        foreach( VmbUint32_t reservedSize, m_ReservedSizes )
+        {
+            if( reservedSize >= size )
+            {
+                size = reservedSize;
+                break;
+            }
+        }
+        QHash<VmbUint32_t, QList<VmbUchar_t*> >::iterator it = m_FreeBuffers.find( size );
+        if( it != m_FreeBuffers.end() && !it->empty() )
+        {
+            pBuffer = it->takeLast();   // most recently used, most likely still mapped and cached
+        }
+    }
+    if( NULL != pBuffer )
+    {
+        m_Hits.ref();
+    }
+    else
+    {
+        pBuffer = new VmbUchar_t[size];
+        m_Misses.ref();
+    }
+    const int inUse = m_InUse.fetchAndAddOrdered( 1 ) + 1;
+    int highWater = m_HighWater.loadAcquire();
+    while( inUse > highWater && !m_HighWater.testAndSetOrdered( highWater, inUse ) )
+    {
+        highWater = m_HighWater.loadAcquire();
+    }
+    return pBuffer;
+}
+
+void FramePool::Give( VmbUchar_t *pBuffer, VmbUint32_t size )
+{
+    m_InUse.deref();
+    {
+        QMutexLocker local_lock( &m_Lock );
+        QList<VmbUchar_t*> &freeBuffers = m_FreeBuffers[size];
+        /* buffers of a size no longer reserved, e.g. from before a ROI change, are not kept */
+        if( freeBuffers.size() < m_MaxFreePerSize && ( m_ReservedSizes.empty() || m_ReservedSizes.contains( size ) ) )
+        {
+            freeBuffers.push_back( pBuffer );
+            return;
+        }
+    }
+    delete [] pBuffer;
+}
+
+void FramePool::Clear()
+{
+    QMutexLocker local_lock( &m_Lock );
+    for( QHash<VmbUint32_t, QList<VmbUchar_t*> >::iterator it = m_FreeBuffers.begin(); it != m_FreeBuffers.end(); ++it )
+    {
+        foreach( VmbUchar_t *pBuffer, *it )
+        {
+            delete [] pBuffer;
+        }
+    }
+    m_FreeBuffers.clear();
+    m_ReservedSizes.clear();
+}
+
+void FramePool::ResetStatistics()
+{
+    m_Hits.storeRelease( 0 );
+    m_Misses.storeRelease( 0 );
+    m_HighWater.storeRelease( m_InUse.loadAcquire() );
+}
+
 /**copy construct from Vimba frame*/
-tFrameInfo::tFrameInfo( const FramePtr& frame, bool color_interpolation )
+tFrameInfo::tFrameInfo( const FramePtr& frame, bool color_interpolation, const FramePoolPtr &pPool )
     : BaseFrame( frame, color_interpolation )
 {
     VmbError_t Result;
@@ -15,14 +116,35 @@ tFrameInfo::tFrameInfo( const FramePtr& frame, bool color_interpolation )
     Result = frame->GetImage( pData );
     if ( Result != VmbErrorSuccess )
     {
-        std::runtime_error( "could not get frame data" );
+        throw std::runtime_error( "could not get frame data" );
+    }
+    if( NULL != pPool )
+    {
+        VmbUint32_t nCapacity = Size();
+        VmbUchar_t *pBuffer = pPool->Take( nCapacity );
+        m_pFrameData = FrameDataPtr( pBuffer, FramePoolReturn( pPool, nCapacity ) );
+    }
+    else
+    {
+        m_pFrameData = FrameDataPtr( new VmbUchar_t[Size()], DeleteArray<VmbUchar_t> );
     }
-    m_pFrameData = FrameDataPtr( new VmbUchar_t[Size()], DeleteArray<VmbUchar_t> );
     if ( m_pFrameData == NULL )
     {
         throw std::bad_alloc();
     }
-    memcpy_threaded<2>( m_pFrameData.data(), pData, Size() );
+    memcpy_threaded( m_pFrameData.data(), pData, Size() );
+}
+
+/**lease construct from Vimba frame*/
+tFrameInfo::tFrameInfo( const FramePtr& frame, bool color_interpolation, const CameraPtr &pCam, const CaptureSessionPtr &pSession )
+    : BaseFrame( frame, color_interpolation )
+{
+    VmbUchar_t* pData;
+    if ( VmbErrorSuccess != frame->GetImage( pData ) )
+    {
+        throw std::runtime_error( "could not get frame data" );
+    }
+    m_pFrameData = FrameDataPtr( pData, FrameLease( pCam, frame, pSession ) );
 }
 
 namespace Helper
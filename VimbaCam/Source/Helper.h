@@ -43,10 +43,20 @@ using AVT::VmbAPI::FramePtr;
 #include <QMutex>
 #include <QMutexLocker>
 #include <QWaitCondition>
+#include <QElapsedTimer>
 #include <QVector>
 #include <QList>
+#include <QHash>
+#include <QAtomicInt>
 #include <exception>
 #include <stdexcept>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+#include "FrameLatency.h"
+#include "FrameDropStats.h"
 
 // QSharedPoinnter custom deleter
 template <class T>
@@ -57,92 +67,305 @@ void DeleteArray(T *pArray)
 
 
 /** consumer frame queue with max size limit.
+* bounded lock free ring, the slots carry a sequence number so that a position is claimed with a single CAS
+* and published with a release store (D. Vyukov's bounded queue). the producer (Vimba callback) never takes a lock
+* unless the consumer sleeps on an empty queue. when the ring is full the producer claims the oldest item itself
+* and drops it, StopProcessing drains the ring the same way.
+* the ring is multi-consumer on purpose: dropping the oldest item makes the producer a second consumer racing the
+* worker for the read position, and StopProcessing drains from a third thread. an SPSC ring would need a lock
+* around the read side for these, the sequence numbers cost one more acquire load per item instead.
+* --benchmark --queue-sweep compares it with the mutex and list queue it replaced.
+* items are moved in and out, a slot is reset right after its item was taken so frame buffers are released early.
 */
 template <typename DATA_TYPE>
 class ConsumerQueue
 {
-    QList<DATA_TYPE>    m_Data;             // frame storage
-    mutable QMutex      m_Lock;             // queue synch lock
-    QWaitCondition      m_DataAvailable;    // data available condition
-    bool                m_Stopping;         // state of the queue
-    const size_t        m_MaxSize;          // max number of frames before the oldest will get dropped
+    enum { CACHE_LINE = 64 };
+    struct alignas(CACHE_LINE) Slot
+    {
+        std::atomic<size_t>             m_Sequence;         // == position when free for that position, position + 1 when filled
+        DATA_TYPE                       m_Data;
+    };
+    const size_t                        m_MaxSize;          // max number of frames before the oldest will get dropped
+    std::unique_ptr<Slot[]>             m_Slots;            // ring storage
+    alignas(CACHE_LINE) std::atomic<size_t> m_EnqueuePos;   // next position to write
+    alignas(CACHE_LINE) std::atomic<size_t> m_DequeuePos;   // next position to read
+    alignas(CACHE_LINE) std::atomic<bool>   m_Stopping;     // state of the queue
+    std::atomic<int>                    m_Sleepers;         // consumers waiting in WaitData
+    std::atomic<int>                    m_TakenSleepers;    // producers waiting in WaitFree or WaitEmpty
+    QMutex                              m_SleepLock;        // only taken to sleep on / signal an empty or full queue
+    QWaitCondition                      m_DataAvailable;    // data available condition
+    QWaitCondition                      m_ItemTaken;        // a consumer took an item condition
+
+    ConsumerQueue( const ConsumerQueue& );
+    ConsumerQueue& operator=( const ConsumerQueue& );
+
+    /**claim the slot for the next write position, false if the ring is full*/
+    bool TryEnqueue( DATA_TYPE &v )
+    {
+        size_t pos = m_EnqueuePos.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            Slot &slot = m_Slots[pos % m_MaxSize];
+            const size_t seq = slot.m_Sequence.load( std::memory_order_acquire );
+            const ptrdiff_t diff = static_cast<ptrdiff_t>( seq - pos );
+            if( 0 == diff )
+            {
+                if( m_EnqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    slot.m_Data = std::move( v );
+                    slot.m_Sequence.store( pos + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_EnqueuePos.load( std::memory_order_relaxed );
+            }
+        }
+    }
+    /**claim the slot for the next read position, false if the ring is empty*/
+    bool TryDequeue( DATA_TYPE &v )
+    {
+        size_t pos = m_DequeuePos.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            Slot &slot = m_Slots[pos % m_MaxSize];
+            const size_t seq = slot.m_Sequence.load( std::memory_order_acquire );
+            const ptrdiff_t diff = static_cast<ptrdiff_t>( seq - ( pos + 1 ) );
+            if( 0 == diff )
+            {
+                if( m_DequeuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    v = std::move( slot.m_Data );
+                    slot.m_Data = DATA_TYPE();
+                    slot.m_Sequence.store( pos + m_MaxSize, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_DequeuePos.load( std::memory_order_relaxed );
+            }
+        }
+    }
+    /**drop everything currently queued*/
+    void Drain()
+    {
+        DATA_TYPE dropped;
+        while( TryDequeue( dropped ) )
+        {
+            dropped = DATA_TYPE();
+        }
+    }
+    /**wake sleeping consumers, cheap if nobody sleeps*/
+    void Notify()
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( 0 != m_Sleepers.load( std::memory_order_relaxed ) )
+        {
+            QMutexLocker local_lock( &m_SleepLock );
+            m_DataAvailable.wakeAll();
+        }
+    }
+    /**wake producers waiting for a consumer to take an item, cheap if nobody waits*/
+    void NotifyTaken()
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( 0 != m_TakenSleepers.load( std::memory_order_relaxed ) )
+        {
+            QMutexLocker local_lock( &m_SleepLock );
+            m_ItemTaken.wakeAll();
+        }
+    }
+    /**wait until ready() holds, the queue is stopped or ms passed. ready is checked again each time a consumer takes an item*/
+    template <typename PRED>
+    bool WaitTaken( PRED ready, unsigned long ms )
+    {
+        QMutexLocker local_lock( &m_SleepLock );
+        m_TakenSleepers.fetch_add( 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        QElapsedTimer timer;
+        timer.start();
+        while( !m_Stopping.load( std::memory_order_acquire ) && !ready() )
+        {
+            const qint64 nElapsed = timer.elapsed();
+            if( nElapsed >= static_cast<qint64>( ms ) )
+            {
+                break;
+            }
+            m_ItemTaken.wait( local_lock.mutex(), static_cast<unsigned long>( ms - nElapsed ) );
+        }
+        m_TakenSleepers.fetch_sub( 1, std::memory_order_relaxed );
+        return m_Stopping.load( std::memory_order_acquire ) || ready();
+    }
 public:
-    /**constructor with max queue size*/
-    explicit ConsumerQueue( size_t maxSize = 0)
-        : m_MaxSize( maxSize )
+    /**constructor with max queue size. the ring has no unbounded mode, 0 throws invalid_argument*/
+    explicit ConsumerQueue( size_t maxSize )
+        : m_MaxSize( 0 != maxSize ? maxSize : throw std::invalid_argument( "ConsumerQueue needs a max size of at least 1" ) )
+        , m_Slots( new Slot[ maxSize ] )
+        , m_EnqueuePos( 0 )
+        , m_DequeuePos( 0 )
         , m_Stopping( false )
-    {}
+        , m_Sleepers( 0 )
+        , m_TakenSleepers( 0 )
+    {
+        for( size_t i = 0; i < m_MaxSize; ++i )
+        {
+            m_Slots[i].m_Sequence.store( i, std::memory_order_relaxed );
+        }
+    }
     /**start queue processing*/
     void StartProcessing()
     {
-        QMutexLocker local_lock( &m_Lock );
-        m_Stopping = false;
+        Drain();
+        m_Stopping.store( false, std::memory_order_release );
     }
     /**stop queue processing, signaling Halt to WaitData*/
     void StopProcessing()
     {
-        {
-            QMutexLocker local_lock( &m_Lock );
-            m_Data.clear();
-            m_Stopping = true;
-        }
-        m_DataAvailable.wakeOne();
+        m_Stopping.store( true, std::memory_order_release );
+        Drain();
+        QMutexLocker local_lock( &m_SleepLock );
+        m_DataAvailable.wakeAll();
+        m_ItemTaken.wakeAll();
     }
     /**test if queue is empty*/
     bool IsEmpty() const
     {
-        QMutexLocker local_lock( & m_Lock );
-        return m_Data.empty();
+        return m_DequeuePos.load( std::memory_order_acquire ) == m_EnqueuePos.load( std::memory_order_acquire );
     }
-    /**enqueue item in queue
+    /**enqueue item in queue, the oldest item is taken out and passed to onDrop if the queue is full
+    * returns the number of items dropped for it. v is left untouched if the queue is stopped
     * might throw bad_alloc
     */
-    void Enqueue( const DATA_TYPE &v)
+    template <typename DROP_HANDLER>
+    size_t Enqueue( DATA_TYPE &&v, DROP_HANDLER &&onDrop )
     {
+        if( m_Stopping.load( std::memory_order_acquire ) )
         {
-            QMutexLocker local_lock( &m_Lock );
-            if( m_Stopping)
-            {
-                m_DataAvailable.wakeOne();
-                return;
-            }
-            if( m_MaxSize != 0 && m_Data.size() == m_MaxSize )
+            return 0;
+        }
+        size_t nDropped = 0;
+        while( !TryEnqueue( v ) )
+        {
+            DATA_TYPE dropped;
+            if( TryDequeue( dropped ) )
             {
-                m_Data.pop_front();
+                ++nDropped;
+                onDrop( dropped );
             }
-            m_Data.push_back( v );
         }
-        m_DataAvailable.wakeOne();
+        Notify();
+        return nDropped;
+    }
+    /**enqueue item in queue, the oldest item is dropped if the queue is full
+    * returns the number of items dropped for it
+    */
+    size_t Enqueue( DATA_TYPE &&v )
+    {
+        return Enqueue( std::move( v ), []( DATA_TYPE& ) {} );
+    }
+    /**enqueue a copy of item in queue*/
+    size_t Enqueue( const DATA_TYPE &v )
+    {
+        return Enqueue( DATA_TYPE( v ) );
+    }
+    /**enqueue item in queue only if there is a free slot, nothing is dropped.
+    * false and v left untouched if the queue is full or stopped
+    */
+    bool EnqueueIfFree( DATA_TYPE &&v )
+    {
+        if( m_Stopping.load( std::memory_order_acquire ) || !TryEnqueue( v ) )
+        {
+            return false;
+        }
+        Notify();
+        return true;
+    }
+    /**the queue was stopped, Enqueue does not take items*/
+    bool IsStopping() const
+    {
+        return m_Stopping.load( std::memory_order_acquire );
+    }
+    /**every slot is claimed, EnqueueIfFree would fail*/
+    bool IsFull() const
+    {
+        return m_EnqueuePos.load( std::memory_order_acquire ) - m_DequeuePos.load( std::memory_order_acquire ) >= m_MaxSize;
+    }
+    /**wait until a slot is free, the queue is stopped or ms passed, false on the timeout.
+    * wakes when a consumer takes an item, a producer waiting here does not poll
+    */
+    bool WaitFree( unsigned long ms )
+    {
+        return WaitTaken( [this]() { return !IsFull(); }, ms );
+    }
+    /**wait until the consumers took every item, the queue is stopped or ms passed, false on the timeout*/
+    bool WaitEmpty( unsigned long ms )
+    {
+        return WaitTaken( [this]() { return IsEmpty(); }, ms );
     }
     /**wait for data item from queue
     * if queue is not empty, an item is returned, else function waits for either a data item to be available,
     * or StopProccessing signal
-    * might return false if queue item canot be copied to v (bad alloc)
     * returns false if StopProcessing is called
     */
     bool WaitData( DATA_TYPE &v)
     {
-        QMutexLocker local_lock( &m_Lock );
-        while( !m_Stopping && m_Data.empty() )
-        {
-            m_DataAvailable.wait( local_lock.mutex() );
-        }
-        if( m_Stopping)
+        for( ;; )
         {
-            return false;
-        }
-        try
-        {
-            v = m_Data.front();
-            m_Data.pop_front();
-            return true;
-        }
-        catch(...)
-        {
-            return false;
+            if( m_Stopping.load( std::memory_order_acquire ) )
+            {
+                return false;
+            }
+            if( TryDequeue( v ) )
+            {
+                NotifyTaken();
+                return true;
+            }
+            QMutexLocker local_lock( &m_SleepLock );
+            m_Sleepers.fetch_add( 1, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            if( !m_Stopping.load( std::memory_order_acquire ) && IsEmpty() )
+            {
+                m_DataAvailable.wait( local_lock.mutex() );
+            }
+            m_Sleepers.fetch_sub( 1, std::memory_order_relaxed );
         }
     }
 };
+/**per frame metadata, filled once on arrival so no consumer has to read camera features to label a frame*/
+struct tFrameMetadata
+{
+    VmbUint64_t             m_nFrameID;                 // camera frame id
+    VmbUint64_t             m_nTimestamp;               // camera timestamp in device ticks, 0 if the source has none
+    VmbUint32_t             m_nOffsetX;                 // sensor position of the frame's ROI
+    VmbUint32_t             m_nOffsetY;
+    double                  m_dExposureTime;            // us, from the chunk data or the settings FrameObserver caches
+    double                  m_dGain;                    // dB, same
+    bool                    m_bChunkData;               // exposure and gain were read from the frame's chunk data
+    bool                    m_bBurst;                   // analysed from a captured burst, the analysis waits for it instead of dropping it
+
+    tFrameMetadata()
+        : m_nFrameID( 0 )
+        , m_nTimestamp( 0 )
+        , m_nOffsetX( 0 )
+        , m_nOffsetY( 0 )
+        , m_dExposureTime( 0.0 )
+        , m_dGain( 0.0 )
+        , m_bChunkData( false )
+        , m_bBurst( false )
+    {}
+};
+
 /**base class for frame data infos*/
 class BaseFrame
 {
@@ -151,6 +374,7 @@ class BaseFrame
     VmbUint32_t             m_Height;                   // frame height
     VmbUint32_t             m_Size;                     // frame size in bytes
     bool                    m_ColorInterpolation;       // requirement if raw data shall be interpolated or displayed as mono
+    tFrameMetadata          m_Metadata;                 // id, timestamp and acquisition settings of this frame
 
 public:
     /**get frame pixel format.*/
@@ -173,6 +397,10 @@ public:
     bool                    UseColorInterpolation()                 const   { return m_ColorInterpolation; }
     /**set state of color interpolation.*/
     void                    UseColorInterpolation(bool v)                   { m_ColorInterpolation = v; }
+    /**get frame metadata.*/
+    const tFrameMetadata&   Metadata()                              const   { return m_Metadata; }
+    /**access frame metadata.*/
+    tFrameMetadata&         Metadata()                                      { return m_Metadata; }
     /**reset frame information from Vimba frame.*/
     void Set( const FramePtr &frame, bool color_interpolation)
     {
@@ -206,6 +434,12 @@ public:
         {
             throw std::runtime_error("could not get image size from frame");
         }
+        /* the metadata is informational, a field the transport layer does not provide stays 0 */
+        m_Metadata = tFrameMetadata();
+        frame->GetFrameID( m_Metadata.m_nFrameID );
+        frame->GetTimestamp( m_Metadata.m_nTimestamp );
+        frame->GetOffsetX( m_Metadata.m_nOffsetX );
+        frame->GetOffsetY( m_Metadata.m_nOffsetY );
     }
     /**default constructor.*/
     BaseFrame( )
@@ -232,10 +466,90 @@ public:
 };
 
 typedef QSharedPointer<VmbUchar_t> FrameDataPtr;
+typedef QSharedPointer<QAtomicInt> CaptureSessionPtr;   // non zero while the capture the frames were announced for is running
+
+/**QSharedPointer custom deleter for leased frame data.
+* the Vimba frame is handed back to the camera queue when the last consumer drops its reference,
+* unless the capture session it belongs to has been stopped in the meantime
+*/
+class FrameLease
+{
+    CameraPtr           m_pCam;
+    FramePtr            m_pFrame;                   // keeps the announced buffer alive while leased
+    CaptureSessionPtr   m_pSession;
+public:
+    FrameLease( const CameraPtr &pCam, const FramePtr &frame, const CaptureSessionPtr &pSession )
+        : m_pCam( pCam )
+        , m_pFrame( frame )
+        , m_pSession( pSession )
+    {}
+    void operator()( VmbUchar_t * ) const
+    {
+        if( m_pSession != NULL && m_pSession->loadAcquire() != 0 )
+        {
+            m_pCam->QueueFrame( m_pFrame );
+        }
+    }
+};
+
+/**size keyed pool of frame data buffers.
+* buffers handed out by Acquire come back on release of their last reference instead of being deleted,
+* so steady state acquisition does not touch the heap
+*/
+class FramePool
+{
+    QHash<VmbUint32_t, QList<VmbUchar_t*> > m_FreeBuffers;      // released buffers by size in bytes
+    QList<VmbUint32_t>                      m_ReservedSizes;    // sizes given to Reserve, ascending
+    mutable QMutex                          m_Lock;             // free list synch lock
+    const int                               m_MaxFreePerSize;   // buffers above this count get deleted on release
+    QAtomicInt                              m_Hits;             // acquires served from the free list
+    QAtomicInt                              m_Misses;           // acquires that needed a new allocation
+    QAtomicInt                              m_InUse;            // buffers currently handed out
+    QAtomicInt                              m_HighWater;        // max buffers handed out at the same time
+public:
+    explicit FramePool( int maxFreePerSize = 16 );
+    ~FramePool();
+    /**allocate count buffers of size bytes up front, might throw bad_alloc*/
+    void            Reserve     ( VmbUint32_t size, int count );
+    /**get a buffer of at least size bytes from the free list or the heap, might throw bad_alloc.
+    * size is rounded up to the smallest reserved size that fits, e.g. image size to payload size
+    */
+    VmbUchar_t*     Take        ( VmbUint32_t &size );
+    /**hand a buffer obtained by Take back to the free list*/
+    void            Give        ( VmbUchar_t *pBuffer, VmbUint32_t size );
+    /**delete all buffers on the free list, handed out buffers are not affected*/
+    void            Clear       ();
+    /**reset hit/miss/high water counters*/
+    void            ResetStatistics();
+
+    int             Hits        ()  const   { return m_Hits.loadAcquire(); }
+    int             Misses      ()  const   { return m_Misses.loadAcquire(); }
+    int             InUse       ()  const   { return m_InUse.loadAcquire(); }
+    int             HighWater   ()  const   { return m_HighWater.loadAcquire(); }
+};
+typedef QSharedPointer<FramePool> FramePoolPtr;
+
+/**QSharedPointer custom deleter returning frame data to its pool*/
+class FramePoolReturn
+{
+    FramePoolPtr        m_pPool;                    // keeps the pool alive while buffers are out
+    VmbUint32_t         m_Size;
+public:
+    FramePoolReturn( const FramePoolPtr &pPool, VmbUint32_t size )
+        : m_pPool( pPool )
+        , m_Size( size )
+    {}
+    void operator()( VmbUchar_t *pBuffer ) const
+    {
+        m_pPool->Give( pBuffer, m_Size );
+    }
+};
+
 /**class to hold info and a copy of frame data*/
 class tFrameInfo: public BaseFrame
 {
     FrameDataPtr    m_pFrameData;
+    FrameTrace      m_Trace;                    // stage timestamps for the latency statistics
 public:
     /**access to shared data pointer*/
     FrameDataPtr        DataPtr()   const   { return m_pFrameData; }
@@ -247,11 +561,23 @@ public:
     /**access to raw data pointer*/
     VmbUchar_t*         Data()              { return m_pFrameData.data(); }
 
+    /**access to stage timestamps*/
+    const FrameTrace&   Trace()     const   { return m_Trace; }
+    /**access to stage timestamps*/
+    FrameTrace&         Trace()             { return m_Trace; }
+
     /**default constructor*/
     tFrameInfo()
     {}
-    /**copy construct from Vimba frame*/
-    tFrameInfo( const FramePtr& frame, bool color_interpolation );
+    /**copy construct from Vimba frame, the copy is drawn from pPool if given*/
+    tFrameInfo( const FramePtr& frame, bool color_interpolation, const FramePoolPtr &pPool = FramePoolPtr() );
+    /**lease construct from Vimba frame, no data is copied and the frame is re-queued to pCam on release*/
+    tFrameInfo( const FramePtr& frame, bool color_interpolation, const CameraPtr &pCam, const CaptureSessionPtr &pSession );
+    /**construct from frame information and data filled by a source other than Vimba, e.g. SimulatedCamera*/
+    tFrameInfo( const BaseFrame &info, const FrameDataPtr &pData )
+        : BaseFrame( info )
+        , m_pFrameData( pData )
+    {}
 };
 typedef QSharedPointer<tFrameInfo> FrameInfoPtr;    // shared pointer for frame infos
 
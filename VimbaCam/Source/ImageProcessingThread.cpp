@@ -1,144 +1,95 @@
 #include "ImageProcessingThread.h"
 
 #include "VmbImageTransformHelper.hpp"
+#include "PixelUnpack.h"
 
 void ImageProcessingThread::run()
 {
-    FrameData tmpFrameData;
-    while (!m_Stopping
-        && m_FrameQueue.WaitData(tmpFrameData)
-        )
+    while (!m_Stopping)
     {
-        m_imageDataReady = false;
-        if (m_LimitFrameRate)
+        /* scoped to the iteration, a leased frame goes back to the camera as soon as possible */
+        FrameData tmpFrameData;
+        if (!m_FrameQueue.WaitData(tmpFrameData))
         {
-            double currentTime = m_Timer.elapsed();
-            if (m_LastTime.isValid())
-            {
-                const double frameLimit = 33.0; // limit about time for 33 fps
-                const double deltaTime = currentTime - m_LastTime();
-                if (frameLimit > deltaTime)
-                {
-                    continue;
-                }
-                const double newTime = currentTime + (frameLimit - deltaTime);
-                m_LastTime(newTime);
-            }
-            else
-            {
-                m_LastTime(currentTime);
-            }
+            break;
         }
+        tmpFrameData.Trace().Mark(FrameStage_Dequeued);
+        /*every frame is analysed, the display rate is limited by the calculating thread*/
 
         if (NULL != tmpFrameData.GetFrameData()) // unlikely
         {
-            VmbError_t error;
-
-            VmbPixelFormatType outputPixelFormat;
-            if (tmpFrameData.ColorInterpolation())
-            {
-                outputPixelFormat = tmpFrameData.PixelFormat();
-            }
-            else
+            /*the analysis is mono only, bayer raw is taken as mono of the same depth and packed formats are unpacked first*/
+            const VmbPixelFormatType cameraFormat = tmpFrameData.PixelFormat();
+            VmbPixelFormatType monoFormat = mono_format(cameraFormat);
+            if (0 == monoFormat)
             {
-                try
-                {
-                    outputPixelFormat = AVT::GetCompatibleMonoPixelFormatForRaw(tmpFrameData.PixelFormat());
-
-                }
-                catch (...)// lands here if GetCompatibleMonoPixelFromatForRaw throws
-                {
-                    outputPixelFormat = tmpFrameData.PixelFormat();
-                }
+                emit logging("From FrameObserver: " + Helper::convertFormatToString(cameraFormat) + " is neither a mono nor a bayer raw format. Only these are supported now.");
+                countDrop(FrameDrop_Analysis);
+                retireTrace(tmpFrameData.Trace());
+                continue;
             }
-            //error = AVT::VmbImageTransform( convertedImage, tmpFrameData.GetFrameData().data(), tmpFrameData.Width(),  tmpFrameData.Height(), outputPixelFormat );
-
-            /*my custom readout for mono8 and mono12*/
-            QString sFormat = Helper::convertFormatToString(outputPixelFormat);
 
             if (((tmpFrameData.Width() % 4 != 0) || (tmpFrameData.Height() % 2 != 0)))
             {
+                QString sFormat = Helper::convertFormatToString(monoFormat);
                 sFormat.append(" (height" + QString::number(tmpFrameData.Width()) + " or width" + QString::number(tmpFrameData.Height()) + " not supported!)");
                 emit logging("From FrameObserver: " + sFormat + "width is module zero for 4, height is module zero for 2");
+                countDrop(FrameDrop_Analysis);
+                retireTrace(tmpFrameData.Trace());
                 continue;
             }
 
-
-            //QVector<ushort> uint16QVector;
-            //if (0 == sFormat.compare("Mono12"))
-            //{
-            //    ushort* dstDataPtr = reinterpret_cast<ushort*> (tmpFrameData.GetFrameData().data());
-            //    uint16QVector = QVector<ushort>(dstDataPtr, dstDataPtr + tmpFrameData.Height() * tmpFrameData.Width());
-            //}
-            //else if (0 == sFormat.compare("Mono8"))
-            //{
-            //    uint8_t* dstDataPtr = tmpFrameData.GetFrameData().data();
-            //    uint16QVector = QVector<ushort>(dstDataPtr, dstDataPtr + tmpFrameData.Height() * tmpFrameData.Width());
-            //}
-            //else
-            //{
-            //    emit logging("From FrameObserver: " + sFormat + "is neither Mono8 nor Mono12. Only these two are supported now.");
-            //    continue;
-            //}
-
-            QVector<double> doubleQVector;
-            if (0 == sFormat.compare("Mono12"))
+            const uint8_t* srcDataPtr = tmpFrameData.GetFrameData().data();
+            const size_t nPixels = static_cast<size_t>(tmpFrameData.Width()) * tmpFrameData.Height();
+            if (is_packed_format(monoFormat) && tmpFrameData.Size() < packed_size(monoFormat, nPixels))
             {
-                ushort* dstDataPtr = reinterpret_cast<ushort*> (tmpFrameData.GetFrameData().data());
-                doubleQVector = QVector<double>(dstDataPtr, dstDataPtr + tmpFrameData.Height() * tmpFrameData.Width());
+                emit logging("From FrameObserver: " + Helper::convertFormatToString(cameraFormat) + " frame holds fewer pixels than width x height, dropped");
+                countDrop(FrameDrop_Analysis);
+                retireTrace(tmpFrameData.Trace());
+                continue;
             }
-            else if (0 == sFormat.compare("Mono8"))
+            AnalysisFramePtr pFrame = m_FramePool.Acquire();
+            if (is_packed_format(monoFormat))
             {
-                uint8_t* dstDataPtr = tmpFrameData.GetFrameData().data();
-                doubleQVector = QVector<double>(dstDataPtr, dstDataPtr + tmpFrameData.Height() * tmpFrameData.Width());
+                /*unpacked straight into the samples, the 16 bit values are what the analysis works on*/
+                unpack_pixels(monoFormat, srcDataPtr, pFrame->m_Samples.prepare<ushort>(nPixels).data(), nPixels);
+                monoFormat = unpacked_format(monoFormat);
             }
             else
             {
-                emit logging("From FrameObserver: " + sFormat + "is neither Mono8 nor Mono12. Only these two are supported now.");
-                continue;
+                /*samples keep their 8 or 16 bit width, the fit stage widens only what the fitter needs*/
+                convert_mono(monoFormat, srcDataPtr, nPixels, pFrame->m_Samples);
             }
+            pFrame->m_Format = monoFormat;
+            pFrame->m_BitDepth = AVT::GetUsedBits(monoFormat);
 
             //QVector<double> double64QVector(dstDataPtr, dstDataPtr + tmpFrameData.Height() * tmpFrameData.Width());
             //std::vector<ushort> uint16Vector(dstDataPtr, dstDataPtr + tmpFrameData.Height() * tmpFrameData.Width());
             //to initialize a vector with different type, can directly use above two commented
 
+            // send the full bit depth image if requested, then drop our reference, the frame buffer is not needed anymore
+            if (true == tmpFrameData.TransformFullBitDepth())
             {
-                if (!m_Stopping)
-                {
-                    m_imageLock.lock();
-                    m_FrameCount++;
-                    m_FPSCounter.count(m_FrameCount);
-
-                    //m_uint16QVector.swap(uint16QVector); //this does not involve any copy constructor, just switching the pointer hence super fast. After this, the uintQVector is junk and wait for destruction at the end of the loop
-                    m_doubleQVector.swap(doubleQVector);
-                    m_format = sFormat;
-                    m_height = tmpFrameData.Height();
-                    m_width = tmpFrameData.Width();
-                    m_imageDataReady = true;
-                    m_imageCalcWait.wakeOne();
-                    m_imageProcWait.wait(&m_imageLock,2000);
-                    m_doubleQVector.clear();
-                    m_imageLock.unlock();
-
-                    /*emit frameReadyFromThread(uint16Vector, sFormat, QString::number(tmpFrameData.Height()),
-                        QString::number(tmpFrameData.Width()));*/
-
-                    /*emit frameReadyFromThread(uint16QVector, sFormat, QString::number(tmpFrameData.Height()),
-                            QString::number(tmpFrameData.Width()));*/
-
-                    /*emit frameReadyFromThread (convertedImage, sFormat, QString::number (tmpFrameData.Height() ),
-                                                QString::number (tmpFrameData.Width() ));*/
-
-                }
-
+                emit frameReadyFromThreadFullBitDepth(tmpFrameData.FrameInfo());
+            }
+            pFrame->m_Height = tmpFrameData.Height();
+            pFrame->m_Width = tmpFrameData.Width();
+            pFrame->m_Metadata = tmpFrameData.Metadata();
+            pFrame->m_OffsetX = static_cast<int>(pFrame->m_Metadata.m_nOffsetX);
+            pFrame->m_OffsetY = static_cast<int>(pFrame->m_Metadata.m_nOffsetY);
+            tmpFrameData.Trace().Mark(FrameStage_Converted);
+            pFrame->m_Trace = tmpFrameData.Trace();
+            tmpFrameData = FrameData();
+
+            m_FrameCount++;
+            m_FPSCounter.count(m_FrameCount);
+            /*no waiting on the reductions stage, when it falls behind the oldest converted frame is dropped*/
+            m_AnalysisQueue.Enqueue(std::move(pFrame), [this](AnalysisFramePtr& pDropped) { dropFrame(pDropped); });
+            if (!pFrame.isNull())
+            {
+                /*the analysis is stopped*/
+                dropFrame(pFrame);
             }
-        }
-
-
-    // send the full bit depth image if requested
-        if (true == tmpFrameData.TransformFullBitDepth())
-        {
-            emit frameReadyFromThreadFullBitDepth(tmpFrameData.FrameInfo());
         }
     }
 }
\ No newline at end of file
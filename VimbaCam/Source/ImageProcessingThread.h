@@ -3,6 +3,7 @@
 
 #include <QImage>
 #include "Helper.h"
+#include "AnalysisPipeline.h"
 #include <QVector>
 #include <VimbaCPP/Include/Frame.h>
 
@@ -144,6 +145,7 @@ protected:
         tFrameInfo                      m_FrameInfo;
     public:
         FrameData()
+            : m_TransferFullBitDepthImage(false)
         {}
         FrameData(const tFrameInfo& info, bool FullBitDepthImage)
             : m_TransferFullBitDepthImage(FullBitDepthImage)
@@ -157,53 +159,39 @@ protected:
         VmbUint32_t                     Width()                                             const { return m_FrameInfo.Width(); }
         VmbUint32_t                     Height()                                            const { return m_FrameInfo.Height(); }
         VmbUint32_t                     Size()                                              const { return m_FrameInfo.Size(); }
+        FrameTrace&                     Trace()                                                   { return m_FrameInfo.Trace(); }
+        const tFrameMetadata&           Metadata()                                          const { return m_FrameInfo.Metadata(); }
     };
 private:
     ConsumerQueue<FrameData>    m_FrameQueue;
     bool                        m_Stopping;
-    size_t                      m_DroppedFrames;
 
     VmbUint64_t                 m_FrameCount;
     FPSCounter                  m_FPSCounter;
-    timer_type                  m_Timer;
-    bool                        m_LimitFrameRate;
-    ValueWithState<double>      m_LastTime;
 
-    QVector<ushort>             m_uint16QVector;
-    QVector<double>             m_doubleQVector;
-    int                         m_width; //this width and height are used in data transfer to imgCThread
-    int                         m_height;
-    QString                     m_format;
-    bool                        m_imageDataReady;
+    AnalysisFramePool           m_FramePool;        // converted frames, recycled by the last analysis stage
+    ConsumerQueue<AnalysisFramePtr> m_AnalysisQueue; // converted frames waiting for the reductions stage, oldest dropped when full
 
-    QMutex                      m_imageLock;
-    QWaitCondition              m_imageCalcWait;
-    QWaitCondition              m_imageProcWait;
+    FrameLatencyStatsPtr        m_pLatencyStats;
+    FrameDropStatsPtr           m_pDropStats;       // shared with the FrameObserver and the calculating thread
 
 public:
-    QMutex& mutex() { return m_imageLock; }
-    QWaitCondition& calcWait() { return m_imageCalcWait; }
-    QWaitCondition& procWait() { return m_imageProcWait; }
-    QVector<ushort>& uint16Vec() { return m_uint16QVector; }
-    QVector<double>& doubleVec() { return m_doubleQVector; }
-    const int& width() const { return m_width; }
-    const int& height() const { return m_height; }
-    const QString& format() const { return m_format; }
-    const int& frameCount() const { return m_FrameCount; }
-    const bool& dataReady() const { return m_imageDataReady; }
-
-    ImageProcessingThread(size_t MaxFrames = 3)
+    /*converted frames for the reductions stage, started and stopped by its consumer*/
+    ConsumerQueue<AnalysisFramePtr>& analysisQueue() { return m_AnalysisQueue; }
+    AnalysisFramePool& framePool() { return m_FramePool; }
+    const VmbUint64_t& frameCount() const { return m_FrameCount; }
+    /*no frame waiting for conversion or reductions, a feeder that waits for this never makes the queues drop*/
+    bool isIdle() const { return m_FrameQueue.IsEmpty() && m_AnalysisQueue.IsEmpty(); }
+    /*sleep until isIdle, a queue is stopped or ms passed per queue; woken as the consumers take frames. false if not idle*/
+    bool waitIdle(unsigned long ms) { return m_FrameQueue.WaitEmpty(ms) && m_AnalysisQueue.WaitEmpty(ms) && isIdle(); }
+
+    /*queue sizes in frames, both bounded: 0 makes ConsumerQueue throw*/
+    ImageProcessingThread(size_t MaxFrames = 3, size_t MaxAnalysisFrames = 4)
         : m_FrameQueue(MaxFrames)
         , m_Stopping(false)
-        , m_DroppedFrames(0)
         , m_FrameCount(0)
-        , m_LimitFrameRate(false)
-        , m_width(0)
-        , m_height(0)
-        , m_format("")
-        , m_imageDataReady(false)
+        , m_AnalysisQueue(MaxAnalysisFrames)
     {
-        m_Timer.start();
     }
     const FPSCounter& getFPSCounter() const { return m_FPSCounter; }
     ~ImageProcessingThread()
@@ -214,7 +202,6 @@ public:
     {
         if (!m_Stopping)
         {
-            m_LastTime.Invalidate();
             m_Stopping = true;
             m_FrameCount = 0;
             m_FrameQueue.StopProcessing();
@@ -228,15 +215,50 @@ public:
         m_FrameQueue.StartProcessing();
         start();
     }
-    size_t DroppedFrames() const { return m_DroppedFrames; }
+    /*frames this thread dropped: queue overflows and analysis skips*/
+    size_t DroppedFrames() const
+    {
+        if (NULL == m_pDropStats)
+        {
+            return 0;
+        }
+        return m_pDropStats->Drops(FrameDrop_QueueOverflow) + m_pDropStats->Drops(FrameDrop_Analysis);
+    }
 
     void setThreadFrame(const tFrameInfo& FrameInfo, bool FullBitDepthImage)
     {
         FrameData tmpFrameData(FrameInfo, FullBitDepthImage);
-        m_FrameQueue.Enqueue(tmpFrameData);
+        const size_t nDropped = m_FrameQueue.Enqueue(std::move(tmpFrameData));
+        if (0 != nDropped)
+        {
+            countDrop(FrameDrop_QueueOverflow, nDropped);
+        }
     }
-    void LimitFrameRate(bool v) { m_LimitFrameRate = v; }
+    void setLatencyStats(const FrameLatencyStatsPtr& pStats) { m_pLatencyStats = pStats; }
+    void setDropStats(const FrameDropStatsPtr& pStats) { m_pDropStats = pStats; }
 private:
+    void countDrop(FrameDropReason reason, size_t n = 1)
+    {
+        if (NULL != m_pDropStats)
+        {
+            m_pDropStats->Count(reason, n);
+        }
+    }
+    /*record the stages a frame went through when it leaves the pipeline*/
+    void retireTrace(const FrameTrace& trace)
+    {
+        if (NULL != m_pLatencyStats)
+        {
+            m_pLatencyStats->Record(trace);
+        }
+    }
+    /*a converted frame the reductions stage did not take*/
+    void dropFrame(AnalysisFramePtr& pFrame)
+    {
+        countDrop(FrameDrop_Analysis);
+        retireTrace(pFrame->m_Trace);
+        m_FramePool.Recycle(pFrame);
+    }
 
 protected:
     virtual void run();
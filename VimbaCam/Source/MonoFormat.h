@@ -0,0 +1,161 @@
+
+
+#ifndef MONO_FORMAT_H_
+#define MONO_FORMAT_H_
+
+#include <QVector>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include "VmbImageTransformHelper.hpp"
+
+/** the analysis works on mono data only, bayer raw is taken as mono of the same depth and layout.
+* mono_format maps a camera format to that mono format, packed ones stay packed,
+* convert_mono copies an unpacked mono frame at its native sample width with a copy instantiated per format.
+*/
+
+/** storage of one pixel of the unpacked mono formats*/
+template <VmbPixelFormatType FORMAT> struct mono_traits;
+template <> struct mono_traits<VmbPixelFormatMono8>     { typedef VmbUchar_t    pixel_type; };
+template <> struct mono_traits<VmbPixelFormatMono10>    { typedef VmbUint16_t   pixel_type; };
+template <> struct mono_traits<VmbPixelFormatMono12>    { typedef VmbUint16_t   pixel_type; };
+template <> struct mono_traits<VmbPixelFormatMono14>    { typedef VmbUint16_t   pixel_type; };
+template <> struct mono_traits<VmbPixelFormatMono16>    { typedef VmbUint16_t   pixel_type; };
+
+/** mono format the analysis sees for a camera format, 0 if there is none*/
+inline VmbPixelFormatType mono_format( VmbPixelFormatType format )
+{
+    switch( format )
+    {
+    case VmbPixelFormatMono8:
+    case VmbPixelFormatMono10:
+    case VmbPixelFormatMono10p:
+    case VmbPixelFormatMono12:
+    case VmbPixelFormatMono12p:
+    case VmbPixelFormatMono12Packed:
+    case VmbPixelFormatMono14:
+    case VmbPixelFormatMono16:
+        return format;
+    case VmbPixelFormatBayerGR10p:
+    case VmbPixelFormatBayerRG10p:
+    case VmbPixelFormatBayerGB10p:
+    case VmbPixelFormatBayerBG10p:
+        return VmbPixelFormatMono10p;
+    case VmbPixelFormatBayerGR12p:
+    case VmbPixelFormatBayerRG12p:
+    case VmbPixelFormatBayerGB12p:
+    case VmbPixelFormatBayerBG12p:
+        return VmbPixelFormatMono12p;
+    case VmbPixelFormatBayerGR12Packed:
+    case VmbPixelFormatBayerRG12Packed:
+    case VmbPixelFormatBayerGB12Packed:
+    case VmbPixelFormatBayerBG12Packed:
+        return VmbPixelFormatMono12Packed;
+    default:
+        break;
+    }
+    if( !AVT::IsRawPixelFormat( format ) )
+    {
+        return static_cast<VmbPixelFormatType>( 0 );
+    }
+    /* unpacked bayer: 8 bit or lsb aligned in 16 bit */
+    switch( AVT::GetUsedBits( format ) )
+    {
+    case 8:     return VmbPixelFormatMono8;
+    case 10:    return VmbPixelFormatMono10;
+    case 12:    return VmbPixelFormatMono12;
+    case 14:    return VmbPixelFormatMono14;
+    case 16:    return VmbPixelFormatMono16;
+    default:    return static_cast<VmbPixelFormatType>( 0 );
+    }
+}
+
+/** samples of one mono frame at their native width, 8 bit frames in m_uint8, all others in m_uint16.
+* handed between the processing and calculating threads by swap, so the buffers are recycled
+*/
+struct MonoSamples
+{
+    QVector<quint8>     m_uint8;
+    QVector<ushort>     m_uint16;
+    VmbUint32_t         m_bytesPerSample;   // 1 or 2, 0 while empty
+
+    MonoSamples()
+        : m_bytesPerSample( 0 )
+    {}
+    bool    isEmpty() const             { return 0 == m_bytesPerSample; }
+    /**empty, the capacity of both vectors is kept*/
+    void    clear()
+    {
+        m_uint8.resize( 0 );
+        m_uint16.resize( 0 );
+        m_bytesPerSample = 0;
+    }
+    void    swap( MonoSamples &other )
+    {
+        m_uint8.swap( other.m_uint8 );
+        m_uint16.swap( other.m_uint16 );
+        std::swap( m_bytesPerSample, other.m_bytesPerSample );
+    }
+    /**the vector of sample type T, resized to nPixels and marked as the one in use*/
+    template <typename T>
+    QVector<T>& prepare( size_t nPixels );
+    template <typename T>
+    const QVector<T>& samples() const;
+};
+template <> inline const QVector<quint8>& MonoSamples::samples<quint8>() const { return m_uint8; }
+template <> inline const QVector<ushort>& MonoSamples::samples<ushort>() const { return m_uint16; }
+template <> inline QVector<quint8>& MonoSamples::prepare<quint8>( size_t nPixels )
+{
+    m_uint16.resize( 0 );
+    m_uint8.resize( static_cast<int>( nPixels ) );
+    m_bytesPerSample = 1;
+    return m_uint8;
+}
+template <> inline QVector<ushort>& MonoSamples::prepare<ushort>( size_t nPixels )
+{
+    m_uint8.resize( 0 );
+    m_uint16.resize( static_cast<int>( nPixels ) );
+    m_bytesPerSample = 2;
+    return m_uint16;
+}
+
+/** copy nPixels of an unpacked mono FORMAT frame, the samples keep their width*/
+template <VmbPixelFormatType FORMAT>
+inline void convert_mono( const VmbUchar_t *src, size_t nPixels, MonoSamples &dst )
+{
+    typedef typename mono_traits<FORMAT>::pixel_type pixel_type;
+    QVector<pixel_type> &samples = dst.prepare<pixel_type>( nPixels );
+    memcpy( samples.data(), src, nPixels * sizeof( pixel_type ) );
+}
+
+/** copy nPixels of an unpacked mono frame, false if format is none of Mono8/10/12/14/16*/
+inline bool convert_mono( VmbPixelFormatType format, const VmbUchar_t *src, size_t nPixels, MonoSamples &dst )
+{
+    switch( format )
+    {
+    case VmbPixelFormatMono8:   convert_mono<VmbPixelFormatMono8>( src, nPixels, dst );  return true;
+    case VmbPixelFormatMono10:  convert_mono<VmbPixelFormatMono10>( src, nPixels, dst ); return true;
+    case VmbPixelFormatMono12:  convert_mono<VmbPixelFormatMono12>( src, nPixels, dst ); return true;
+    case VmbPixelFormatMono14:  convert_mono<VmbPixelFormatMono14>( src, nPixels, dst ); return true;
+    case VmbPixelFormatMono16:  convert_mono<VmbPixelFormatMono16>( src, nPixels, dst ); return true;
+    default:                    return false;
+    }
+}
+
+/** widen to double, for the consumers that need floating point*/
+inline void widen_samples( const MonoSamples &src, QVector<double> &dst )
+{
+    if( 1 == src.m_bytesPerSample )
+    {
+        dst.resize( src.m_uint8.size() );
+        std::copy( src.m_uint8.constBegin(), src.m_uint8.constEnd(), dst.begin() );
+    }
+    else
+    {
+        dst.resize( src.m_uint16.size() );
+        std::copy( src.m_uint16.constBegin(), src.m_uint16.constEnd(), dst.begin() );
+    }
+}
+
+#endif
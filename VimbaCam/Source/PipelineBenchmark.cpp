@@ -0,0 +1,968 @@
+
+
+#include "PipelineBenchmark.h"
+#include "ReplayCamera.h"
+#include "Version.h"
+#include "UI/ImageCalculatingThread.h"
+#include "Gaussian2DFit.h"
+#include "FitWorkspaceCache.h"
+#include "BeamMoments.h"
+#include "memcpy_threaded.h"
+#include "PixelUnpack.h"
+#include "VmbImageTransformHelper.hpp"
+#include "ExternLib/qcustomplot/qcustomplot.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QTimer>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+namespace
+{
+    /** the mutex and list ConsumerQueue before it became a ring, the reference of QueueSweep*/
+    template <typename DATA_TYPE>
+    class LockedQueue
+    {
+        QList<DATA_TYPE>    m_Data;
+        mutable QMutex      m_Lock;
+        QWaitCondition      m_DataAvailable;
+        bool                m_Stopping;
+        const size_t        m_MaxSize;
+    public:
+        explicit LockedQueue( size_t maxSize )
+            : m_Stopping( false )
+            , m_MaxSize( maxSize )
+        {}
+        void StartProcessing()
+        {
+            QMutexLocker local_lock( &m_Lock );
+            m_Stopping = false;
+        }
+        void StopProcessing()
+        {
+            {
+                QMutexLocker local_lock( &m_Lock );
+                m_Data.clear();
+                m_Stopping = true;
+            }
+            m_DataAvailable.wakeOne();
+        }
+        bool IsEmpty() const
+        {
+            QMutexLocker local_lock( &m_Lock );
+            return m_Data.empty();
+        }
+        void Enqueue( const DATA_TYPE &v )
+        {
+            {
+                QMutexLocker local_lock( &m_Lock );
+                if( m_Stopping )
+                {
+                    return;
+                }
+                if( m_MaxSize != 0 && static_cast<size_t>( m_Data.size() ) == m_MaxSize )
+                {
+                    m_Data.pop_front();
+                }
+                m_Data.push_back( v );
+            }
+            m_DataAvailable.wakeOne();
+        }
+        bool WaitData( DATA_TYPE &v )
+        {
+            QMutexLocker local_lock( &m_Lock );
+            while( !m_Stopping && m_Data.empty() )
+            {
+                m_DataAvailable.wait( local_lock.mutex() );
+            }
+            if( m_Stopping )
+            {
+                return false;
+            }
+            v = m_Data.front();
+            m_Data.pop_front();
+            return true;
+        }
+    };
+
+    /** what the queues carry in QueueSweep, a shared frame buffer as the frame queue does*/
+    struct tQueueItem
+    {
+        quint64         m_nStamp;           // FrameTrace::Now() before the item was enqueued
+        FrameDataPtr    m_pData;
+        tQueueItem() : m_nStamp( 0 ) {}
+    };
+
+    /** one QueueSweep run: the calling thread produces for nRunMs at dRate items/s, 0 unpaced, a pool thread consumes.
+    * the producer spins between items as a camera delivers them, sleeping would measure the timer instead
+    */
+    template <typename QUEUE>
+    void runQueue( QUEUE &queue, double dRate, qint64 nRunMs, LatencyHistogram &latency, quint64 &nSent, quint64 &nEnqueueNs )
+    {
+        nSent       = 0;
+        nEnqueueNs  = 0;
+        latency.Reset();
+        queue.StartProcessing();
+        QFuture<void> consumer = QtConcurrent::run( [&queue, &latency]()
+        {
+            tQueueItem item;
+            while( queue.WaitData( item ) )
+            {
+                latency.Record( FrameTrace::Now() - item.m_nStamp );
+            }
+        } );
+        const FrameDataPtr  pData( new VmbUchar_t[64], DeleteArray<VmbUchar_t> );
+        const quint64       nPeriod = dRate > 0.0 ? static_cast<quint64>( 1.0e9 / dRate ) : 0;
+        const quint64       nStart  = FrameTrace::Now();
+        const quint64       nEnd    = nStart + static_cast<quint64>( nRunMs ) * 1000000;
+        quint64             nNext   = nStart;
+        for( quint64 nNow = nStart; nNow < nEnd; nNow = FrameTrace::Now() )
+        {
+            if( nNow < nNext )
+            {
+                continue;
+            }
+            nNext += nPeriod;
+            tQueueItem item;
+            item.m_pData  = pData;
+            item.m_nStamp = FrameTrace::Now();
+            queue.Enqueue( item );
+            nEnqueueNs += FrameTrace::Now() - item.m_nStamp;
+            ++nSent;
+        }
+        /* the consumer takes what is left, then it is stopped */
+        QElapsedTimer drain;
+        drain.start();
+        while( !queue.IsEmpty() && drain.elapsed() < 100 )
+        {
+            QThread::msleep( 1 );
+        }
+        queue.StopProcessing();
+        consumer.waitForFinished();
+    }
+
+    /** cpu time of the process in s, user and system*/
+    double processCpuTime()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if( !GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) )
+        {
+            return 0.0;
+        }
+        const quint64 nKernel   = ( static_cast<quint64>( kernel.dwHighDateTime ) << 32 ) | kernel.dwLowDateTime;
+        const quint64 nUser     = ( static_cast<quint64>( user.dwHighDateTime ) << 32 ) | user.dwLowDateTime;
+        return ( nKernel + nUser ) * 1.0e-7;
+#else
+        rusage usage;
+        if( 0 != getrusage( RUSAGE_SELF, &usage ) )
+        {
+            return 0.0;
+        }
+        return    usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1.0e-6
+                + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1.0e-6;
+#endif
+    }
+
+    /** peak resident memory of the process in bytes*/
+    quint64 processPeakMemory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+        {
+            return 0;
+        }
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage;
+        if( 0 != getrusage( RUSAGE_SELF, &usage ) )
+        {
+            return 0;
+        }
+        /* kilobytes on linux */
+        return static_cast<quint64>( usage.ru_maxrss ) * 1024;
+#endif
+    }
+
+    /* ImageCalculatingThread addresses the axis rects and plottables by index, so the layout is ViewerWidget's:
+    *  axis rects left 0, centre 1, bottom 2; the centre holds the colormap, the cross hair and the ellipse curve;
+    *  graphs 0 and 1 are the cross sections, 2 and 3 the 1D fits. the plot owns all of them */
+    struct BenchmarkPlot
+    {
+        QSharedPointer<QCustomPlot>     m_pQCP;
+        QSharedPointer<QCPColorMap>     m_pColorMap;
+        QSharedPointer<QCPGraph>        m_pBottomGraph;
+        QSharedPointer<QCPGraph>        m_pLeftGraph;
+
+        BenchmarkPlot()
+            : m_pQCP( new QCustomPlot() )
+        {
+            m_pQCP->resize( 1280, 960 );
+            m_pQCP->plotLayout()->clear();
+            QCPAxisRect *pCenter    = new QCPAxisRect( m_pQCP.data() );
+            QCPAxisRect *pBottom    = new QCPAxisRect( m_pQCP.data() );
+            QCPAxisRect *pLeft      = new QCPAxisRect( m_pQCP.data() );
+            m_pQCP->plotLayout()->addElement( 0, 1, pCenter );
+            m_pQCP->plotLayout()->addElement( 0, 0, pLeft );
+            m_pQCP->plotLayout()->addElement( 1, 1, pBottom );
+            pCenter->setupFullAxesBox( true );
+            pLeft->setupFullAxesBox( false );
+            pBottom->setupFullAxesBox( false );
+            QCPColorScale *pColorScale = new QCPColorScale( m_pQCP.data() );
+            m_pQCP->plotLayout()->addElement( 0, 2, pColorScale );
+
+            const auto notOwned = []( QCPAbstractPlottable* ) {};
+            QCPColorMap *pColorMap = new QCPColorMap( pCenter->axis( QCPAxis::atBottom ), pCenter->axis( QCPAxis::atLeft ) );
+            pColorMap->setColorScale( pColorScale );
+            m_pColorMap     = QSharedPointer<QCPColorMap>( pColorMap, notOwned );
+            m_pBottomGraph  = QSharedPointer<QCPGraph>( new QCPGraph( pBottom->axis( QCPAxis::atTop ), pBottom->axis( QCPAxis::atLeft ) ), notOwned );
+            m_pLeftGraph    = QSharedPointer<QCPGraph>( new QCPGraph( pLeft->axis( QCPAxis::atRight ), pLeft->axis( QCPAxis::atBottom ) ), notOwned );
+            m_pQCP->addGraph( m_pBottomGraph->keyAxis(), m_pBottomGraph->valueAxis() );
+            m_pQCP->addGraph( m_pLeftGraph->keyAxis(), m_pLeftGraph->valueAxis() );
+            new QCPCurve( pColorMap->keyAxis(), pColorMap->valueAxis() );
+            new QCPCurve( pColorMap->keyAxis(), pColorMap->valueAxis() );
+        }
+    };
+}
+
+namespace
+{
+    /** the formats UnpackCheck and UnpackSweep run*/
+    struct tPackedFormat
+    {
+        const char             *m_Name;
+        VmbPixelFormatType      m_Format;
+    };
+    const tPackedFormat PACKED_FORMATS[] =
+    {
+        { "Mono10p",        VmbPixelFormatMono10p },
+        { "Mono12p",        VmbPixelFormatMono12p },
+        { "Mono12Packed",   VmbPixelFormatMono12Packed },
+    };
+    const UnpackKernel UNPACK_KERNELS[] = { UnpackKernel_Scalar, UnpackKernel_SSSE3, UnpackKernel_AVX2 };
+
+    /** nPixels of src as one line of format unpacked to unpacked_format( format ) by VmbImageTransform,
+    * what the viewer did before unpack_pixels
+    */
+    VmbError_t unpackReference( VmbPixelFormatType format, const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels )
+    {
+        VmbImage source;
+        VmbImage destination;
+        source.Size         = sizeof( source );
+        destination.Size    = sizeof( destination );
+        const VmbUint32_t width = static_cast<VmbUint32_t>( nPixels );
+        VmbError_t result = VmbSetImageInfoFromPixelFormat( format, width, 1, &source );
+        if( VmbErrorSuccess == result )
+        {
+            result = VmbSetImageInfoFromPixelFormat( unpacked_format( format ), width, 1, &destination );
+        }
+        if( VmbErrorSuccess != result )
+        {
+            return result;
+        }
+        source.Data         = const_cast<VmbUchar_t*>( src );
+        destination.Data    = dst;
+        return VmbImageTransform( &source, &destination, NULL, 0 );
+    }
+}
+
+PipelineBenchmark::PipelineBenchmark( const tBenchmarkSettings &settings )
+    : m_Settings( settings )
+{
+}
+
+int PipelineBenchmark::Run( QTextStream &out )
+{
+    SP_DECL(FrameObserver) pFrameObs;
+    SP_SET( pFrameObs, new FrameObserver( CameraPtr() ) );
+    BenchmarkPlot plot;
+    QObject::connect( SP_ACCESS( pFrameObs ), &FrameObserver::logging, plot.m_pQCP.data(), [&out]( const QString &sMessage ) { out << sMessage << "\n"; } );
+
+    QSharedPointer<SimulatedCamera> pSimulation;
+    QSharedPointer<ReplayCamera>    pReplay;
+    QString sSource;
+    if( m_Settings.ReplayFile.isEmpty() )
+    {
+        pSimulation = QSharedPointer<SimulatedCamera>( new SimulatedCamera( pFrameObs, m_Settings.Simulation ) );
+        const tSimulationSettings &simulation = m_Settings.Simulation;
+        sSource = QString( "simulated %1 x %2, format 0x%3, %4 spot(s)" )
+                  .arg( simulation.Width ).arg( simulation.Height )
+                  .arg( simulation.PixelFormat, 8, 16, QChar( '0' ) ).arg( simulation.SpotCount );
+    }
+    else
+    {
+        QString sError;
+        pReplay = QSharedPointer<ReplayCamera>( new ReplayCamera( pFrameObs ) );
+        if( !pReplay->Load( m_Settings.ReplayFile, m_Settings.ReplayMaxBytes, sError ) )
+        {
+            out << "ERROR " << sError << "\n";
+            return 1;
+        }
+        pReplay->setFrameRate( m_Settings.Simulation.FrameRate );
+        sSource = QString( "replay of %1, %2 frames" ).arg( m_Settings.ReplayFile ).arg( pReplay->frames() );
+    }
+
+    ImageCalculatingThread calculating( pFrameObs, CameraPtr(), plot.m_pQCP, plot.m_pColorMap, plot.m_pBottomGraph, plot.m_pLeftGraph );
+    calculating.toggleDoFitting( m_Settings.Fit1D );
+    calculating.toggleDoFitting2D( m_Settings.Fit2D );
+    calculating.toggleWarmStart( m_Settings.WarmStart );
+    QObject::connect( &calculating, &ImageCalculatingThread::logging, plot.m_pQCP.data(), [&out]( const QString &sMessage ) { out << sMessage << "\n"; } );
+    /* the viewer's part of a plot update, queued to this thread */
+    const bool bReplot = m_Settings.Replot;
+    QObject::connect( &calculating, &ImageCalculatingThread::imageReadyForPlot, plot.m_pQCP.data(), [&calculating, &plot, bReplot]()
+        {
+            calculating.mutex().lock();
+            if( bReplot )
+            {
+                plot.m_pColorMap->rescaleDataRange( true );
+                plot.m_pQCP->replot();
+            }
+            FrameTrace trace = calculating.takePlotTrace();
+            trace.Mark( FrameStage_Plotted );
+            calculating.mutex().unlock();
+            calculating.latencyStats()->Record( trace );
+        } );
+
+    const FrameLatencyStatsPtr& pLatency    = SP_ACCESS( pFrameObs )->latencyStats();
+    const FrameDropStatsPtr&    pDrops      = SP_ACCESS( pFrameObs )->dropStats();
+    SP_ACCESS( pFrameObs )->Starting();
+    calculating.StartProcessing();
+    !pSimulation.isNull() ? pSimulation->StartCapture() : pReplay->StartCapture();
+    const auto delivered = [&pSimulation, &pReplay]() { return !pSimulation.isNull() ? pSimulation->frameCount() : pReplay->frameCount(); };
+
+    /* the counters are reset while frames are in flight, a few frames around the reset are off by a stage */
+    QEventLoop      loop;
+    QElapsedTimer   wall;
+    VmbUint64_t     nDeliveredStart = 0;
+    double          dCpuStart       = 0.0;
+    FitWorkspaceCache::Counters workspacesStart = FitWorkspaceCache::counters();
+    QTimer::singleShot( static_cast<int>( m_Settings.Warmup * 1000.0 ), [&]()
+        {
+            pLatency->Reset();
+            pDrops->Reset();
+            nDeliveredStart = delivered();
+            dCpuStart       = processCpuTime();
+            workspacesStart = FitWorkspaceCache::counters();
+            wall.start();
+            QTimer::singleShot( static_cast<int>( m_Settings.Duration * 1000.0 ), &loop, &QEventLoop::quit );
+        } );
+    loop.exec();
+
+    const double        dSeconds    = wall.nsecsElapsed() * 1.0e-9;
+    const double        dCpu        = processCpuTime() - dCpuStart;
+    const VmbUint64_t   nDelivered  = delivered() - nDeliveredStart;
+    const quint64       nReceived   = pDrops->Received();
+    const quint64       nAnalysed   = pLatency->Stage( FrameStage_Fitted ).Count();
+    const quint64       nPlotted    = pLatency->Stage( FrameStage_Plotted ).Count();
+    const QString       sDrops      = pDrops->Summary();
+    const QString       sLatency    = pLatency->Report();
+    const FitWorkspaceCache::Counters workspaces = FitWorkspaceCache::counters();
+
+    !pSimulation.isNull() ? pSimulation->StopCapture() : pReplay->StopCapture();
+    SP_ACCESS( pFrameObs )->Stopping();
+    calculating.StopProcessing();
+    QCoreApplication::processEvents();
+
+    QString sReport;
+    QTextStream report( &sReport );
+    report  << "Vimba JILA Viewer " << VIMBAVIEWER_VERSION << " pipeline benchmark\n"
+            << "Source:     " << sSource << "\n"
+            << "Rate:       " << ( m_Settings.Simulation.FrameRate > 0.0 ? QString( "%1 fps" ).arg( m_Settings.Simulation.FrameRate ) : QString( "max" ) ) << "\n"
+            << "Analysis:   " << ( m_Settings.Fit1D ? "1D fit " : "" ) << ( m_Settings.Fit2D ? "2D fit " : "" )
+                              << ( m_Settings.Fit1D || m_Settings.Fit2D ? ( m_Settings.WarmStart ? "warm started " : "cold started " ) : "" )
+                              << ( m_Settings.Replot ? "replot" : "no replot" ) << "\n"
+            << "Measured:   " << QString::number( dSeconds, 'f', 2 ) << " s after " << m_Settings.Warmup << " s warmup\n"
+            << "Delivered:  " << nDelivered << " frames, " << QString::number( nDelivered / dSeconds, 'f', 1 ) << " fps\n"
+            << "Received:   " << nReceived << " frames, " << QString::number( nReceived / dSeconds, 'f', 1 ) << " fps\n"
+            << "Analysed:   " << nAnalysed << " frames, " << QString::number( nAnalysed / dSeconds, 'f', 1 ) << " fps\n"
+            << "Plotted:    " << nPlotted << " frames, " << QString::number( nPlotted / dSeconds, 'f', 1 ) << " fps\n"
+            << "Drops:      " << sDrops << "\n"
+            << "Workspaces: " << workspaces.allocated - workspacesStart.allocated << " fit workspaces allocated, "
+                              << workspaces.reused - workspacesStart.reused << " reused, " << workspaces.idle << " idle\n"
+            << "CPU:        " << QString::number( dCpu, 'f', 2 ) << " s, " << QString::number( 100.0 * dCpu / dSeconds, 'f', 0 ) << " % of one core\n"
+            << "Peak RSS:   " << QString::number( processPeakMemory() / 1048576.0, 'f', 1 ) << " MB\n"
+            << "\n" << sLatency;
+    report.flush();
+
+    out << sReport;
+    out.flush();
+    if( !m_Settings.ReportFile.isEmpty() )
+    {
+        QFile file( m_Settings.ReportFile );
+        if( !file.open( QIODevice::WriteOnly | QIODevice::Text ) || -1 == file.write( sReport.toUtf8() ) )
+        {
+            out << "ERROR could not write " << m_Settings.ReportFile << "\n";
+            return 1;
+        }
+    }
+    return 0 == nAnalysed ? 1 : 0;
+}
+
+int PipelineBenchmark::FitSweep( QTextStream &out )
+{
+    struct tEvaluation
+    {
+        const char     *m_Name;
+        bool            m_bSimd;
+        bool            m_bThreads;
+    };
+    const tEvaluation evaluations[] =
+    {
+        { "scalar",         false,  false },
+        { "simd",           true,   false },
+        { "simd+threads",   true,   true },
+    };
+
+    out << "Vimba JILA Viewer " << VIMBAVIEWER_VERSION << " 2D fit benchmark\n"
+        << "Exp kernel: " << Gaussian2DFit::expKernelName() << ", moment kernel: " << beam_moments_kernel_name() << ", "
+        << QThreadPool::globalInstance()->maxThreadCount() << " threads\n"
+        << "size        pixels      mode            iterations  total ms    ms/iteration\n";
+    out.flush();
+    /* the moments take well under a millisecond, each is timed over as many runs as fit into MOMENT_RUNS_MS */
+    const qint64 MOMENT_RUNS_MS = 200;
+    QString sMoments;
+
+    /* a tilted beam over a quarter of the frame with 1 % noise, the fit starts from the peak and the frame size,
+    *  the viewer's guess without a beam above the noise, then once more from the beam's moments */
+    std::mt19937 random( 1 );
+    std::normal_distribution<double> noise( 0.0, 10.0 );
+    int nResult = 0;
+    for( int nSize = 64; nSize <= 2048; nSize *= 2 )
+    {
+        const size_t nPixels = static_cast<size_t>( nSize ) * nSize;
+        std::vector<double> keys( nSize );
+        for( int i = 0; i < nSize; ++i )
+        {
+            keys[i] = i;
+        }
+        const double dCenter    = 0.45 * nSize;
+        const double a          = 1.0 / ( 0.02 * nSize * nSize );
+        const double b          = 0.3 * a;
+        const double c          = 0.6 * a;
+        std::vector<double> z( nPixels );
+        for( int y = 0; y < nSize; ++y )
+        {
+            for( int x = 0; x < nSize; ++x )
+            {
+                z[y * nSize + x] = Gaussian2DFit::gaussian2d( 1000.0, dCenter, dCenter, a, b, c, 50.0, x, y ) + noise( random );
+            }
+        }
+        MonoSamples samples;
+        samples.m_bytesPerSample = 2;
+        samples.m_uint16.resize( static_cast<int>( nPixels ) );
+        for( size_t i = 0; i < nPixels; ++i )
+        {
+            samples.m_uint16[static_cast<int>( i )] = static_cast<ushort>( std::max( 0.0, std::round( z[i] ) ) );
+        }
+        const auto zmax = std::max_element( z.begin(), z.end() );
+        const double x00 = static_cast<double>( ( zmax - z.begin() ) % nSize );
+        const double y00 = static_cast<double>( ( zmax - z.begin() ) / nSize );
+        const double dInitialSize = 1.0 / ( 0.25 * nSize * nSize );
+        Gaussian2DFit fit( nPixels, nSize, nSize, keys.data(), keys.data(), z.data(),
+                           *zmax - 50.0, x00, y00, dInitialSize, 0.1 * dInitialSize, dInitialSize, 50.0 );
+        /* no time budget, every mode runs the same iterations */
+        fit.setBudget( 0, 200 );
+        for( const tEvaluation &evaluation : evaluations )
+        {
+            fit.setEvaluation( evaluation.m_bSimd, evaluation.m_bThreads );
+            QElapsedTimer timer;
+            timer.start();
+            fit.solve_system();
+            const double    dMs         = timer.nsecsElapsed() * 1.0e-6;
+            const size_t    nIterations = fit.getIterations();
+            out << QString( "%1" ).arg( QString( "%1 x %1" ).arg( nSize ), -12 )
+                << QString( "%1" ).arg( nPixels, -12 )
+                << QString( "%1" ).arg( evaluation.m_Name, -16 )
+                << QString( "%1" ).arg( nIterations, -12 )
+                << QString( "%1" ).arg( dMs, -12, 'f', 1 )
+                << ( nIterations > 0 ? QString::number( dMs / nIterations, 'f', 3 ) : QString( "-" ) )
+                << ( dMs > Gaussian2DFit::defaultBudgetMs ? "  (over the viewer's time budget)" : "" ) << "\n";
+            out.flush();
+            if( 0 == nIterations )
+            {
+                nResult = 1;
+            }
+
+            tMomentSettings momentSettings;
+            momentSettings.Simd     = evaluation.m_bSimd;
+            momentSettings.Threads  = evaluation.m_bThreads;
+            tBeamMoments moments;
+            int nRuns = 0;
+            timer.start();
+            do
+            {
+                moments = beam_moments( samples, nSize, nSize, 0, 0, momentSettings );
+                ++nRuns;
+            }
+            while( timer.elapsed() < MOMENT_RUNS_MS );
+            const double dMomentMs = timer.nsecsElapsed() * 1.0e-6 / nRuns;
+            sMoments += QString( "%1" ).arg( QString( "%1 x %1" ).arg( nSize ), -12 )
+                     +  QString( "%1" ).arg( nPixels, -12 )
+                     +  QString( "%1" ).arg( evaluation.m_Name, -16 )
+                     +  QString( "%1" ).arg( moments.m_nIterations, -8 )
+                     +  QString( "%1" ).arg( dMomentMs, -12, 'f', 3 )
+                     +  QString( "%1" ).arg( dMomentMs * 1.0e6 / nPixels, -12, 'f', 3 )
+                     +  QString( "%1 x %2" ).arg( moments.m_dMajor, 0, 'f', 1 ).arg( moments.m_dMinor, 0, 'f', 1 )
+                     +  ( moments.m_bConverged ? "" : "  (not converged)" ) + "\n";
+            if( !moments.m_bValid )
+            {
+                nResult = 1;
+            }
+        }
+        /* the viewer's cold start, the gaussian with the beam's moments */
+        QVector<double> seed;
+        if( beam_moments_gaussian( beam_moments( samples, nSize, nSize, 0, 0 ), seed ) )
+        {
+            fit.setEvaluation( true, true );
+            fit.set_initialP( seed );
+            QElapsedTimer timer;
+            timer.start();
+            fit.solve_system();
+            const double    dMs         = timer.nsecsElapsed() * 1.0e-6;
+            const size_t    nIterations = fit.getIterations();
+            out << QString( "%1" ).arg( QString( "%1 x %1" ).arg( nSize ), -12 )
+                << QString( "%1" ).arg( nPixels, -12 )
+                << QString( "%1" ).arg( "moment seed", -16 )
+                << QString( "%1" ).arg( nIterations, -12 )
+                << QString( "%1" ).arg( dMs, -12, 'f', 1 )
+                << ( nIterations > 0 ? QString::number( dMs / nIterations, 'f', 3 ) : QString( "-" ) ) << "\n";
+            out.flush();
+        }
+    }
+    out << "\nISO 11146 second moments\n"
+        << "size        pixels      mode            passes  ms          ms/Mpixel   D4sigma major x minor\n"
+        << sMoments;
+    return nResult;
+}
+
+int PipelineBenchmark::QueueSweep( QTextStream &out )
+{
+    /* the size of the processing queue, the one the frame callback feeds */
+    const size_t    QUEUE_SIZE  = 3;
+    const qint64    RUN_MS      = 1000;
+    const double    rates[]     = { 1000.0, 10000.0, 0.0 };
+
+    out << "Vimba JILA Viewer " << VIMBAVIEWER_VERSION << " frame queue benchmark, " << QUEUE_SIZE << " slots, "
+        << RUN_MS << " ms per run\n"
+        << "queue       items/s     sent        delivered   enqueue ns  handoff us p50 / p99 / max\n";
+    out.flush();
+    int nResult = 0;
+    LatencyHistogram latency;
+    for( const double dRate : rates )
+    {
+        for( int nQueue = 0; nQueue < 2; ++nQueue )
+        {
+            quint64 nSent       = 0;
+            quint64 nEnqueueNs  = 0;
+            if( 0 == nQueue )
+            {
+                LockedQueue<tQueueItem> queue( QUEUE_SIZE );
+                runQueue( queue, dRate, RUN_MS, latency, nSent, nEnqueueNs );
+            }
+            else
+            {
+                ConsumerQueue<tQueueItem> queue( QUEUE_SIZE );
+                runQueue( queue, dRate, RUN_MS, latency, nSent, nEnqueueNs );
+            }
+            out << QString( "%1" ).arg( 0 == nQueue ? "mutex+list" : "ring", -12 )
+                << QString( "%1" ).arg( dRate > 0.0 ? QString::number( dRate, 'f', 0 ) : QString( "unpaced" ), -12 )
+                << QString( "%1" ).arg( nSent, -12 )
+                << QString( "%1" ).arg( latency.Count(), -12 )
+                << QString( "%1" ).arg( nSent > 0 ? static_cast<double>( nEnqueueNs ) / nSent : 0.0, -12, 'f', 0 )
+                << QString( "%1 / %2 / %3" ).arg( latency.Percentile( 0.5 ), 0, 'f', 1 ).arg( latency.Percentile( 0.99 ), 0, 'f', 1 )
+                                            .arg( latency.Max(), 0, 'f', 1 ) << "\n";
+            out.flush();
+            if( 0 == latency.Count() )
+            {
+                nResult = 1;
+            }
+        }
+    }
+    return nResult;
+}
+
+int PipelineBenchmark::CopySweep( QTextStream &out )
+{
+    const size_t    MB      = 1024 * 1024;
+    const size_t    sizes[] = { 1, 2, 4, 8, 12, 16, 24, 32, 50 };
+    const int       RUNS    = 5;
+
+    out << "Vimba JILA Viewer " << VIMBAVIEWER_VERSION << " frame copy benchmark, best of " << RUNS << " runs\n";
+    out.flush();
+    CopyThreadPool &copyPool = CopyThreadPool::Instance();
+    copyPool.waitCalibrated();
+    out << "copy pool: " << copyPool.threadCount() << " thread(s), split above "
+        << ( copyPool.threadCount() > 1 ? QString::number( copyPool.splitThreshold() / static_cast<double>( MB ), 'f', 2 ) : QString( "-" ) )
+        << " MB, streaming stores " << ( copyPool.useStreaming() ? "on" : "off" ) << "\n"
+        << "MB          memcpy GB/s stream GB/s threaded GB/s  speedup\n";
+    /* touched once, so page faults do not count */
+    std::vector<char> src( sizes[sizeof( sizes ) / sizeof( sizes[0] ) - 1] * MB );
+    std::vector<char> dst( src.size(), 0 );
+    for( size_t i = 0; i < src.size(); ++i )
+    {
+        src[i] = static_cast<char>( i * 31 );
+    }
+    int nResult = 0;
+    for( const size_t nMB : sizes )
+    {
+        const size_t len = nMB * MB;
+        const auto bandwidth = [&]( void ( *copy )( void*, const void*, size_t ) )
+        {
+            qint64 nBestNs = std::numeric_limits<qint64>::max();
+            for( int run = 0; run < RUNS; ++run )
+            {
+                QElapsedTimer timer;
+                timer.start();
+                copy( dst.data(), src.data(), len );
+                nBestNs = std::min( nBestNs, std::max<qint64>( 1, timer.nsecsElapsed() ) );
+            }
+            if( 0 != memcmp( dst.data(), src.data(), len ) )
+            {
+                nResult = 1;
+            }
+            std::memset( dst.data(), 0, len );
+            return static_cast<double>( len ) / nBestNs;
+        };
+        const double dMemcpy    = bandwidth( []( void *d, const void *s, size_t n ) { std::memcpy( d, s, n ); } );
+        const double dStream    = bandwidth( &stream_copy );
+        const double dThreaded  = bandwidth( []( void *d, const void *s, size_t n ) { memcpy_threaded( d, s, n ); } );
+        out << QString( "%1" ).arg( nMB, -12 )
+            << QString( "%1" ).arg( dMemcpy, -12, 'f', 2 )
+            << QString( "%1" ).arg( dStream, -12, 'f', 2 )
+            << QString( "%1" ).arg( dThreaded, -15, 'f', 2 )
+            << QString( "%1" ).arg( dThreaded / dMemcpy, 0, 'f', 2 ) << "\n";
+        out.flush();
+    }
+    if( 0 != nResult )
+    {
+        out << "ERROR a copy differs from its source\n";
+    }
+    return nResult;
+}
+
+int PipelineBenchmark::UnpackCheck( QTextStream &out )
+{
+    /* every tail length of the 8 pixel groups and of the 32 pixel AVX2 loads, then whole frames */
+    std::vector<size_t> pixelCounts;
+    for( size_t n = 1; n <= 70; ++n )
+    {
+        pixelCounts.push_back( n );
+    }
+    const size_t frames[] = { 1021, 4096, 65537, 640 * 480, 1920 * 1080 + 7 };
+    pixelCounts.insert( pixelCounts.end(), frames, frames + sizeof( frames ) / sizeof( frames[0] ) );
+    const int           SEEDS   = 4;
+    const VmbUint16_t   CANARY  = 0xbeef;
+
+    out << "Vimba JILA Viewer " << VIMBAVIEWER_VERSION << " unpack check, kernel of this cpu: " << unpack_kernel_name( unpack_kernel() ) << "\n"
+        << pixelCounts.size() << " sizes from 1 to " << pixelCounts.back() << " pixels, " << SEEDS
+        << " random buffers each, aligned and one byte off\n"
+        << "format          kernel      cases       mismatches  first mismatch\n";
+    out.flush();
+    int nResult = 0;
+    std::mt19937 random( 11146 );
+    for( const tPackedFormat &packed : PACKED_FORMATS )
+    {
+        quint64 nCases      [sizeof( UNPACK_KERNELS ) / sizeof( UNPACK_KERNELS[0] )] = {};
+        quint64 nMismatches [sizeof( UNPACK_KERNELS ) / sizeof( UNPACK_KERNELS[0] )] = {};
+        QString sFirst      [sizeof( UNPACK_KERNELS ) / sizeof( UNPACK_KERNELS[0] )];
+        quint64 nReferenceErrors = 0;
+        VmbError_t firstError = VmbErrorSuccess;
+        for( const size_t nPixels : pixelCounts )
+        {
+            const size_t nBytes = packed_size( packed.m_Format, nPixels );
+            for( int seed = 0; seed < SEEDS; ++seed )
+            {
+                for( size_t offset = 0; offset < 2; ++offset )
+                {
+                    std::vector<VmbUchar_t> src( nBytes + offset );
+                    for( VmbUchar_t &byte : src )
+                    {
+                        byte = static_cast<VmbUchar_t>( random() );
+                    }
+                    /* one more than the pixels, a kernel writing past its tail overwrites the canary */
+                    std::vector<VmbUint16_t> reference( nPixels + 1, CANARY );
+                    const VmbError_t error = unpackReference( packed.m_Format, src.data() + offset, reference.data(), nPixels );
+                    if( VmbErrorSuccess != error )
+                    {
+                        if( 0 == nReferenceErrors++ )
+                        {
+                            firstError = error;
+                        }
+                        continue;
+                    }
+                    for( size_t k = 0; k < sizeof( UNPACK_KERNELS ) / sizeof( UNPACK_KERNELS[0] ); ++k )
+                    {
+                        if( UNPACK_KERNELS[k] > unpack_kernel() )
+                        {
+                            continue;
+                        }
+                        std::vector<VmbUint16_t> unpacked( nPixels + 1, CANARY );
+                        unpack_pixels( packed.m_Format, src.data() + offset, unpacked.data(), nPixels, UNPACK_KERNELS[k] );
+                        ++nCases[k];
+                        const auto mismatch = std::mismatch( unpacked.begin(), unpacked.end(), reference.begin() );
+                        if( mismatch.first != unpacked.end() )
+                        {
+                            if( 0 == nMismatches[k]++ )
+                            {
+                                const size_t nAt = mismatch.first - unpacked.begin();
+                                sFirst[k] = QString( "%1 px, offset %2: pixel %3 is %4, expected %5" )
+                                    .arg( nPixels ).arg( offset ).arg( nAt ).arg( *mismatch.first ).arg( *mismatch.second );
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        if( 0 != nReferenceErrors )
+        {
+            out << QString( "%1" ).arg( packed.m_Name, -16 ) << "ERROR VmbImageTransform failed on " << nReferenceErrors
+                << " buffers, first with " << firstError << "\n";
+            nResult = 1;
+        }
+        for( size_t k = 0; k < sizeof( UNPACK_KERNELS ) / sizeof( UNPACK_KERNELS[0] ); ++k )
+        {
+            out << QString( "%1" ).arg( packed.m_Name, -16 ) << QString( "%1" ).arg( unpack_kernel_name( UNPACK_KERNELS[k] ), -12 );
+            if( UNPACK_KERNELS[k] > unpack_kernel() )
+            {
+                out << "not supported by this cpu\n";
+                continue;
+            }
+            out << QString( "%1" ).arg( nCases[k], -12 ) << QString( "%1" ).arg( nMismatches[k], -12 ) << sFirst[k] << "\n";
+            if( 0 != nMismatches[k] )
+            {
+                nResult = 1;
+            }
+        }
+        out.flush();
+    }
+    return nResult;
+}
+
+int PipelineBenchmark::UnpackSweep( QTextStream &out )
+{
+    struct tFrameSize
+    {
+        int             m_Width;
+        int             m_Height;
+    };
+    const tFrameSize    sizes[] = { { 640, 480 }, { 2048, 2048 }, { 5472, 3648 } };
+    const int           RUNS    = 5;
+
+    out << "Vimba JILA Viewer " << VIMBAVIEWER_VERSION << " unpack benchmark, best of " << RUNS << " runs\n"
+        << "format          size        kernel          Mpixel/s    packed GB/s\n";
+    out.flush();
+    int nResult = 0;
+    std::mt19937 random( 11146 );
+    for( const tPackedFormat &packed : PACKED_FORMATS )
+    {
+        for( const tFrameSize &size : sizes )
+        {
+            const size_t nPixels    = static_cast<size_t>( size.m_Width ) * size.m_Height;
+            const size_t nBytes     = packed_size( packed.m_Format, nPixels );
+            std::vector<VmbUchar_t> src( nBytes );
+            for( VmbUchar_t &byte : src )
+            {
+                byte = static_cast<VmbUchar_t>( random() );
+            }
+            /* touched once, so page faults do not count */
+            std::vector<VmbUint16_t> dst( nPixels, 0 );
+            const auto report = [&]( const char *pName, qint64 nBestNs )
+            {
+                out << QString( "%1" ).arg( packed.m_Name, -16 )
+                    << QString( "%1x%2" ).arg( size.m_Width ).arg( size.m_Height ).leftJustified( 12 )
+                    << QString( "%1" ).arg( pName, -16 )
+                    << QString( "%1" ).arg( nPixels * 1000.0 / nBestNs, -12, 'f', 0 )
+                    << QString( "%1" ).arg( static_cast<double>( nBytes ) / nBestNs, 0, 'f', 2 ) << "\n";
+                out.flush();
+            };
+            for( const UnpackKernel kernel : UNPACK_KERNELS )
+            {
+                if( kernel > unpack_kernel() )
+                {
+                    continue;
+                }
+                qint64 nBestNs = std::numeric_limits<qint64>::max();
+                for( int run = 0; run < RUNS; ++run )
+                {
+                    QElapsedTimer timer;
+                    timer.start();
+                    unpack_pixels( packed.m_Format, src.data(), dst.data(), nPixels, kernel );
+                    nBestNs = std::min( nBestNs, std::max<qint64>( 1, timer.nsecsElapsed() ) );
+                }
+                report( unpack_kernel_name( kernel ), nBestNs );
+            }
+            qint64 nBestNs = std::numeric_limits<qint64>::max();
+            VmbError_t error = VmbErrorSuccess;
+            for( int run = 0; run < RUNS && VmbErrorSuccess == error; ++run )
+            {
+                QElapsedTimer timer;
+                timer.start();
+                error = unpackReference( packed.m_Format, src.data(), dst.data(), nPixels );
+                nBestNs = std::min( nBestNs, std::max<qint64>( 1, timer.nsecsElapsed() ) );
+            }
+            if( VmbErrorSuccess != error )
+            {
+                out << "ERROR VmbImageTransform failed with " << error << "\n";
+                nResult = 1;
+            }
+            else
+            {
+                report( "VmbImageTransform", nBestNs );
+            }
+        }
+    }
+    return nResult;
+}
+
+bool PipelineBenchmark::IsRequested( int argc, char *argv[] )
+{
+    for( int i = 1; i < argc; ++i )
+    {
+        if( 0 == strcmp( argv[i], "--benchmark" ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int PipelineBenchmark::Main( int argc, char *argv[] )
+{
+#ifndef _WIN32
+    /* no display on a build machine, the plot is never shown */
+    if( qEnvironmentVariableIsEmpty( "QT_QPA_PLATFORM" ) )
+    {
+        qputenv( "QT_QPA_PLATFORM", "offscreen" );
+    }
+#else
+    /* started from the viewer exe, which has no console: the report goes to the console it was started from or to
+    *  a new one, output redirected to a file stays where it is. VimbaCamBenchmark is the console build */
+    if( FILE_TYPE_UNKNOWN == GetFileType( GetStdHandle( STD_OUTPUT_HANDLE ) )
+        && ( AttachConsole( ATTACH_PARENT_PROCESS ) || AllocConsole() ) )
+    {
+        FILE *pConsole = NULL;
+        freopen_s( &pConsole, "CONOUT$", "w", stdout );
+        freopen_s( &pConsole, "CONOUT$", "w", stderr );
+    }
+#endif
+    QApplication a( argc, argv );
+    a.setApplicationName( "Vimba JILA Viewer" );
+    a.setApplicationVersion( VIMBAVIEWER_VERSION );
+
+    tBenchmarkSettings settings;
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Runs the processing pipeline on synthetic or recorded frames without camera and viewer." );
+    parser.addHelpOption();
+    const QCommandLineOption benchmark  ( "benchmark",   "Run the pipeline benchmark instead of the viewer." );
+    const QCommandLineOption replay     ( "replay",      "Play the frames of a raw recording instead of synthetic frames.", "file" );
+    const QCommandLineOption replayMB   ( "replay-mb",   "Frame data loaded from the recording.", "MB", QString::number( settings.ReplayMaxBytes >> 20 ) );
+    const QCommandLineOption width      ( "width",       "Synthetic frame width.", "pixels", QString::number( settings.Simulation.Width ) );
+    const QCommandLineOption height     ( "height",      "Synthetic frame height.", "pixels", QString::number( settings.Simulation.Height ) );
+    const QCommandLineOption format     ( "format",      "Synthetic pixel format: mono8, mono12 or mono16.", "format", "mono12" );
+    const QCommandLineOption spots      ( "spots",       "Synthetic beams per frame.", "count", QString::number( settings.Simulation.SpotCount ) );
+    const QCommandLineOption rate       ( "rate",        "Frames per second, 0 generates flat out and the pipeline drops what it cannot keep up with.", "fps", "0" );
+    const QCommandLineOption warmup     ( "warmup",      "Seconds before the measurement starts.", "s", QString::number( settings.Warmup ) );
+    const QCommandLineOption duration   ( "duration",    "Seconds measured.", "s", QString::number( settings.Duration ) );
+    const QCommandLineOption noFit      ( "no-fit",      "Skip the 1D gaussian fits." );
+    const QCommandLineOption fit2D      ( "fit2d",       "Run the 2D gaussian fit." );
+    const QCommandLineOption coldFits   ( "cold-fits",   "Start every fit from a guess from the frame instead of the last converged parameters." );
+    const QCommandLineOption replot     ( "replot",      "Replot an offscreen plot on every plot update." );
+    const QCommandLineOption fitSweep   ( "fit-sweep",   "Time the 2D gaussian fit per iteration over image sizes instead of running the pipeline." );
+    const QCommandLineOption queueSweep ( "queue-sweep", "Time the frame queue handoff against the mutex queue it replaced instead of running the pipeline." );
+    const QCommandLineOption copySweep  ( "copy-sweep",  "Time the threaded frame copy against memcpy from 1 to 50 MB instead of running the pipeline." );
+    const QCommandLineOption unpackCheck( "unpack-check", "Compare every unpack kernel against VmbImageTransform on random packed data instead of running the pipeline." );
+    const QCommandLineOption unpackSweep( "unpack-sweep", "Time every unpack kernel and VmbImageTransform over frame sizes instead of running the pipeline." );
+    const QCommandLineOption reportFile ( "report",      "Also write the report to a file.", "file" );
+    parser.addOptions( { benchmark, replay, replayMB, width, height, format, spots, rate, warmup, duration, noFit, fit2D, coldFits, replot, fitSweep, queueSweep, copySweep, unpackCheck, unpackSweep, reportFile } );
+    parser.process( a );
+
+    settings.ReplayFile                 = parser.value( replay );
+    settings.ReplayMaxBytes             = parser.value( replayMB ).toULongLong() << 20;
+    settings.Simulation.Width           = parser.value( width ).toUInt();
+    settings.Simulation.Height          = parser.value( height ).toUInt();
+    settings.Simulation.SpotCount       = parser.value( spots ).toInt();
+    settings.Simulation.FrameRate       = parser.value( rate ).toDouble();
+    settings.Warmup                     = parser.value( warmup ).toDouble();
+    settings.Duration                   = parser.value( duration ).toDouble();
+    settings.Fit1D                      = !parser.isSet( noFit );
+    settings.Fit2D                      = parser.isSet( fit2D );
+    settings.WarmStart                  = !parser.isSet( coldFits );
+    settings.Replot                     = parser.isSet( replot );
+    settings.FitSweep                   = parser.isSet( fitSweep );
+    settings.QueueSweep                 = parser.isSet( queueSweep );
+    settings.CopySweep                  = parser.isSet( copySweep );
+    settings.UnpackCheck                = parser.isSet( unpackCheck );
+    settings.UnpackSweep                = parser.isSet( unpackSweep );
+    settings.ReportFile                 = parser.value( reportFile );
+    const QString sFormat = parser.value( format ).toLower();
+    if( "mono8" == sFormat )
+    {
+        settings.Simulation.PixelFormat = VmbPixelFormatMono8;
+    }
+    else if( "mono16" == sFormat )
+    {
+        settings.Simulation.PixelFormat = VmbPixelFormatMono16;
+    }
+    else if( "mono12" == sFormat )
+    {
+        settings.Simulation.PixelFormat = VmbPixelFormatMono12;
+    }
+    else
+    {
+        parser.showHelp( 1 );
+    }
+    if( 0 == settings.Simulation.Width || 0 == settings.Simulation.Height || settings.Duration <= 0.0 || settings.Warmup < 0.0 )
+    {
+        parser.showHelp( 1 );
+    }
+
+    QTextStream out( stdout );
+    try
+    {
+        PipelineBenchmark pipelineBenchmark( settings );
+        if( settings.FitSweep )
+        {
+            return pipelineBenchmark.FitSweep( out );
+        }
+        if( settings.QueueSweep )
+        {
+            return pipelineBenchmark.QueueSweep( out );
+        }
+        if( settings.CopySweep )
+        {
+            return pipelineBenchmark.CopySweep( out );
+        }
+        if( settings.UnpackCheck )
+        {
+            return pipelineBenchmark.UnpackCheck( out );
+        }
+        if( settings.UnpackSweep )
+        {
+            return pipelineBenchmark.UnpackSweep( out );
+        }
+        return pipelineBenchmark.Run( out );
+    }
+    catch( const std::exception &e )
+    {
+        out << "ERROR " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,94 @@
+
+
+#ifndef PIPELINEBENCHMARK_H
+#define PIPELINEBENCHMARK_H
+
+#include <QString>
+#include <QTextStream>
+
+#include "SimulatedCamera.h"
+
+/** settings of one headless benchmark run*/
+struct tBenchmarkSettings
+{
+    QString                 ReplayFile;         // FrameRecorder file to play, empty plays synthetic frames
+    quint64                 ReplayMaxBytes;     // frame data loaded from the replay file
+    tSimulationSettings     Simulation;         // frame settings of the synthetic frames; FrameRate also paces the replay
+    double                  Warmup;             // seconds run before the counters are reset
+    double                  Duration;           // seconds measured after the warmup
+    bool                    Fit1D;              // run the 1D gaussian fits
+    bool                    Fit2D;              // run the 2D gaussian fit
+    bool                    WarmStart;          // fits start from the last converged parameters, as in the viewer
+    bool                    Replot;             // replot an offscreen plot for every plot update, as the viewer does
+    bool                    FitSweep;           // time the 2D gaussian fit alone over a range of image sizes instead of the pipeline
+    bool                    QueueSweep;         // time the frame queue handoff at fixed rates, the ring against the mutex queue
+    bool                    CopySweep;          // time memcpy_threaded against memcpy over frame sizes
+    bool                    UnpackCheck;        // compare every unpack kernel against VmbImageTransform on random packed data
+    bool                    UnpackSweep;        // time every unpack kernel and VmbImageTransform over frame sizes
+    QString                 ReportFile;         // the report is also written here if given
+
+    tBenchmarkSettings()
+        : ReplayMaxBytes    ( 1024ull << 20 )
+        , Warmup            ( 1.0 )
+        , Duration          ( 10.0 )
+        , Fit1D             ( true )
+        , Fit2D             ( false )
+        , WarmStart         ( true )
+        , Replot            ( false )
+        , FitSweep          ( false )
+        , QueueSweep        ( false )
+        , CopySweep         ( false )
+        , UnpackCheck       ( false )
+        , UnpackSweep       ( false )
+    {
+        Simulation.FrameRate = 0.0;
+    }
+};
+
+/** runs FrameObserver, ImageProcessingThread and ImageCalculatingThread without a camera and without the viewer.
+* frames come from SimulatedCamera or ReplayCamera at a fixed rate or flat out, the drop counters show what the pipeline could not keep up with;
+* the report holds the sustained frame rates, the drop counters, the per stage latency percentiles,
+* the cpu time and the peak resident memory of the process.
+* started with --benchmark on the command line of the viewer, or as VimbaCamBenchmark, the console build; see Main
+*/
+class PipelineBenchmark
+{
+    tBenchmarkSettings      m_Settings;
+
+    PipelineBenchmark( const PipelineBenchmark& );
+    PipelineBenchmark& operator=( const PipelineBenchmark& );
+public:
+    explicit PipelineBenchmark( const tBenchmarkSettings &settings );
+
+    /**run the benchmark and write the report to out, 0 if frames made it through the pipeline*/
+    int                     Run         ( QTextStream &out );
+    /**fit a synthetic beam with Gaussian2DFit at square sizes from 64 to 2048 pixels, once per evaluation mode,
+    * and write the time per solver iteration to out. 0 if every fit ran
+    */
+    int                     FitSweep    ( QTextStream &out );
+    /**hand items from a paced producer thread to a consumer thread through ConsumerQueue and through the mutex and
+    * list queue it replaced, at 1000 and 10000 items/s and unpaced, and write the enqueue cost and the handoff
+    * latency to out. 0 if items got through
+    */
+    int                     QueueSweep  ( QTextStream &out );
+    /**copy buffers of 1 to 50 MB with memcpy, stream_copy and memcpy_threaded once the copy pool is calibrated,
+    * and write the GB/s of each to out. 0 if the copies came out right
+    */
+    int                     CopySweep   ( QTextStream &out );
+    /**unpack random Mono10p, Mono12p and Mono12Packed data of 1 pixel to a few frames, odd tails and an unaligned
+    * source included, with every unpack kernel the cpu supports and compare each pixel against VmbImageTransform.
+    * writes the cases and mismatches per format and kernel to out, 0 if all of them matched
+    */
+    int                     UnpackCheck ( QTextStream &out );
+    /**unpack frames of 0.3 to 20 megapixels of each packed format with every unpack kernel the cpu supports and
+    * with VmbImageTransform, and write the megapixels/s and packed GB/s of each to out. 0 if the transform ran
+    */
+    int                     UnpackSweep ( QTextStream &out );
+
+    /**true if the command line asks for the benchmark instead of the viewer*/
+    static bool             IsRequested ( int argc, char *argv[] );
+    /**parse the command line, run and return the process exit code. creates the application object itself*/
+    static int              Main        ( int argc, char *argv[] );
+};
+
+#endif
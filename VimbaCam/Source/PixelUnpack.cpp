@@ -0,0 +1,231 @@
+
+#include "PixelUnpack.h"
+
+#include "CpuDispatch.h"
+
+namespace
+{
+    /** how the shuffled 16 bit words of one format become pixels*/
+    struct PackedLayout
+    {
+        size_t      m_BytesPer8;            // packed bytes of 8 pixels
+        char        m_Shuffle[16];          // source byte of the low and high half of each of the 8 words
+        short       m_Multiplier[8];        // shifts the pixel bits of each word up to the top ...
+        int         m_Shift;                // ... and down to bit 0 again
+    };
+
+    /* lsb first bit streams: pixel j starts at bit j * bits, a multiply by 2^( 16 - bits - offset ) and a shift
+    *  by 16 - bits cut the pixel out of the two bytes it spans */
+    const PackedLayout MONO10P_LAYOUT =
+    {
+        10,
+        { 0, 1,  1, 2,  2, 3,  3, 4,  5, 6,  6, 7,  7, 8,  8, 9 },
+        { 64, 16, 4, 1, 64, 16, 4, 1 },
+        6
+    };
+    const PackedLayout MONO12P_LAYOUT =
+    {
+        12,
+        { 0, 1,  1, 2,  3, 4,  4, 5,  6, 7,  7, 8,  9, 10,  10, 11 },
+        { 16, 1, 16, 1, 16, 1, 16, 1 },
+        4
+    };
+    /* Mono12Packed: even pixel = b0 << 4 | b1 & 0xf, odd pixel = b2 << 4 | b1 >> 4.
+    *  the words are ( b0 << 8 | b1 ) and ( b2 << 8 | b1 ), see unpack12PackedSSSE3 */
+    const char MONO12PACKED_SHUFFLE[16] = { 1, 0,  1, 2,  4, 3,  4, 5,  7, 6,  7, 8,  10, 9,  10, 11 };
+
+    inline void unpackLsbScalar( const VmbUchar_t *src, VmbUint16_t *dst, size_t first, size_t nPixels, unsigned int bits )
+    {
+        const unsigned int mask = ( 1u << bits ) - 1;
+        for( size_t j = first; j < nPixels; ++j )
+        {
+            /* bits >= 10, so a pixel always spans two bytes and never reads past the end */
+            const size_t        bit     = j * bits;
+            const size_t        byte    = bit >> 3;
+            const unsigned int  word    = src[byte] | ( src[byte + 1] << 8 );
+            dst[j] = static_cast<VmbUint16_t>( ( word >> ( bit & 7 ) ) & mask );
+        }
+    }
+
+    inline void unpack12PackedScalar( const VmbUchar_t *src, VmbUint16_t *dst, size_t first, size_t nPixels )
+    {
+        for( size_t j = first; j < nPixels; ++j )
+        {
+            const VmbUchar_t *p = src + ( j >> 1 ) * 3;
+            dst[j] = ( j & 1 ) == 0 ? static_cast<VmbUint16_t>( ( p[0] << 4 ) | ( p[1] & 0x0f ) )
+                                    : static_cast<VmbUint16_t>( ( p[2] << 4 ) | ( p[1] >> 4 ) );
+        }
+    }
+
+    void unpackScalar( VmbPixelFormatType format, const VmbUchar_t *src, VmbUint16_t *dst, size_t first, size_t nPixels )
+    {
+        switch( format )
+        {
+        case VmbPixelFormatMono10p:         unpackLsbScalar( src, dst, first, nPixels, 10 ); break;
+        case VmbPixelFormatMono12p:         unpackLsbScalar( src, dst, first, nPixels, 12 ); break;
+        case VmbPixelFormatMono12Packed:    unpack12PackedScalar( src, dst, first, nPixels ); break;
+        default:                            break;
+        }
+    }
+
+#ifdef CPU_HAS_X86
+    /* every step reads 16 bytes, of which only m_BytesPer8 are used. steps are only taken while those 16 bytes
+    *  are inside the source, the rest is done by the scalar kernel. returns the number of pixels done */
+    CPU_TARGET("ssse3")
+    size_t unpackLsbSSSE3( const PackedLayout &layout, const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels, size_t nBytes )
+    {
+        const __m128i   shuffle     = _mm_loadu_si128( reinterpret_cast<const __m128i*>( layout.m_Shuffle ) );
+        const __m128i   multiplier  = _mm_loadu_si128( reinterpret_cast<const __m128i*>( layout.m_Multiplier ) );
+        const __m128i   shift       = _mm_cvtsi32_si128( layout.m_Shift );
+        size_t j = 0;
+        for( size_t offset = 0; j + 8 <= nPixels && offset + 16 <= nBytes; j += 8, offset += layout.m_BytesPer8 )
+        {
+            __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + offset ) );
+            v = _mm_shuffle_epi8( v, shuffle );
+            v = _mm_srl_epi16( _mm_mullo_epi16( v, multiplier ), shift );
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( dst + j ), v );
+        }
+        return j;
+    }
+
+    CPU_TARGET("ssse3")
+    size_t unpack12PackedSSSE3( const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels, size_t nBytes )
+    {
+        /* even: ( w >> 4 ) & 0xff0 | w & 0xf, odd: w >> 4 */
+        const __m128i   shuffle     = _mm_loadu_si128( reinterpret_cast<const __m128i*>( MONO12PACKED_SHUFFLE ) );
+        const __m128i   highMask    = _mm_set_epi16( 0x0fff, 0x0ff0, 0x0fff, 0x0ff0, 0x0fff, 0x0ff0, 0x0fff, 0x0ff0 );
+        const __m128i   lowMask     = _mm_set_epi16( 0, 0x000f, 0, 0x000f, 0, 0x000f, 0, 0x000f );
+        size_t j = 0;
+        for( size_t offset = 0; j + 8 <= nPixels && offset + 16 <= nBytes; j += 8, offset += 12 )
+        {
+            __m128i w = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + offset ) );
+            w = _mm_shuffle_epi8( w, shuffle );
+            const __m128i v = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( w, 4 ), highMask ), _mm_and_si128( w, lowMask ) );
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( dst + j ), v );
+        }
+        return j;
+    }
+
+    /* the same per 128 bit lane, 16 pixels per step with the second 8 loaded into the upper lane */
+    CPU_TARGET("avx2")
+    size_t unpackLsbAVX2( const PackedLayout &layout, const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels, size_t nBytes )
+    {
+        const __m256i   shuffle     = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i*>( layout.m_Shuffle ) ) );
+        const __m256i   multiplier  = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i*>( layout.m_Multiplier ) ) );
+        const __m128i   shift       = _mm_cvtsi32_si128( layout.m_Shift );
+        const size_t    step        = layout.m_BytesPer8;
+        size_t j = 0;
+        for( size_t offset = 0; j + 16 <= nPixels && offset + step + 16 <= nBytes; j += 16, offset += 2 * step )
+        {
+            __m256i v = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + offset ) ) ),
+                                                 _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + offset + step ) ), 1 );
+            v = _mm256_shuffle_epi8( v, shuffle );
+            v = _mm256_srl_epi16( _mm256_mullo_epi16( v, multiplier ), shift );
+            _mm256_storeu_si256( reinterpret_cast<__m256i*>( dst + j ), v );
+        }
+        return j;
+    }
+
+    CPU_TARGET("avx2")
+    size_t unpack12PackedAVX2( const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels, size_t nBytes )
+    {
+        const __m256i   shuffle     = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i*>( MONO12PACKED_SHUFFLE ) ) );
+        const __m256i   highMask    = _mm256_set1_epi32( 0x0fff0ff0 );
+        const __m256i   lowMask     = _mm256_set1_epi32( 0x0000000f );
+        size_t j = 0;
+        for( size_t offset = 0; j + 16 <= nPixels && offset + 12 + 16 <= nBytes; j += 16, offset += 24 )
+        {
+            __m256i w = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + offset ) ) ),
+                                                 _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + offset + 12 ) ), 1 );
+            w = _mm256_shuffle_epi8( w, shuffle );
+            const __m256i v = _mm256_or_si256( _mm256_and_si256( _mm256_srli_epi16( w, 4 ), highMask ), _mm256_and_si256( w, lowMask ) );
+            _mm256_storeu_si256( reinterpret_cast<__m256i*>( dst + j ), v );
+        }
+        return j;
+    }
+#endif
+}
+
+bool is_packed_format( VmbPixelFormatType format )
+{
+    return     VmbPixelFormatMono10p == format
+            || VmbPixelFormatMono12p == format
+            || VmbPixelFormatMono12Packed == format;
+}
+
+VmbPixelFormatType unpacked_format( VmbPixelFormatType format )
+{
+    switch( format )
+    {
+    case VmbPixelFormatMono10p:         return VmbPixelFormatMono10;
+    case VmbPixelFormatMono12p:
+    case VmbPixelFormatMono12Packed:    return VmbPixelFormatMono12;
+    default:                            return format;
+    }
+}
+
+size_t packed_size( VmbPixelFormatType format, size_t nPixels )
+{
+    switch( format )
+    {
+    case VmbPixelFormatMono10p:         return ( nPixels * 10 + 7 ) / 8;
+    case VmbPixelFormatMono12p:
+    case VmbPixelFormatMono12Packed:    return ( nPixels * 12 + 7 ) / 8;
+    default:                            return 0;
+    }
+}
+
+UnpackKernel unpack_kernel()
+{
+    static const UnpackKernel kernel = cpu_has_avx2() ? UnpackKernel_AVX2 : cpu_has_ssse3() ? UnpackKernel_SSSE3 : UnpackKernel_Scalar;
+    return kernel;
+}
+
+const char* unpack_kernel_name( UnpackKernel kernel )
+{
+    switch( kernel )
+    {
+    case UnpackKernel_AVX2:     return "AVX2";
+    case UnpackKernel_SSSE3:    return "SSSE3";
+    default:                    return "Scalar";
+    }
+}
+
+bool unpack_pixels( VmbPixelFormatType format, const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels )
+{
+    return unpack_pixels( format, src, dst, nPixels, unpack_kernel() );
+}
+
+bool unpack_pixels( VmbPixelFormatType format, const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels, UnpackKernel kernel )
+{
+    if( !is_packed_format( format ) )
+    {
+        return false;
+    }
+    if( kernel > unpack_kernel() )
+    {
+        kernel = unpack_kernel();
+    }
+    size_t done = 0;
+#ifdef CPU_HAS_X86
+    const size_t nBytes = packed_size( format, nPixels );
+    const PackedLayout *pLayout = VmbPixelFormatMono10p == format ? &MONO10P_LAYOUT
+                                : VmbPixelFormatMono12p == format ? &MONO12P_LAYOUT
+                                : NULL;
+    if( UnpackKernel_AVX2 == kernel )
+    {
+        done = NULL != pLayout ? unpackLsbAVX2( *pLayout, src, dst, nPixels, nBytes )
+                               : unpack12PackedAVX2( src, dst, nPixels, nBytes );
+    }
+    if( UnpackKernel_Scalar != kernel )
+    {
+        /* the last few groups the wide kernel could not load, or all of them for SSSE3 */
+        const size_t groupBytes = NULL != pLayout ? pLayout->m_BytesPer8 : 12;
+        const size_t offset     = done / 8 * groupBytes;
+        done += NULL != pLayout ? unpackLsbSSSE3( *pLayout, src + offset, dst + done, nPixels - done, nBytes - offset )
+                                : unpack12PackedSSSE3( src + offset, dst + done, nPixels - done, nBytes - offset );
+    }
+#endif
+    unpackScalar( format, src, dst, done, nPixels );
+    return true;
+}
@@ -0,0 +1,37 @@
+
+
+#ifndef PIXEL_UNPACK_H_
+#define PIXEL_UNPACK_H_
+
+#include <cstddef>
+#include <VimbaCPP/Include/VimbaCPPCommon.h>
+
+/** unpacking of the packed mono formats into one 16 bit value per pixel.
+* Mono10p and Mono12p are the GenICam lsb first bit streams, Mono12Packed is the GigE Vision layout
+* with the low nibbles of two pixels sharing the middle byte.
+* the kernel is picked once on first use: AVX2, SSSE3 or scalar, whatever the cpu and os support.
+*/
+enum UnpackKernel
+{
+    UnpackKernel_Scalar = 0,
+    UnpackKernel_SSSE3  = 1,
+    UnpackKernel_AVX2   = 2,
+};
+
+/** true for the formats unpack_pixels handles*/
+bool            is_packed_format    ( VmbPixelFormatType format );
+/** format of the unpacked data: Mono10 for Mono10p, Mono12 for Mono12p and Mono12Packed, format itself otherwise*/
+VmbPixelFormatType unpacked_format  ( VmbPixelFormatType format );
+/** bytes nPixels take in a packed format, 0 if the format is not packed*/
+size_t          packed_size         ( VmbPixelFormatType format, size_t nPixels );
+/** unpack nPixels from src to dst with the kernel selected for this cpu, false if the format is not packed.
+* src has to hold packed_size( format, nPixels ) bytes
+*/
+bool            unpack_pixels       ( VmbPixelFormatType format, const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels );
+/** same with a fixed kernel, falls back to the next smaller one the cpu supports*/
+bool            unpack_pixels       ( VmbPixelFormatType format, const VmbUchar_t *src, VmbUint16_t *dst, size_t nPixels, UnpackKernel kernel );
+/** kernel unpack_pixels uses on this cpu*/
+UnpackKernel    unpack_kernel       ();
+const char*     unpack_kernel_name  ( UnpackKernel kernel );
+
+#endif
@@ -0,0 +1,206 @@
+
+
+#include "PretriggerBuffer.h"
+#include "FrameRecorder.h"
+
+#include <QDir>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const int INITIAL_SLOTS = 64;       // the ring doubles from here while the window fills
+}
+
+PretriggerBuffer::PretriggerBuffer()
+    : m_nHead       ( 0 )
+    , m_nCount      ( 0 )
+    , m_nBytes      ( 0 )
+    , m_nWindowNs   ( 0 )
+    , m_nMaxBytes   ( 0 )
+    , m_bEnabled    ( false )
+{
+}
+
+PretriggerBuffer::~PretriggerBuffer()
+{
+    wait();
+}
+
+void PretriggerBuffer::Configure( double dSeconds, quint64 nMaxBytes )
+{
+    QMutexLocker guard( &m_Lock );
+    const bool bEnabled = dSeconds > 0.0 && nMaxBytes > 0;
+    m_nWindowNs = bEnabled ? static_cast<quint64>( dSeconds * 1.0e9 ) : 0;
+    m_nMaxBytes = bEnabled ? nMaxBytes : 0;
+    m_bEnabled.store( bEnabled, std::memory_order_relaxed );
+    if( bEnabled )
+    {
+        /* a smaller window takes effect now, not with the next frame */
+        if( m_nCount > 0 )
+        {
+            evict( m_Ring.at( ( m_nHead + m_nCount - 1 ) % m_Ring.size() ).Trace().Stamp( FrameStage_Received ) );
+        }
+    }
+    else
+    {
+        m_Ring.clear();
+        m_nHead     = 0;
+        m_nCount    = 0;
+        m_nBytes    = 0;
+    }
+}
+
+void PretriggerBuffer::Clear()
+{
+    QMutexLocker guard( &m_Lock );
+    for( int i = 0; i < m_Ring.size(); ++i )
+    {
+        m_Ring[i] = tFrameInfo();
+    }
+    m_nHead     = 0;
+    m_nCount    = 0;
+    m_nBytes    = 0;
+}
+
+/* under the lock. the ring only grows while the window fills, afterwards a push replaces the slot evict freed */
+void PretriggerBuffer::append( const tFrameInfo &frame )
+{
+    if( 0 == m_nWindowNs )
+    {
+        /* disabled between the callback's check and the lock */
+        return;
+    }
+    if( m_nCount == m_Ring.size() )
+    {
+        QVector<tFrameInfo> ring( std::max( INITIAL_SLOTS, 2 * m_Ring.size() ) );
+        for( int i = 0; i < m_nCount; ++i )
+        {
+            ring[i] = m_Ring.at( ( m_nHead + i ) % m_Ring.size() );
+        }
+        m_Ring.swap( ring );
+        m_nHead = 0;
+    }
+    m_Ring[( m_nHead + m_nCount ) % m_Ring.size()] = frame;
+    ++m_nCount;
+    m_nBytes += frame.Size();
+}
+
+/* under the lock. the newest frame always stays, even if it alone exceeds the budget */
+void PretriggerBuffer::evict( quint64 nNewestStamp )
+{
+    while( m_nCount > 1 )
+    {
+        tFrameInfo &oldest = m_Ring[m_nHead];
+        if(     m_nBytes <= m_nMaxBytes
+            &&  nNewestStamp - oldest.Trace().Stamp( FrameStage_Received ) <= m_nWindowNs )
+        {
+            break;
+        }
+        m_nBytes -= oldest.Size();
+        /* the last reference of a frame no dump holds, its buffer goes back to the pool */
+        oldest = tFrameInfo();
+        m_nHead = ( m_nHead + 1 ) % m_Ring.size();
+        --m_nCount;
+    }
+}
+
+void PretriggerBuffer::Push( const tFrameInfo &frame, const FramePoolPtr &pPool )
+{
+    if( !IsEnabled() )
+    {
+        return;
+    }
+    if( NULL == pPool )
+    {
+        QMutexLocker guard( &m_Lock );
+        append( frame );
+        evict( frame.Trace().Stamp( FrameStage_Received ) );
+        return;
+    }
+    /* copied outside the lock, a failed allocation only loses the frame for the window */
+    try
+    {
+        VmbUint32_t nCapacity = frame.Size();
+        VmbUchar_t *pBuffer = pPool->Take( nCapacity );
+        const FrameDataPtr pData( pBuffer, FramePoolReturn( pPool, nCapacity ) );
+        memcpy( pBuffer, frame.Data(), frame.Size() );
+        tFrameInfo copy( frame, pData );
+        copy.Trace() = frame.Trace();
+        QMutexLocker guard( &m_Lock );
+        append( copy );
+        evict( copy.Trace().Stamp( FrameStage_Received ) );
+    }
+    catch( const std::bad_alloc& )
+    {
+    }
+}
+
+bool PretriggerBuffer::Dump( const QString &sFileName )
+{
+    if( isRunning() )
+    {
+        return false;
+    }
+    {
+        QMutexLocker guard( &m_Lock );
+        m_Snapshot.resize( m_nCount );
+        for( int i = 0; i < m_nCount; ++i )
+        {
+            m_Snapshot[i] = m_Ring.at( ( m_nHead + i ) % m_Ring.size() );
+        }
+    }
+    if( m_Snapshot.isEmpty() )
+    {
+        return false;
+    }
+    m_sDumpFile = sFileName;
+    start( QThread::LowPriority );
+    return true;
+}
+
+void PretriggerBuffer::run()
+{
+    const int nFrames = m_Snapshot.size();
+    double dSeconds = 0.0;
+    if( nFrames > 1 )
+    {
+        dSeconds = ( m_Snapshot.last().Trace().Stamp( FrameStage_Received ) - m_Snapshot.first().Trace().Stamp( FrameStage_Received ) ) * 1.0e-9;
+    }
+    QString sError;
+    const bool bOk = FrameRecorder::WriteFrames( m_sDumpFile, m_Snapshot, sError );
+    m_Snapshot.clear();
+    QMutexLocker guard( &m_ResultLock );
+    m_sResult = bOk ? QString( "Pre-trigger dump: %1 frames, %2 s written to %3" ).arg( nFrames ).arg( dSeconds, 0, 'f', 2 ).arg( QDir::toNativeSeparators( m_sDumpFile ) )
+                    : QString( "ERROR: pre-trigger dump to %1 failed, %2" ).arg( QDir::toNativeSeparators( m_sDumpFile ) ).arg( sError );
+}
+
+int PretriggerBuffer::Frames() const
+{
+    QMutexLocker guard( &m_Lock );
+    return m_nCount;
+}
+
+quint64 PretriggerBuffer::Bytes() const
+{
+    QMutexLocker guard( &m_Lock );
+    return m_nBytes;
+}
+
+double PretriggerBuffer::Seconds() const
+{
+    QMutexLocker guard( &m_Lock );
+    if( m_nCount < 2 )
+    {
+        return 0.0;
+    }
+    const quint64 nOldest = m_Ring.at( m_nHead ).Trace().Stamp( FrameStage_Received );
+    const quint64 nNewest = m_Ring.at( ( m_nHead + m_nCount - 1 ) % m_Ring.size() ).Trace().Stamp( FrameStage_Received );
+    return ( nNewest - nOldest ) * 1.0e-9;
+}
+
+QString PretriggerBuffer::DumpResult() const
+{
+    QMutexLocker guard( &m_ResultLock );
+    return m_sResult;
+}
@@ -0,0 +1,71 @@
+
+
+#ifndef PRETRIGGERBUFFER_H
+#define PRETRIGGERBUFFER_H
+
+#include <QThread>
+#include <QString>
+#include <QMutex>
+#include <QVector>
+#include <QSharedPointer>
+#include <atomic>
+
+#include "Helper.h"
+
+/** keeps the frames of the last seconds in memory, so the frames before a rare event can be saved after it.
+* the window holds references to the frames the pipeline got, so a frame buffer goes back to the pool when
+* the frame falls out of the window and is reused for a later frame; only leased camera buffers are copied,
+* they have to go back to the camera queue.
+* Dump writes the frames held at that moment to a FrameRecorder file on the buffer's own thread
+* while the window keeps filling
+*/
+class PretriggerBuffer : public QThread
+{
+    mutable QMutex              m_Lock;             // the window, shared by the frame callback and the GUI thread
+    QVector<tFrameInfo>         m_Ring;             // m_nCount frames from m_nHead on, oldest first; grows until the window is full
+    int                         m_nHead;
+    int                         m_nCount;
+    quint64                     m_nBytes;           // frame data held
+    quint64                     m_nWindowNs;        // age of the oldest frame kept, 0 disables
+    quint64                     m_nMaxBytes;
+    std::atomic<bool>           m_bEnabled;         // checked by the callback without the lock
+
+    /* the running dump */
+    QVector<tFrameInfo>         m_Snapshot;
+    QString                     m_sDumpFile;
+    mutable QMutex              m_ResultLock;
+    QString                     m_sResult;
+
+    PretriggerBuffer( const PretriggerBuffer& );
+    PretriggerBuffer& operator=( const PretriggerBuffer& );
+
+    void                append          ( const tFrameInfo &frame );
+    void                evict           ( quint64 nNewestStamp );
+protected:
+    virtual void run();
+public:
+    PretriggerBuffer();
+    ~PretriggerBuffer();
+
+    /**keep the frames of the last dSeconds, at most nMaxBytes of frame data. 0 seconds disables and releases the frames*/
+    void                Configure       ( double dSeconds, quint64 nMaxBytes );
+    bool                IsEnabled       () const    { return m_bEnabled.load( std::memory_order_relaxed ); }
+    /**frame callback: add frame to the window and drop what fell out of it.
+    * with pPool the data is copied into a buffer of it first, for leased frames
+    */
+    void                Push            ( const tFrameInfo &frame, const FramePoolPtr &pPool );
+    /**release all frames held*/
+    void                Clear           ();
+    /**write the frames held now to sFileName in the background. false if the window is empty or a dump is still running*/
+    bool                Dump            ( const QString &sFileName );
+
+    int                 Frames          () const;
+    quint64             Bytes           () const;
+    /**time between the oldest and the newest frame held in s*/
+    double              Seconds         () const;
+    /**one line outcome of the last finished dump*/
+    QString             DumpResult      () const;
+};
+typedef QSharedPointer<PretriggerBuffer> PretriggerBufferPtr;
+
+#endif
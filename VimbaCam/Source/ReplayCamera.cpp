@@ -0,0 +1,214 @@
+
+
+#include "ReplayCamera.h"
+
+#include <QFile>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+    const int       REPLAY_BUFFER_COUNT     = 6;            // pool buffers reserved on start, as for a live capture
+
+    /* files of version 1 written before the metadata was added have a shorter frame header, the rest stays 0 */
+    bool readFrameHeader( QFile &file, quint32 nHeaderSize, tRecordFrameHeader &header )
+    {
+        memset( &header, 0, sizeof( header ) );
+        const qint64 nRead = std::min<qint64>( nHeaderSize, sizeof( header ) );
+        if( file.read( reinterpret_cast<char*>( &header ), nRead ) != nRead )
+        {
+            return false;
+        }
+        return file.seek( file.pos() + nHeaderSize - nRead );
+    }
+}
+
+ReplayCamera::ReplayCamera( const SP_DECL(FrameObserver) &pFrameObs )
+    : m_pFrameObs   ( pFrameObs )
+    , m_nMaxSize    ( 0 )
+    , m_dFrameRate  ( 0.0 )
+    , m_Stopping    ( true )
+    , m_FrameID     ( 0 )
+{
+}
+
+ReplayCamera::~ReplayCamera()
+{
+    StopCapture();
+}
+
+void ReplayCamera::setFrameRate( double dFrameRate )
+{
+    if( !isRunning() )
+    {
+        m_dFrameRate = std::max( 0.0, dFrameRate );
+    }
+}
+
+bool ReplayCamera::appendFrame( const tRecordFrameHeader &header, const QByteArray &data, quint64 &nBytes, quint64 nMaxBytes )
+{
+    if( nBytes + header.m_nSize > nMaxBytes )
+    {
+        return false;
+    }
+    RecordedFrame frame;
+    frame.m_Info = BaseFrame( header.m_PixelFormat, header.m_nWidth, header.m_nHeight, header.m_nSize, false );
+    tFrameMetadata &metadata    = frame.m_Info.Metadata();
+    metadata.m_nFrameID         = header.m_nFrameID;
+    metadata.m_nTimestamp       = header.m_nCameraTimestamp;
+    metadata.m_nOffsetX         = header.m_nOffsetX;
+    metadata.m_nOffsetY         = header.m_nOffsetY;
+    metadata.m_dExposureTime    = header.m_dExposureTime;
+    metadata.m_dGain            = header.m_dGain;
+    frame.m_Data                = data;
+    m_Frames.append( frame );
+    m_nMaxSize  = std::max( m_nMaxSize, header.m_nSize );
+    nBytes      += header.m_nSize;
+    return true;
+}
+
+bool ReplayCamera::Load( const QString &sFileName, quint64 nMaxBytes, QString &sError )
+{
+    if( isRunning() )
+    {
+        sError = "the replay is running";
+        return false;
+    }
+    m_Frames.clear();
+    m_nMaxSize = 0;
+
+    QFile file( sFileName );
+    if( !file.open( QIODevice::ReadOnly ) )
+    {
+        sError = QString( "could not open %1: %2" ).arg( sFileName ).arg( file.errorString() );
+        return false;
+    }
+    tRecordFileHeader fileHeader;
+    if(     file.read( reinterpret_cast<char*>( &fileHeader ), sizeof( fileHeader ) ) != sizeof( fileHeader )
+        ||  0 != memcmp( fileHeader.m_Magic, "VCRAWREC", sizeof( fileHeader.m_Magic ) )
+        ||  1 != fileHeader.m_nVersion )
+    {
+        sError = QString( "%1 is no raw frame recording" ).arg( sFileName );
+        return false;
+    }
+    const quint32   nHeaderSize = fileHeader.m_nFrameHeaderSize;
+    const qint64    nFileSize   = file.size();
+
+    /* a closed recording lists its frames in the index, the trailer tells where it starts */
+    QVector<quint64> offsets;
+    tRecordFileTrailer trailer;
+    if(     nFileSize >= static_cast<qint64>( sizeof( fileHeader ) + sizeof( trailer ) )
+        &&  file.seek( nFileSize - sizeof( trailer ) )
+        &&  file.read( reinterpret_cast<char*>( &trailer ), sizeof( trailer ) ) == sizeof( trailer )
+        &&  0 == memcmp( trailer.m_Magic, "VCRAWIDX", sizeof( trailer.m_Magic ) )
+        &&  trailer.m_nIndexOffset + trailer.m_nFrames * sizeof( tRecordIndexEntry ) + sizeof( trailer ) == static_cast<quint64>( nFileSize )
+        &&  file.seek( trailer.m_nIndexOffset ) )
+    {
+        offsets.reserve( static_cast<int>( trailer.m_nFrames ) );
+        for( quint64 i = 0; i < trailer.m_nFrames; ++i )
+        {
+            tRecordIndexEntry entry;
+            if( file.read( reinterpret_cast<char*>( &entry ), sizeof( entry ) ) != sizeof( entry ) )
+            {
+                break;
+            }
+            offsets.append( entry.m_nOffset );
+        }
+    }
+    const bool bIndexed = !offsets.isEmpty();
+    const qint64 nDataEnd = bIndexed ? static_cast<qint64>( trailer.m_nIndexOffset ) : nFileSize;
+
+    quint64 nBytes = 0;
+    qint64 nPos = sizeof( fileHeader );
+    for( int i = 0; bIndexed ? i < offsets.size() : nPos < nDataEnd; ++i )
+    {
+        if( bIndexed )
+        {
+            nPos = static_cast<qint64>( offsets[i] );
+        }
+        tRecordFrameHeader header;
+        if( !file.seek( nPos ) || !readFrameHeader( file, nHeaderSize, header ) )
+        {
+            break;
+        }
+        /* an unclosed recording ends with whatever the last block held, stop at the first frame that does not fit */
+        const qint64 nPadded = ( static_cast<qint64>( header.m_nSize ) + 7 ) / 8 * 8;
+        if( 0 == header.m_nSize || file.pos() + nPadded > nDataEnd )
+        {
+            break;
+        }
+        const QByteArray data = file.read( header.m_nSize );
+        if( data.size() != static_cast<int>( header.m_nSize ) || !appendFrame( header, data, nBytes, nMaxBytes ) )
+        {
+            break;
+        }
+        nPos = file.pos() + nPadded - header.m_nSize;
+    }
+    if( m_Frames.isEmpty() )
+    {
+        sError = QString( "%1 holds no frame that fits into %2 MB" ).arg( sFileName ).arg( nMaxBytes >> 20 );
+        return false;
+    }
+    return true;
+}
+
+void ReplayCamera::StartCapture()
+{
+    if( isRunning() || m_Frames.isEmpty() )
+    {
+        return;
+    }
+    SP_ACCESS( m_pFrameObs )->reserveFramePool( m_nMaxSize, REPLAY_BUFFER_COUNT );
+    m_FrameID.store( 0, std::memory_order_relaxed );
+    m_Stopping.store( false, std::memory_order_release );
+    start();
+}
+
+void ReplayCamera::StopCapture()
+{
+    m_Stopping.store( true, std::memory_order_release );
+    wait();
+}
+
+void ReplayCamera::run()
+{
+    typedef std::chrono::steady_clock clock_type;
+    const clock_type::duration period = m_dFrameRate > 0.0
+                                        ? std::chrono::duration_cast<clock_type::duration>( std::chrono::duration<double>( 1.0 / m_dFrameRate ) )
+                                        : clock_type::duration::zero();
+    const FramePoolPtr  pPool = SP_ACCESS( m_pFrameObs )->framePool();
+    clock_type::time_point next = clock_type::now();
+
+    while( !m_Stopping.load( std::memory_order_acquire ) )
+    {
+        const VmbUint64_t nFrameID = m_FrameID.load( std::memory_order_relaxed );
+        const RecordedFrame &frame = m_Frames.at( static_cast<int>( nFrameID % m_Frames.size() ) );
+        try
+        {
+            VmbUint32_t nCapacity = frame.m_Info.Size();
+            VmbUchar_t *pBuffer = pPool->Take( nCapacity );
+            const FrameDataPtr pData( pBuffer, FramePoolReturn( pPool, nCapacity ) );
+            memcpy( pBuffer, frame.m_Data.constData(), frame.m_Info.Size() );
+            SP_ACCESS( m_pFrameObs )->FrameReceived( tFrameInfo( frame.m_Info, pData ), nFrameID );
+        }
+        catch( const std::bad_alloc& )
+        {
+            /* same as a frame the driver could not deliver, the id gap shows up in the camera fps */
+        }
+        m_FrameID.store( nFrameID + 1, std::memory_order_relaxed );
+
+        if( period != clock_type::duration::zero() )
+        {
+            next += period;
+            const clock_type::time_point now = clock_type::now();
+            if( next < now )
+            {
+                /* behind schedule, a real camera does not catch up with a burst either */
+                next = now;
+            }
+            std::this_thread::sleep_until( next );
+        }
+    }
+}
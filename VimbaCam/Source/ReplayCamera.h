@@ -0,0 +1,63 @@
+
+
+#ifndef REPLAYCAMERA_H
+#define REPLAYCAMERA_H
+
+#include <QThread>
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+
+#include "FrameObserver.h"
+
+/** software camera playing the frames of a FrameRecorder file into a FrameObserver.
+* the frames are loaded into memory up front, so the disk does not limit the replay, and are played in a loop.
+* every frame is copied into a buffer of the observer's frame pool and handed to the same entry point
+* SimulatedCamera uses
+*/
+class ReplayCamera : public QThread
+{
+    struct RecordedFrame
+    {
+        BaseFrame           m_Info;
+        QByteArray          m_Data;
+    };
+
+    SP_DECL(FrameObserver)      m_pFrameObs;        // receiver of the frames
+    QVector<RecordedFrame>      m_Frames;
+    VmbUint32_t                 m_nMaxSize;         // largest frame, the pool is reserved for it
+    double                      m_dFrameRate;       // frames per second, 0 runs flat out without backpressure
+    std::atomic<bool>           m_Stopping;
+    std::atomic<VmbUint64_t>    m_FrameID;          // id of the next frame, counts up from 0 on every start
+
+    ReplayCamera( const ReplayCamera& );
+    ReplayCamera& operator=( const ReplayCamera& );
+
+    bool        appendFrame     ( const tRecordFrameHeader &header, const QByteArray &data, quint64 &nBytes, quint64 nMaxBytes );
+protected:
+    virtual void run();
+public:
+    ReplayCamera( const SP_DECL(FrameObserver) &pFrameObs );
+    ~ReplayCamera();
+
+    /**load up to nMaxBytes of frame data from a recording, only while stopped.
+    * uses the index of a closed recording, a recording that was not closed is read sequentially.
+    * false with sError set if the file is no recording or holds no frame
+    */
+    bool                        Load            ( const QString &sFileName, quint64 nMaxBytes, QString &sError );
+    /** frames per second, 0 runs flat out without backpressure, the consumer queue drops the oldest frames. only while stopped*/
+    void                        setFrameRate    ( double dFrameRate );
+    /** frames loaded*/
+    int                         frames          () const { return m_Frames.size(); }
+    /** start delivering frames, the observer must have been started*/
+    void                        StartCapture    ();
+    /** stop delivering frames and wait for the producer thread*/
+    void                        StopCapture     ();
+    /** frames delivered since the last start*/
+    VmbUint64_t                 frameCount      () const { return m_FrameID.load( std::memory_order_relaxed ); }
+    /** size in bytes of the largest frame*/
+    VmbUint32_t                 payloadSize     () const { return m_nMaxSize; }
+};
+
+#endif
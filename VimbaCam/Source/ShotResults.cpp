@@ -0,0 +1,144 @@
+#include "ShotResults.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <QtMath>
+
+#include <algorithm>
+#include <limits>
+
+void tShotResult::ClearFits()
+{
+    m_dCentroidX    = std::numeric_limits<double>::quiet_NaN();
+    m_dCentroidY    = std::numeric_limits<double>::quiet_NaN();
+    m_Fitted1D      = false;
+    m_Fitted2D      = false;
+    m_FitInfo2D     = 0;
+    m_FitExpired2D  = false;
+    m_ErrMajor      = 0.0;
+    m_ErrMinor      = 0.0;
+    for( int i = 0; i < FIT1D_PARAMS; ++i )
+    {
+        m_FitParaX[i] = m_Confi95X[i] = m_FitParaY[i] = m_Confi95Y[i] = 0.0;
+    }
+    for( int i = 0; i < FIT2D_PARAMS; ++i )
+    {
+        m_FitPara2D[i] = m_Confi95_2D[i] = 0.0;
+    }
+    m_FitError.clear();
+}
+
+void tShotResult::SetCentroid()
+{
+    if( m_Fitted2D )
+    {
+        m_dCentroidX = m_FitPara2D[1];
+        m_dCentroidY = m_FitPara2D[2];
+    }
+    else if( m_Fitted1D )
+    {
+        m_dCentroidX = m_FitParaX[1];
+        m_dCentroidY = m_FitParaY[1];
+    }
+    else if( m_Moments.m_bValid )
+    {
+        m_dCentroidX = m_Moments.m_dCentroidX;
+        m_dCentroidY = m_Moments.m_dCentroidY;
+    }
+    else
+    {
+        m_dCentroidX = std::numeric_limits<double>::quiet_NaN();
+        m_dCentroidY = std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+ShotResults::ShotResults( int nCapacity )
+    : m_Ring( std::max( 1, nCapacity ) )
+    , m_nRecorded( 0 )
+{
+}
+
+void ShotResults::Record( const tShotResult &shot )
+{
+    QMutexLocker guard( &m_Lock );
+    m_Ring[static_cast<int>( m_nRecorded % m_Ring.size() )] = shot;
+    ++m_nRecorded;
+}
+
+QVector<tShotResult> ShotResults::Snapshot() const
+{
+    QMutexLocker guard( &m_Lock );
+    const quint64 nSize     = m_Ring.size();
+    const quint64 nKept     = std::min( m_nRecorded, nSize );
+    QVector<tShotResult> shots;
+    shots.reserve( static_cast<int>( nKept ) );
+    for( quint64 n = m_nRecorded - nKept; n < m_nRecorded; ++n )
+    {
+        shots.append( m_Ring.at( static_cast<int>( n % nSize ) ) );
+    }
+    return shots;
+}
+
+quint64 ShotResults::Recorded() const
+{
+    QMutexLocker guard( &m_Lock );
+    return m_nRecorded;
+}
+
+quint64 ShotResults::Overwritten() const
+{
+    QMutexLocker guard( &m_Lock );
+    const quint64 nSize = m_Ring.size();
+    return m_nRecorded > nSize ? m_nRecorded - nSize : 0;
+}
+
+void ShotResults::Clear()
+{
+    QMutexLocker guard( &m_Lock );
+    m_nRecorded = 0;
+}
+
+/* the history is copied first, the fit stage is not held up by the disk */
+bool ShotResults::WriteCsv( const QString &sFileName ) const
+{
+    const QVector<tShotResult> shots = Snapshot();
+    QFile file( sFileName );
+    if( !file.open( QIODevice::WriteOnly | QIODevice::Text ) )
+    {
+        return false;
+    }
+    QTextStream out( &file );
+    out.setRealNumberPrecision( 10 );   // sub-pixel positions on a large sensor
+    out << "frame_id,timestamp,analysed_ns,exposure_us,gain_db,offset_x,offset_y,width,height,centroid_x,centroid_y,"
+           "fit1d,amp_x,mu_x,sigma_x,base_x,mu_x_ci95,sigma_x_ci95,amp_y,mu_y,sigma_y,base_y,mu_y_ci95,sigma_y_ci95,"
+           "fit2d,info2d,expired2d,A,x0,y0,a,b,c,D,x0_ci95,y0_ci95,err_major,err_minor,"
+           "moments,mom_x,mom_y,d4s_major,d4s_minor,mom_angle_deg,mom_iterations\n";
+    const auto writeFit1D = [&out]( const double *pPara, const double *pConfi )
+    {
+        out << ',' << pPara[0] << ',' << pPara[1] << ',' << pPara[2] << ',' << pPara[3]
+            << ',' << pConfi[1] << ',' << pConfi[2];
+    };
+    for( const tShotResult &shot : shots )
+    {
+        out << shot.m_Metadata.m_nFrameID << ',' << shot.m_Metadata.m_nTimestamp << ',' << shot.m_nAnalysed << ','
+            << shot.m_Metadata.m_dExposureTime << ',' << shot.m_Metadata.m_dGain << ','
+            << shot.m_OffsetX << ',' << shot.m_OffsetY << ',' << shot.m_Width << ',' << shot.m_Height << ','
+            << shot.m_dCentroidX << ',' << shot.m_dCentroidY << ',' << ( shot.m_Fitted1D ? 1 : 0 );
+        writeFit1D( shot.m_FitParaX, shot.m_Confi95X );
+        writeFit1D( shot.m_FitParaY, shot.m_Confi95Y );
+        out << ',' << ( shot.m_Fitted2D ? 1 : 0 ) << ',' << shot.m_FitInfo2D << ',' << ( shot.m_FitExpired2D ? 1 : 0 );
+        for( int i = 0; i < tShotResult::FIT2D_PARAMS; ++i )
+        {
+            out << ',' << shot.m_FitPara2D[i];
+        }
+        out << ',' << shot.m_Confi95_2D[1] << ',' << shot.m_Confi95_2D[2]
+            << ',' << shot.m_ErrMajor << ',' << shot.m_ErrMinor;
+        const tBeamMoments &moments = shot.m_Moments;
+        out << ',' << ( moments.m_bValid ? 1 : 0 ) << ',' << moments.m_dCentroidX << ',' << moments.m_dCentroidY
+            << ',' << moments.m_dMajor << ',' << moments.m_dMinor << ',' << moments.m_dAngle * 180.0 / M_PI
+            << ',' << moments.m_nIterations << '\n';
+    }
+    out.flush();
+    return out.status() == QTextStream::Ok;
+}
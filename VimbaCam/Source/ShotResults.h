@@ -0,0 +1,87 @@
+#ifndef SHOTRESULTS_H
+#define SHOTRESULTS_H
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QSharedPointer>
+#include <QtGlobal>
+#include "Helper.h"
+#include "BeamMoments.h"
+
+/** what the analysis found in one frame, kept whether the frame was plotted or not.
+* plain values only, so recording one is a copy without allocations
+*/
+struct tShotResult
+{
+    enum { FIT1D_PARAMS = 4, FIT2D_PARAMS = 7 };
+
+    tFrameMetadata          m_Metadata;                     // frame id, camera timestamp, exposure and gain of the frame
+    quint64                 m_nAnalysed;                    // FrameTrace::Now() when the shot was recorded
+    int                     m_Width;                        // ROI of the frame
+    int                     m_Height;
+    int                     m_OffsetX;
+    int                     m_OffsetY;
+    double                  m_dCentroidX;                   // sensor px, of the 2D fit, else of the 1D fits, else of the moments, NaN without
+    double                  m_dCentroidY;
+    tBeamMoments            m_Moments;                      // ISO 11146 second moments, of every frame that reached the fit stage's queue
+    bool                    m_Fitted1D;
+    double                  m_FitParaX[FIT1D_PARAMS];       // amplitude, mean, sigma, offset
+    double                  m_Confi95X[FIT1D_PARAMS];
+    double                  m_FitParaY[FIT1D_PARAMS];
+    double                  m_Confi95Y[FIT1D_PARAMS];
+    bool                    m_Fitted2D;
+    int                     m_FitInfo2D;                    // gsl convergence info, 1 is success
+    bool                    m_FitExpired2D;                 // the fit ran out of its time budget, the parameters are the best it got to
+    double                  m_FitPara2D[FIT2D_PARAMS];      // A, x0, y0, a, b, c, D
+    double                  m_Confi95_2D[FIT2D_PARAMS];
+    double                  m_ErrMajor;
+    double                  m_ErrMinor;
+    QString                 m_FitError;                     // logged by the render stage, the fit stage runs at the frame rate
+
+    tShotResult()
+        : m_nAnalysed( 0 )
+        , m_Width( 0 )
+        , m_Height( 0 )
+        , m_OffsetX( 0 )
+        , m_OffsetY( 0 )
+    {
+        ClearFits();
+    }
+    /**no fit ran, the moments are kept*/
+    void ClearFits();
+    /**m_dCentroid* from the fits that ran or the moments*/
+    void SetCentroid();
+};
+
+/** ring of the results of the last shots of an acquisition, fed by the fit stage with every frame it analyses and
+* with the moments of the frames that were pushed out of its queue, in the order they got there.
+* the history can be taken or saved as a whole, the display plots the results carried by the frame it shows.
+* Record overwrites the oldest entry once the ring is full. all functions may be called from any thread
+*/
+class ShotResults
+{
+    mutable QMutex          m_Lock;
+    QVector<tShotResult>    m_Ring;
+    quint64                 m_nRecorded;                    // since Clear, the latest is at ( m_nRecorded - 1 ) % capacity
+
+    ShotResults( const ShotResults& );
+    ShotResults& operator=( const ShotResults& );
+public:
+    /**shots kept by default, about 10 MB*/
+    enum { HISTORY_SHOTS = 32768 };
+
+    explicit ShotResults( int nCapacity = HISTORY_SHOTS );
+    void                    Record( const tShotResult &shot );
+    /**the kept shots, oldest first*/
+    QVector<tShotResult>    Snapshot() const;
+    quint64                 Recorded() const;
+    /**shots that fell out of the ring*/
+    quint64                 Overwritten() const;
+    void                    Clear();
+    /**the kept shots as csv, one line per shot*/
+    bool                    WriteCsv( const QString &sFileName ) const;
+};
+typedef QSharedPointer<ShotResults> ShotResultsPtr;
+
+#endif
@@ -0,0 +1,231 @@
+
+#include "SimulatedCamera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+    const int       SIMULATED_BUFFER_COUNT  = 6;            // pool buffers reserved on start, as for a live capture
+    const int       NOISE_TABLE_SIZE        = 1 << 18;      // noise samples, rows start at random offsets into it
+    const double    PROFILE_CUTOFF          = 1.0e-4;       // rows where a spot is below this fraction of its peak skip it
+    const double    TWO_PI                  = 6.283185307179586;
+
+    double fullScale( VmbPixelFormatType format )
+    {
+        switch( format )
+        {
+        case VmbPixelFormatMono8:   return 255.0;
+        case VmbPixelFormatMono12:  return 4095.0;
+        case VmbPixelFormatMono16:  return 65535.0;
+        default:                    throw std::invalid_argument( "simulated camera supports Mono8, Mono12 and Mono16 only" );
+        }
+    }
+}
+
+SimulatedCamera::SimulatedCamera( const SP_DECL(FrameObserver) &pFrameObs, const tSimulationSettings &settings )
+    : m_pFrameObs   ( pFrameObs )
+    , m_Stopping    ( true )
+    , m_FrameID     ( 0 )
+{
+    setSettings( settings );
+}
+
+SimulatedCamera::~SimulatedCamera()
+{
+    StopCapture();
+}
+
+void SimulatedCamera::setSettings( const tSimulationSettings &settings )
+{
+    if( isRunning() )
+    {
+        return;
+    }
+    fullScale( settings.PixelFormat );
+    if( 0 == settings.Width || 0 == settings.Height )
+    {
+        throw std::invalid_argument( "simulated frame size must not be zero" );
+    }
+    m_Settings = settings;
+}
+
+VmbUint32_t SimulatedCamera::payloadSize() const
+{
+    const VmbUint32_t nBytesPerPixel = VmbPixelFormatMono8 == m_Settings.PixelFormat ? 1 : 2;
+    return m_Settings.Width * m_Settings.Height * nBytesPerPixel;
+}
+
+void SimulatedCamera::StartCapture()
+{
+    if( isRunning() )
+    {
+        return;
+    }
+    setupScene();
+    SP_ACCESS( m_pFrameObs )->reserveFramePool( payloadSize(), SIMULATED_BUFFER_COUNT );
+    m_FrameID.store( 0, std::memory_order_relaxed );
+    m_Stopping.store( false, std::memory_order_release );
+    start();
+}
+
+void SimulatedCamera::StopCapture()
+{
+    m_Stopping.store( true, std::memory_order_release );
+    wait();
+}
+
+/* places the spots and fills the noise table, the same seed gives the same scene */
+void SimulatedCamera::setupScene()
+{
+    const double dMax   = fullScale( m_Settings.PixelFormat );
+    const double w      = m_Settings.Width;
+    const double h      = m_Settings.Height;
+    const double radius = 0.25 * std::min( w, h );
+    std::mt19937 random( m_Settings.Seed );
+
+    m_Spots.resize( std::max( 0, m_Settings.SpotCount ) );
+    for( int i = 0; i < m_Spots.size(); ++i )
+    {
+        Spot &spot = m_Spots[i];
+        /* first spot in the centre, the others on a circle around it */
+        const double angle  = i == 0 ? 0.0 : TWO_PI * ( i - 1 ) / std::max( 1, m_Spots.size() - 1 );
+        const double r      = i == 0 ? 0.0 : radius;
+        spot.m_CenterX      = 0.5 * w + r * std::cos( angle );
+        spot.m_CenterY      = 0.5 * h + r * std::sin( angle );
+        spot.m_SigmaX       = m_Settings.SpotSigma * ( 1.0 + 0.2 * i );
+        spot.m_SigmaY       = m_Settings.SpotSigma * ( 1.0 + 0.2 * i ) * ( i % 2 == 0 ? 1.0 : 0.6 );
+        spot.m_Amplitude    = m_Settings.PeakLevel * dMax / ( 1.0 + 0.25 * i );
+        spot.m_Phase        = std::uniform_real_distribution<double>( 0.0, TWO_PI )( random );
+    }
+
+    m_Noise.fill( 0.0f, NOISE_TABLE_SIZE + m_Settings.Width );
+    if( m_Settings.NoiseLevel > 0.0 )
+    {
+        std::normal_distribution<float> noise( 0.0f, static_cast<float>( m_Settings.NoiseLevel * dMax ) );
+        for( int i = 0; i < m_Noise.size(); ++i )
+        {
+            m_Noise[i] = noise( random );
+        }
+    }
+    m_ProfileX.resize( m_Spots.size() * m_Settings.Width );
+    m_ProfileY.resize( m_Spots.size() * m_Settings.Height );
+    m_Row.resize( m_Settings.Width );
+}
+
+template <typename T>
+void SimulatedCamera::storeRow( T *pDst, double dMax ) const
+{
+    const float fMax = static_cast<float>( dMax );
+    for( int x = 0; x < m_Row.size(); ++x )
+    {
+        /* clipping at full scale is what makes a bright beam saturate */
+        pDst[x] = static_cast<T>( std::min( fMax, std::max( 0.0f, m_Row[x] ) ) + 0.5f );
+    }
+}
+
+/* the beams are axis aligned gaussians, so every spot is the product of a horizontal and a vertical profile
+*  and a row costs one multiply add per pixel and spot instead of an exp */
+void SimulatedCamera::renderFrame( VmbUchar_t *pBuffer, VmbUint64_t nFrameID )
+{
+    const int       w       = m_Settings.Width;
+    const int       h       = m_Settings.Height;
+    const double    dMax    = fullScale( m_Settings.PixelFormat );
+    const double    drift   = TWO_PI * static_cast<double>( nFrameID ) / std::max( 1.0, m_Settings.DriftPeriod );
+
+    for( int s = 0; s < m_Spots.size(); ++s )
+    {
+        const Spot &spot    = m_Spots[s];
+        const double cx     = spot.m_CenterX + m_Settings.DriftAmplitude * std::cos( drift + spot.m_Phase );
+        const double cy     = spot.m_CenterY + m_Settings.DriftAmplitude * std::sin( drift + spot.m_Phase );
+        float *pProfileX    = m_ProfileX.data() + s * w;
+        float *pProfileY    = m_ProfileY.data() + s * h;
+        for( int x = 0; x < w; ++x )
+        {
+            const double d = ( x - cx ) / spot.m_SigmaX;
+            pProfileX[x] = static_cast<float>( spot.m_Amplitude * std::exp( -0.5 * d * d ) );
+        }
+        for( int y = 0; y < h; ++y )
+        {
+            const double d = ( y - cy ) / spot.m_SigmaY;
+            pProfileY[y] = static_cast<float>( std::exp( -0.5 * d * d ) );
+        }
+    }
+
+    std::minstd_rand random( static_cast<unsigned int>( m_Settings.Seed + nFrameID ) );
+    const float background = static_cast<float>( m_Settings.BackgroundLevel * dMax );
+    for( int y = 0; y < h; ++y )
+    {
+        const float *pNoise = m_Noise.data() + random() % NOISE_TABLE_SIZE;
+        for( int x = 0; x < w; ++x )
+        {
+            m_Row[x] = background + pNoise[x];
+        }
+        for( int s = 0; s < m_Spots.size(); ++s )
+        {
+            const float gy = m_ProfileY[s * h + y];
+            if( gy < PROFILE_CUTOFF )
+            {
+                continue;
+            }
+            const float *pProfileX = m_ProfileX.data() + s * w;
+            for( int x = 0; x < w; ++x )
+            {
+                m_Row[x] += pProfileX[x] * gy;
+            }
+        }
+        if( VmbPixelFormatMono8 == m_Settings.PixelFormat )
+        {
+            storeRow( pBuffer + y * w, dMax );
+        }
+        else
+        {
+            storeRow( reinterpret_cast<VmbUint16_t*>( pBuffer ) + y * w, dMax );
+        }
+    }
+}
+
+void SimulatedCamera::run()
+{
+    typedef std::chrono::steady_clock clock_type;
+    const clock_type::duration period = m_Settings.FrameRate > 0.0
+                                        ? std::chrono::duration_cast<clock_type::duration>( std::chrono::duration<double>( 1.0 / m_Settings.FrameRate ) )
+                                        : clock_type::duration::zero();
+    const BaseFrame     info( m_Settings.PixelFormat, m_Settings.Width, m_Settings.Height, payloadSize(), false );
+    const FramePoolPtr  pPool = SP_ACCESS( m_pFrameObs )->framePool();
+    clock_type::time_point next = clock_type::now();
+
+    while( !m_Stopping.load( std::memory_order_acquire ) )
+    {
+        const VmbUint64_t nFrameID = m_FrameID.load( std::memory_order_relaxed );
+        try
+        {
+            VmbUint32_t nCapacity = info.Size();
+            VmbUchar_t *pBuffer = pPool->Take( nCapacity );
+            const FrameDataPtr pData( pBuffer, FramePoolReturn( pPool, nCapacity ) );
+            renderFrame( pBuffer, nFrameID );
+            SP_ACCESS( m_pFrameObs )->FrameReceived( tFrameInfo( info, pData ), nFrameID );
+        }
+        catch( const std::bad_alloc& )
+        {
+            /* same as a frame the driver could not deliver, the id gap shows up in the camera fps */
+        }
+        m_FrameID.store( nFrameID + 1, std::memory_order_relaxed );
+
+        if( period != clock_type::duration::zero() )
+        {
+            next += period;
+            const clock_type::time_point now = clock_type::now();
+            if( next < now )
+            {
+                /* behind schedule, a real camera does not catch up with a burst either */
+                next = now;
+            }
+            std::this_thread::sleep_until( next );
+        }
+    }
+}
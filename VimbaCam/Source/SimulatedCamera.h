@@ -0,0 +1,97 @@
+
+
+#ifndef SIMULATEDCAMERA_H
+#define SIMULATEDCAMERA_H
+
+#include <QThread>
+#include <QVector>
+#include <atomic>
+
+#include "FrameObserver.h"
+
+/** settings of the synthetic frames produced by SimulatedCamera*/
+struct tSimulationSettings
+{
+    VmbPixelFormatType      PixelFormat;        // VmbPixelFormatMono8, VmbPixelFormatMono12 or VmbPixelFormatMono16
+    VmbUint32_t             Width;              // frame width
+    VmbUint32_t             Height;             // frame height
+    double                  FrameRate;          // frames per second, 0 runs flat out without backpressure, the consumer queue drops the oldest frames
+    int                     SpotCount;          // number of gaussian beams in the frame
+    double                  SpotSigma;          // beam sigma in pixels, further spots get slightly wider and elliptic
+    double                  PeakLevel;          // beam amplitude relative to full scale, above 1 the beams saturate
+    double                  BackgroundLevel;    // constant offset relative to full scale
+    double                  NoiseLevel;         // standard deviation of the additive noise relative to full scale
+    double                  DriftAmplitude;     // amplitude in pixels of the slow periodic drift of the beams
+    double                  DriftPeriod;        // drift period in frames
+    unsigned int            Seed;               // noise seed, equal seeds give equal frame sequences
+
+    tSimulationSettings()
+        : PixelFormat       ( VmbPixelFormatMono12 )
+        , Width             ( 1280 )
+        , Height            ( 1024 )
+        , FrameRate         ( 30.0 )
+        , SpotCount         ( 1 )
+        , SpotSigma         ( 40.0 )
+        , PeakLevel         ( 0.8 )
+        , BackgroundLevel   ( 0.02 )
+        , NoiseLevel        ( 0.01 )
+        , DriftAmplitude    ( 5.0 )
+        , DriftPeriod       ( 200.0 )
+        , Seed              ( 1 )
+    {}
+};
+
+/** software camera feeding synthetic Mono8/Mono12/Mono16 frames into a FrameObserver.
+* frames are rendered straight into buffers of the observer's frame pool and handed to the same
+* entry point Vimba frames take, so everything behind FrameObserver runs without a camera attached.
+*/
+class SimulatedCamera : public QThread
+{
+    /** one gaussian beam, centre without drift*/
+    struct Spot
+    {
+        double              m_CenterX;
+        double              m_CenterY;
+        double              m_SigmaX;
+        double              m_SigmaY;
+        double              m_Amplitude;        // in counts
+        double              m_Phase;            // drift phase
+    };
+
+    SP_DECL(FrameObserver)      m_pFrameObs;        // receiver of the frames
+    tSimulationSettings         m_Settings;
+    QVector<Spot>               m_Spots;
+    QVector<float>              m_Noise;            // gaussian noise table in counts, indexed from a random offset per row
+    QVector<float>              m_ProfileX;         // per spot horizontal profile, SpotCount * Width
+    QVector<float>              m_ProfileY;         // per spot vertical profile, SpotCount * Height
+    QVector<float>              m_Row;              // one rendered row before quantization
+    std::atomic<bool>           m_Stopping;
+    std::atomic<VmbUint64_t>    m_FrameID;          // id of the next frame, counts up from 0 on every start
+
+    SimulatedCamera( const SimulatedCamera& );
+    SimulatedCamera& operator=( const SimulatedCamera& );
+
+    void        setupScene      ();
+    void        renderFrame     ( VmbUchar_t *pBuffer, VmbUint64_t nFrameID );
+    template <typename T>
+    void        storeRow        ( T *pDst, double dMax ) const;
+protected:
+    virtual void run();
+public:
+    SimulatedCamera( const SP_DECL(FrameObserver) &pFrameObs, const tSimulationSettings &settings = tSimulationSettings() );
+    ~SimulatedCamera();
+
+    /** change the frame settings, only while stopped*/
+    void                        setSettings     ( const tSimulationSettings &settings );
+    const tSimulationSettings&  settings        () const { return m_Settings; }
+    /** start delivering frames, the observer must have been started*/
+    void                        StartCapture    ();
+    /** stop delivering frames and wait for the producer thread*/
+    void                        StopCapture     ();
+    /** frames delivered since the last start*/
+    VmbUint64_t                 frameCount      () const { return m_FrameID.load( std::memory_order_relaxed ); }
+    /** size in bytes of one frame*/
+    VmbUint32_t                 payloadSize     () const;
+};
+
+#endif
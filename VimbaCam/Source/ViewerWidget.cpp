@@ -4,11 +4,13 @@
 #include "VmbImageTransformHelper.hpp"
 #include "ExternLib/qcustomplot/qcustomplot.h"
 #include <tuple>
+#include <cmath>
 #include <filesystem>
 #include <utility>
 #include <QDebug>
 
 #include "UI/csvReader.h"
+#include "memcpy_threaded.h"
 
 using AVT::VmbAPI::Frame;
 using AVT::VmbAPI::FramePtr;
@@ -26,12 +28,17 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
     , m_bIsRedHighlighted(false)
     , m_bIsViewerWindowClosing(false)
     , m_bIsDisplayEveryFrame(false)
+    , m_dDisplayRate(0.0)
     , m_saveFileDialog(NULL)
     //, m_ImageOptionDialog(NULL)
     //, m_getDirDialog(NULL)
     //, m_bIsTriggeredByMultiSaveBtn(false)
     //, m_nNumberOfFramesToSave(0)
     , m_FrameBufferCount(BUFFER_COUNT)
+    , m_nBufferWindowMs(BUFFER_WINDOW_MS)
+    , m_nAnnouncedPayload(0)
+    , m_nBufferLosses(0)
+    , m_nSliderBitDepth(0)
     , m_pCam(pCam)
 {
     VmbError_t errorType;
@@ -46,6 +53,24 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
     m_DiagInfomation->setStyleSheet("background-color: rgb(255, 255, 255); font: 9pt;");//font: 10pt;
     m_InformationWindow = new MainInformationWindow(0, 0, m_pCam);
     m_InformationWindow->openLoggingWindow();
+    {
+        /* the first use starts the copy bandwidth measurement on its own thread, the choice is logged once it is done */
+        CopyThreadPool::Instance();
+        QTimer* copyPoolTimer = new QTimer(this);
+        connect(copyPoolTimer, &QTimer::timeout, this, [this, copyPoolTimer]() {
+            const CopyThreadPool& copyPool = CopyThreadPool::Instance();
+            if (!copyPool.isCalibrated())
+                return;
+            copyPoolTimer->stop();
+            copyPoolTimer->deleteLater();
+            m_InformationWindow->feedLogger("Logging", QString("Frame copy: %1 thread(s), split above %2 MB, streaming stores %3, %4 GB/s (memcpy %5 GB/s)")
+                .arg(copyPool.threadCount())
+                .arg(copyPool.threadCount() > 1 ? copyPool.splitThreshold() / (1024.0 * 1024.0) : 0.0, 0, 'f', 2)
+                .arg(copyPool.useStreaming() ? "on" : "off")
+                .arg(copyPool.poolBandwidth(), 0, 'f', 2)
+                .arg(copyPool.memcpyBandwidth(), 0, 'f', 2), VimbaViewerLogCategory_INFO); });
+        copyPoolTimer->start(100);
+    }
     QVBoxLayout* infoLayout = new QVBoxLayout(m_DiagInfomation);
     infoLayout->addWidget(m_InformationWindow);
     infoLayout->setContentsMargins(0, 0, 0, 0);
@@ -451,6 +476,13 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
     m_ContextMenu->addAction(m_aDiagInfo);
     connect(m_aDiagInfo, &QAction::triggered, this, [&]() {m_DiagInfomation->show(); });
 
+    m_aDiagLatency = new QAction("&Latency Diagnostics");
+    m_ContextMenu->addAction(m_aDiagLatency);
+    connect(m_aDiagLatency, &QAction::triggered, this, [&]() {
+        m_LatencyText->setPlainText(SP_ACCESS(m_pFrameObs)->latencyStats()->Report());
+        m_LatencyTimer->start();
+        m_DiagLatency->show(); });
+
     m_ContextMenu->addSeparator();
 
     m_aSetCurrScrROI = new QAction("SetCurrentRO&I");
@@ -511,6 +543,14 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
         m_aPlotFitter2D->isChecked() ? m_pImgCThread->toggleDoFitting2D(true) : m_pImgCThread->toggleDoFitting2D(false);
         m_QCP->replot(); });
 
+    m_aWarmStart = new QAction("Warm-Start Fits");
+    m_aWarmStart->setCheckable(true);
+    m_aWarmStart->setChecked(true);
+    m_aWarmStart->setToolTip("Start every fit from the last converged parameters instead of a guess from the frame");
+    m_ContextMenu->addAction(m_aWarmStart);
+    connect(m_aWarmStart, &QAction::triggered, this, [this]() {
+        m_pImgCThread->toggleWarmStart(m_aWarmStart->isChecked()); });
+
 
     m_aCscale = new QAction("Color Scale");
     m_ContextMenu->addAction(m_aCscale);
@@ -524,6 +564,29 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
     m_aManualCscale->setChecked(false);
     m_ContextMenu->addAction(m_aManualCscale);
 
+    m_aZeroCopy = new QAction("Zero-Copy Frames");
+    m_aZeroCopy->setCheckable(true);
+    m_aZeroCopy->setChecked(false);
+    m_aZeroCopy->setToolTip("Pass the camera buffers to the processing threads without copying, applied on the next start");
+    m_ContextMenu->addAction(m_aZeroCopy);
+    connect(m_aZeroCopy, &QAction::triggered, this, [this]() {
+        if (m_bIsCameraRunning)
+        {
+            m_InformationWindow->feedLogger("Logging", "Zero-copy mode will be applied on the next start of the acquisition", VimbaViewerLogCategory_INFO);
+        } });
+
+    m_aDisplayRate = new QAction("Display Rate...");
+    m_aDisplayRate->setToolTip("Plot updates per second, the analysis runs on every frame regardless");
+    m_ContextMenu->addAction(m_aDisplayRate);
+    connect(m_aDisplayRate, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        const double dRate = QInputDialog::getDouble(this, "Display Rate",
+            "Plot updates per second (0: screen refresh rate)", m_dDisplayRate, 0.0, 1000.0, 1, &ok);
+        if (ok)
+        {
+            m_dDisplayRate = dRate;
+            if (m_bIsCameraRunning) { checkDisplayInterval(); }
+        } });
 
 
     m_ContextMenu->addSeparator();
@@ -540,6 +603,96 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
     m_ContextMenu->addAction(m_aSaveImg);
     connect(m_aSaveImg, &QAction::triggered, this, &ViewerWidget::on_ActionSaveAs_triggered);
 
+    m_aSaveShots = new QAction("Save Shot Results...");
+    m_aSaveShots->setToolTip("Write the centroid and fit results of every analysed frame of the acquisition, plotted or not");
+    m_ContextMenu->addAction(m_aSaveShots);
+    connect(m_aSaveShots, &QAction::triggered, this, [this]() {
+        const QString sFile = QFileDialog::getSaveFileName(this, "Save Shot Results", m_SaveFileDir, "CSV (*.csv)");
+        if (sFile.isEmpty())
+            return;
+        m_SaveFileDir = QFileInfo(sFile).absolutePath();
+        const ShotResultsPtr& pShots = m_pImgCThread->shotResults();
+        if (pShots->WriteCsv(sFile))
+        {
+            const quint64 nLost = pShots->Overwritten();
+            m_InformationWindow->feedLogger("Logging", QString("%1 shot results saved to %2").arg(pShots->Recorded() - nLost).arg(sFile) +
+                (nLost > 0 ? QString(", the first %1 of the acquisition were overwritten").arg(nLost) : QString()), VimbaViewerLogCategory_OK);
+        }
+        else
+        {
+            m_InformationWindow->feedLogger("Logging", "Could not write shot results to " + sFile, VimbaViewerLogCategory_ERROR);
+        } });
+
+    m_aRecordRaw = new QAction("Record Raw Frames...");
+    m_aRecordRaw->setToolTip("Write the next frames unprocessed to one file, frames the disk cannot keep up with are skipped");
+    m_ContextMenu->addAction(m_aRecordRaw);
+    connect(m_aRecordRaw, &QAction::triggered, this, [this]() {
+        const QString sFile = QFileDialog::getSaveFileName(this, "Record Raw Frames", m_SaveFileDir, "Raw Recording (*.vcraw)");
+        if (sFile.isEmpty())
+            return;
+        bool ok = false;
+        const int nFrames = QInputDialog::getInt(this, "Record Raw Frames", "Number of frames", 100, 1, INT_MAX, 1, &ok);
+        if (ok)
+        {
+            const QFileInfo fileInfo(sFile);
+            m_SaveFileDir = fileInfo.absolutePath();
+            m_pFrameObs->saveRawData(nFrames, fileInfo.absolutePath(), fileInfo.fileName(), m_aRecordUnbuffered->isChecked());
+        } });
+
+    m_aRecordUnbuffered = new QAction("Unbuffered Recording");
+    m_aRecordUnbuffered->setCheckable(true);
+    m_aRecordUnbuffered->setChecked(false);
+    m_aRecordUnbuffered->setToolTip("Write raw recordings past the system file cache, applied on the next recording");
+    m_ContextMenu->addAction(m_aRecordUnbuffered);
+
+    m_aPretrigger = new QAction("Pre-trigger Buffer...");
+    m_aPretrigger->setCheckable(true);
+    m_aPretrigger->setChecked(false);
+    m_aPretrigger->setToolTip("Keep the raw frames of the last seconds in memory, so they can be saved after an event");
+    m_ContextMenu->addAction(m_aPretrigger);
+    m_aPretriggerDump = new QAction("Dump Pre-trigger Buffer");
+    m_aPretriggerDump->setShortcut(QKeySequence(Qt::Key_F9));
+    m_aPretriggerDump->setToolTip("Write the frames kept in memory to a new raw recording, acquisition goes on");
+    m_aPretriggerDump->setEnabled(false);
+    m_ContextMenu->addAction(m_aPretriggerDump);
+    /* the shortcut has to work without opening the menu */
+    addAction(m_aPretriggerDump);
+    connect(m_aPretrigger, &QAction::toggled, this, [this](bool checked) {
+        bool ok = !checked;
+        if (checked)
+        {
+            const double dSeconds = QInputDialog::getDouble(this, "Pre-trigger Buffer", "Seconds to keep", 5.0, 0.1, 3600.0, 1, &ok);
+            const int nMB = ok ? QInputDialog::getInt(this, "Pre-trigger Buffer", "Memory limit (MB)", 1024, 1, INT_MAX, 256, &ok) : 0;
+            if (ok)
+                m_pFrameObs->enablePretrigger(dSeconds, static_cast<quint64>(nMB) << 20);
+        }
+        else
+        {
+            m_pFrameObs->enablePretrigger(0.0, 0);
+        }
+        if (!ok)
+        {
+            /* cancelled, back to off without going through this again */
+            QSignalBlocker blocker(m_aPretrigger);
+            m_aPretrigger->setChecked(false);
+        }
+        m_aPretriggerDump->setEnabled(m_aPretrigger->isChecked()); });
+    connect(m_aPretriggerDump, &QAction::triggered, this, [this]() {
+        const QString sFile = QDir(m_SaveFileDir).filePath("pretrigger_" + QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss_zzz") + ".vcraw");
+        m_pFrameObs->dumpPretrigger(sFile); });
+
+    m_aBurst = new QAction("Burst Capture...");
+    m_aBurst->setToolTip("Capture frames to memory at the full camera rate, then analyze them and write them to a raw recording");
+    m_ContextMenu->addAction(m_aBurst);
+    connect(m_aBurst, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        const int nFrames = QInputDialog::getInt(this, "Burst Capture", "Number of frames", 500, 1, INT_MAX, 100, &ok);
+        if (ok)
+        {
+            const QString sFile = QDir(m_SaveFileDir).filePath("burst_" + QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss_zzz") + ".vcraw");
+            m_pFrameObs->startBurst(nFrames, sFile);
+        } });
+
 
     m_ContextMenu->addSeparator();
 
@@ -564,10 +717,10 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
     
     connect(SP_ACCESS(m_pFrameObs), SIGNAL(frameReadyFromObserverFullBitDepth(tFrameInfo)),
         this, SLOT(onFullBitDepthImageReady(tFrameInfo)));
-    connect(SP_ACCESS(m_pFrameObs), SIGNAL(setCurrentFPS(const QString&)),
-        this, SLOT(onSetCurrentFPS(const QString&)));
-    connect(SP_ACCESS(m_pFrameObs), SIGNAL(setFrameCounter(const unsigned int&)),
-        this, SLOT(onSetFrameCounter(const unsigned int&)));
+    connect(SP_ACCESS(m_pFrameObs), SIGNAL(frameStatistics(const tFrameStatistics&)),
+        this, SLOT(onFrameStatistics(const tFrameStatistics&)));
+    connect(SP_ACCESS(m_pFrameObs), SIGNAL(logging(const QString&)),
+        this, SLOT(onFeedLogger(const QString&)));
 
     connect(SP_ACCESS(m_pFrameObs)->ImageProcessThreadPtr().data(),
         &ImageProcessingThread::logging, this, &ViewerWidget::onFeedLogger);
@@ -591,25 +744,62 @@ ViewerWidget::ViewerWidget(QWidget* parent, Qt::WindowFlags flag,
         });
     
     connect(m_pImgCThread, &ImageCalculatingThread::logging, this, &ViewerWidget::onFeedLogger);
-    connect(m_pImgCThread, &ImageCalculatingThread::currentFormat, m_RSliderV, [this](QString format) {
-        if (0 == m_sSliderFormat.compare(format)) return;
-        if (0 == format.compare("Mono12")) {
-            m_RSliderV->SetRange(-4095, 0);
-            m_upperSB->setRange(0, 4095);
-            m_lowerSB->setRange(0, 4095);
-            m_sSliderFormat = format;
-        }
-        else if (0 == format.compare("Mono8")) {
-            m_RSliderV->SetRange(-255, 0);
-            m_upperSB->setRange(0, 255);
-            m_lowerSB->setRange(0, 255);
-            m_sSliderFormat = format;
+    connect(m_pImgCThread, &ImageCalculatingThread::currentFormat, m_RSliderV, [this](QString format, int bitDepth) {
+        if (m_nSliderBitDepth == bitDepth) return;
+        if (bitDepth >= 8 && bitDepth <= 16) {
+            const int nMax = (1 << bitDepth) - 1;
+            m_RSliderV->SetRange(-nMax, 0);
+            m_upperSB->setRange(0, nMax);
+            m_lowerSB->setRange(0, nMax);
+            m_nSliderBitDepth = bitDepth;
         }
         else {
-            m_InformationWindow->feedLogger("Logging", "I am curious how on earth do you get format other than Mono8/12", VimbaViewerLogCategory_ERROR);
+            m_InformationWindow->feedLogger("Logging", "I am curious how on earth do you get " + format + " with " + QString::number(bitDepth) + " bits", VimbaViewerLogCategory_ERROR);
         }
         });
 
+    /***********************************************************************/
+    /*latency diagnostics: per stage percentiles, refreshed while the dialog is shown*/
+    m_DiagLatency = new QDialog(this);
+    m_DiagLatency->setModal(false);
+    m_DiagLatency->setWindowTitle("Latency Diagnostics for " + sID);
+    m_DiagLatency->setWindowFlags(m_DiagLatency->windowFlags() & ~Qt::WindowContextHelpButtonHint);
+    m_LatencyText = new QPlainTextEdit(m_DiagLatency);
+    m_LatencyText->setReadOnly(true);
+    m_LatencyText->setLineWrapMode(QPlainTextEdit::NoWrap);
+    m_LatencyText->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    m_LatencyText->setMinimumSize(700, 240);
+    {
+        auto layout = new QVBoxLayout(m_DiagLatency);
+        layout->addWidget(m_LatencyText, 1);
+        auto layout1 = new QHBoxLayout();
+        layout1->setContentsMargins(0, 0, 0, 0);
+        layout1->addStretch(1);
+        auto resetB = new QPushButton("Reset");
+        auto saveB = new QPushButton("Save...");
+        layout1->addWidget(resetB);
+        layout1->addWidget(saveB);
+        layout->addLayout(layout1, 0);
+        connect(resetB, &QPushButton::clicked, this, [this]() {
+            SP_ACCESS(m_pFrameObs)->latencyStats()->Reset();
+            m_LatencyText->setPlainText(SP_ACCESS(m_pFrameObs)->latencyStats()->Report()); });
+        connect(saveB, &QPushButton::clicked, this, [this]() {
+            const QString sFile = QFileDialog::getSaveFileName(this, "Save Latency Statistics", m_SaveFileDir, "Text (*.txt)");
+            if (sFile.isEmpty()) return;
+            if (SP_ACCESS(m_pFrameObs)->latencyStats()->WriteReport(sFile))
+            {
+                m_InformationWindow->feedLogger("Logging", "Latency statistics saved to " + sFile, VimbaViewerLogCategory_OK);
+            }
+            else
+            {
+                m_InformationWindow->feedLogger("Logging", "Could not write latency statistics to " + sFile, VimbaViewerLogCategory_ERROR);
+            } });
+    }
+    m_LatencyTimer = new QTimer(m_DiagLatency);
+    m_LatencyTimer->setInterval(500);
+    connect(m_LatencyTimer, &QTimer::timeout, this, [this]() {
+        m_LatencyText->setPlainText(SP_ACCESS(m_pFrameObs)->latencyStats()->Report()); });
+    connect(m_DiagLatency, &QDialog::finished, m_LatencyTimer, &QTimer::stop);
 
     m_Timer = new QTimer(this);
     
@@ -852,9 +1042,31 @@ bool  ViewerWidget::getAdjustPacketSizeMessage(QString& sMessage)
     return false;
 }
 
-void ViewerWidget::onSetCurrentFPS(const QString& sFPS)
+void ViewerWidget::onFrameStatistics(const tFrameStatistics& statistics)
 {
-    m_FramerateButton->setText(QString::fromStdString(" FPS: ") + sFPS + " ");
+    m_FramesLabel->setText("Frames: " + QString::number(statistics.m_nFrames) + " ");
+
+    static const char token[] = { '-','\\','|','/' }; //quite interesting :) -zzp
+    QString fps(token[statistics.m_nFrames % 4]);
+    if (statistics.m_dReceivedFPS > 0.0)
+    {
+        fps = QString("Rcv:") + QString::number(static_cast<size_t>(statistics.m_dReceivedFPS * 100) / 100.0);
+        if (statistics.m_dCameraFPS > 0.0)
+        {
+            fps += " Cam:" + QString::number(static_cast<size_t>(statistics.m_dCameraFPS * 100) / 100.0);
+        }
+        if (statistics.m_dDisplayFPS > 0.0)
+        {
+            fps += " Dis:" + QString::number(static_cast<size_t>(statistics.m_dDisplayFPS * 100) / 100.0);
+        }
+    }
+    m_FramerateButton->setText(QString::fromStdString(" FPS: ") + fps + " " + statistics.m_sDrops + " "
+        + (statistics.m_sRecorder.isEmpty() ? QString() : statistics.m_sRecorder + " "));
+    if (m_bIsCameraRunning && m_BufferCheckTimer.isValid() && m_BufferCheckTimer.elapsed() >= BUFFER_CHECK_INTERVAL)
+    {
+        m_BufferCheckTimer.restart();
+        checkFrameBuffers();
+    }
 }
 
 void ViewerWidget::onResetFPS()
@@ -862,11 +1074,6 @@ void ViewerWidget::onResetFPS()
     SP_ACCESS(m_pFrameObs)->resetFrameCounter(false);
 }
 
-void ViewerWidget::onSetFrameCounter(const unsigned int& nNumberOfFrames)
-{
-    m_FramesLabel->setText("Frames: " + QString::number(nNumberOfFrames) + " ");
-}
-
 
 void ViewerWidget::onSetEventMessage(const QStringList& sMsg)
 {
@@ -949,10 +1156,16 @@ void ViewerWidget::onimageReadyFromCalc()
     m_ImageSizeButtonW->setText(",W: " + QString::number(w) + " ");
     onSetMousePosInCMap(&event);
     m_QCP->replot();
+    /* taking the trace lets the calculating thread prepare the next plot update */
+    FrameTrace trace = m_pImgCThread->takePlotTrace();
+    trace.Mark(FrameStage_Plotted);
     
+    /* labels from the plotted frame's metadata, no camera access */
     updateExposureTime();
     updateCameraGain();
     m_pImgCThread->mutex().unlock();
+
+    m_pImgCThread->latencyStats()->Record(trace);
     
     
 
@@ -1109,13 +1322,11 @@ void ViewerWidget::onFeedLogger(const QString& sMessage)
 
 void ViewerWidget::updateExposureTime()
 {
-    m_pImgCThread->updateExposureTime();
     m_ExposureTimeButton->setText("Exposure time (ms): " + QString::number(m_pImgCThread->exposureTime() / 1.0e3, 'f', 3));
 }
 
 void ViewerWidget::updateCameraGain()
 {
-    m_pImgCThread->updateCameraGain();
     m_CameraGainButton->setText("Gain (dB): " + QString::number(m_pImgCThread->cameraGain() ));
 }
 
@@ -1128,12 +1339,12 @@ void ViewerWidget::checkDisplayInterval()
         std::string sValue("");
         if (VmbErrorSuccess == pFeatMode->GetValue(sValue))
         {
-            /* display all received frames for SingleFrame and MultiFrame mode or if the user wants to have it */
+            /* display all analysed frames the gui keeps up with for SingleFrame and MultiFrame mode or if the user wants to have it */
             if (0 == sValue.compare("SingleFrame") || 0 == sValue.compare("MultiFrame") || m_bIsDisplayEveryFrame)
-                SP_ACCESS(m_pFrameObs)->setDisplayInterval(0);
-            /* display frame in a certain interval to save CPU consumption for continuous mode */
+                m_pImgCThread->setDisplayInterval(0);
+            /* update the display at the screen refresh or the chosen display rate for continuous mode, every frame is still analysed */
             else
-                SP_ACCESS(m_pFrameObs)->setDisplayInterval(1);
+                m_pImgCThread->setDisplayInterval(1000.0 / qMax(1.0, m_dDisplayRate > 0.0 ? m_dDisplayRate : QGuiApplication::primaryScreen()->refreshRate()));
         }
     }
 }
@@ -1145,6 +1356,87 @@ bool ViewerWidget::isStreamingAvailable()
     return (NULL == pStreamIDFeature) ? false : true;
 }
 
+/* frames for m_nBufferWindowMs at the current frame rate, at least BUFFER_COUNT and within BUFFER_MEMORY_BUDGET_MB above that.
+* without a readable frame rate, e.g. triggered, BUFFER_COUNT */
+unsigned int ViewerWidget::frameBufferCount(VmbInt64_t nPayload)
+{
+    double dFrameRate = 0.0;
+    const FeatureCachePtr& pCache = m_pFrameObs->featureCache();
+    if (VmbErrorSuccess != pCache->GetValue("AcquisitionFrameRateAbs", dFrameRate))
+        pCache->GetValue("AcquisitionFrameRate", dFrameRate);
+    const double dCount = ceil(qMax(0.0, dFrameRate) * m_nBufferWindowMs / 1000.0);
+    const double dBudget = nPayload > 0 ? (static_cast<double>(BUFFER_MEMORY_BUDGET_MB) * 1024.0 * 1024.0) / nPayload : BUFFER_COUNT;
+    return static_cast<unsigned int>(qMax(static_cast<double>(BUFFER_COUNT), qMin(dCount, floor(dBudget))));
+}
+
+/* frames the driver lost for want of a queued buffer: incomplete frames and, on GigE, the underrun counter */
+quint64 ViewerWidget::bufferLosses()
+{
+    quint64 nLosses = m_pFrameObs->dropStats()->Drops(FrameDrop_Incomplete);
+    VmbInt64_t nUnderrun = 0;
+    if (!SP_ISNULL(m_pUnderrunFeature) && VmbErrorSuccess == m_pUnderrunFeature->GetValue(nUnderrun) && nUnderrun > 0)
+        nLosses += nUnderrun;
+    return nLosses;
+}
+
+/* GUI thread while capturing. frames lost since the last check double the window the buffers cover,
+* the additional frames are announced and queued right away; if the driver refuses that they come with the next start.
+* losses are often the network and not the buffers, BUFFER_DECAY_INTERVAL without any halves the window for the next start */
+void ViewerWidget::checkFrameBuffers()
+{
+    const quint64 nLosses = bufferLosses();
+    if (nLosses <= m_nBufferLosses)
+    {
+        if (m_nBufferWindowMs > BUFFER_WINDOW_MS && m_LossFreeTimer.isValid() && m_LossFreeTimer.elapsed() >= BUFFER_DECAY_INTERVAL)
+        {
+            m_nBufferWindowMs = qMax(m_nBufferWindowMs / 2, BUFFER_WINDOW_MS);
+            m_LossFreeTimer.restart();
+        }
+        return;
+    }
+    m_LossFreeTimer.restart();
+    const quint64 nNewLosses = nLosses - m_nBufferLosses;
+    m_nBufferLosses = nLosses;
+    if (m_nBufferWindowMs >= MAX_BUFFER_WINDOW_MS)
+        return;
+    m_nBufferWindowMs = qMin(2 * m_nBufferWindowMs, MAX_BUFFER_WINDOW_MS);
+    const unsigned int nCount = frameBufferCount(m_nAnnouncedPayload);
+    if (nCount <= m_FrameBufferCount)
+    {
+        m_InformationWindow->feedLogger("Logging", QString("%1 frames lost, the frame buffers are at the memory budget (%2 buffers)")
+            .arg(nNewLosses).arg(m_FrameBufferCount), VimbaViewerLogCategory_WARNING);
+        return;
+    }
+    const unsigned int nPrevious = m_FrameBufferCount;
+    VmbError_t error = VmbErrorSuccess;
+    while (m_FrameBufferCount < nCount && VmbErrorSuccess == error)
+    {
+        FramePtr frame;
+        try
+        {
+            frame = FramePtr(new Frame(m_nAnnouncedPayload));
+        }
+        catch (std::bad_alloc&)
+        {
+            error = VmbErrorResources;
+            break;
+        }
+        error = frame->RegisterObserver(m_pFrameObs);
+        if (VmbErrorSuccess == error)
+            error = m_pCam->AnnounceFrame(frame);
+        if (VmbErrorSuccess == error)
+            error = m_pCam->QueueFrame(frame);
+        if (VmbErrorSuccess == error)
+            ++m_FrameBufferCount;
+    }
+    if (VmbErrorSuccess == error)
+        m_InformationWindow->feedLogger("Logging", QString("%1 frames lost, frame buffers grown from %2 to %3 (%4 ms)")
+            .arg(nNewLosses).arg(nPrevious).arg(m_FrameBufferCount).arg(m_nBufferWindowMs), VimbaViewerLogCategory_WARNING);
+    else
+        m_InformationWindow->feedLogger("Logging", QString("%1 frames lost, frame buffers grown from %2 to %3, %4 more with the next start: %5")
+            .arg(nNewLosses).arg(nPrevious).arg(m_FrameBufferCount).arg(nCount - m_FrameBufferCount).arg(Helper::mapReturnCodeToString(error)), VimbaViewerLogCategory_WARNING);
+}
+
 VmbError_t ViewerWidget::onPrepareCapture()
 {
     FeaturePtr pFeature;
@@ -1157,7 +1449,28 @@ VmbError_t ViewerWidget::onPrepareCapture()
         error = pFeature->GetValue(nPayload);
         if (VmbErrorSuccess == error)
         {
-            frames.resize(m_FrameBufferCount);
+            /* losses at another payload, another format or ROI, say nothing about this one */
+            if (nPayload != m_nAnnouncedPayload)
+                m_nBufferWindowMs = BUFFER_WINDOW_MS;
+            m_FrameBufferCount = frameBufferCount(nPayload);
+            m_nAnnouncedPayload = nPayload;
+            m_InformationWindow->feedLogger("Logging", QString("Announcing %1 frame buffers, %2 MB for %3 ms of frames")
+                .arg(m_FrameBufferCount).arg(m_FrameBufferCount * (nPayload / (1024.0 * 1024.0)), 0, 'f', 1).arg(m_nBufferWindowMs), VimbaViewerLogCategory_INFO);
+            /* leased frames stay out of the camera queue until the consumers release them */
+            m_pFrameObs->enableZeroCopy(m_aZeroCopy->isChecked());
+            frames.resize(m_aZeroCopy->isChecked() ? m_FrameBufferCount + LEASE_BUFFER_COUNT : m_FrameBufferCount);
+            if (!m_aZeroCopy->isChecked())
+            {
+                try
+                {
+                    m_pFrameObs->reserveFramePool(nPayload, LEASE_BUFFER_COUNT);
+                }
+                catch (std::bad_alloc&)
+                {
+                    /* not fatal, the pool allocates on demand */
+                    m_InformationWindow->feedLogger("Logging", "Failed to preallocate the frame pool, buffers will be allocated on demand", VimbaViewerLogCategory_WARNING);
+                }
+            }
 
             bool bIsStreamingAvailable = isStreamingAvailable();
 
@@ -1173,12 +1486,9 @@ VmbError_t ViewerWidget::onPrepareCapture()
                     catch (std::bad_alloc&)
                     {
                         frames.resize((VmbInt64_t)(nCounter * 0.7));
+                        m_FrameBufferCount = qMin(m_FrameBufferCount, static_cast<unsigned int>(frames.size()));
                         break;
                     }
-                    /*this is the key part to set the frame thread start to receive signal*/
-                    m_pFrameObs->Starting();
-                    /*the start() will do a lot of overhead to create the thread and it eventually call run()*/
-
                     error = frames[i]->RegisterObserver(m_pFrameObs);
                     if (VmbErrorSuccess != error)
                     {
@@ -1200,10 +1510,19 @@ VmbError_t ViewerWidget::onPrepareCapture()
                         return error;
                     }
                 }
+                /*this is the key part to set the frame thread start to receive signal, once per capture: it resets the
+                 session, the statistics and the pretrigger buffer*/
+                m_pFrameObs->Starting();
             }
 
             if (VmbErrorSuccess == error)
             {
+                /* only losses from here on grow the buffers; the counter's handle comes from the cache, not a lookup per check */
+                SP_RESET(m_pUnderrunFeature);
+                m_pFrameObs->featureCache()->GetFeature("StatFrameUnderrun", m_pUnderrunFeature);
+                m_nBufferLosses = bufferLosses();
+                m_BufferCheckTimer.start();
+                m_LossFreeTimer.start();
                 error = m_pCam->StartCapture();
                 if (VmbErrorSuccess != error)
                 {
@@ -1286,12 +1605,7 @@ void ViewerWidget::on_ActionFreerun_triggered()
         error = m_pCam->GetFeatureByName("AcquisitionStart", pFeat);
         int nResult = m_sAccessMode.compare(tr("(READ ONLY)"));
         
-        FeaturePtr pFeatFormat;
-        auto error2 = m_pCam->GetFeatureByName("PixelFormat", pFeatFormat);
-        QString Pixformat = m_Controller->getFeatureValue(pFeatFormat);
-        int nResult2 = Pixformat.compare("Mono12Packed");
-        
-        if ((VmbErrorSuccess == error) && (0 != nResult) && (VmbErrorSuccess == error2) && (0 != nResult2))
+        if ((VmbErrorSuccess == error) && (0 != nResult))
         {
             SP_ACCESS(m_pFrameObs)->resetFrameCounter(true);
 
@@ -1343,10 +1657,6 @@ void ViewerWidget::on_ActionFreerun_triggered()
 
             }
         }
-        else if ((VmbErrorSuccess == error2) && (0 == nResult2))
-        {
-            m_InformationWindow->feedLogger("Logging", "Please do NOT use Mono12Packed, we are not bandwidth limited and I am lazy to add that support", VimbaViewerLogCategory_ERROR);
-        }
     }
     /* OFF */
     else
@@ -1394,6 +1704,12 @@ VmbError_t ViewerWidget::releaseBuffer()
 {
     m_pFrameObs->Stopping();
     m_pImgCThread->StopProcessing();
+    const FramePoolPtr& pPool = m_pFrameObs->framePool();
+    if (pPool->Hits() + pPool->Misses() > 0)
+    {
+        m_InformationWindow->feedLogger("Logging", QString("Frame pool: %1 hits, %2 misses, high water %3 buffers")
+            .arg(pPool->Hits()).arg(pPool->Misses()).arg(pPool->HighWater()), VimbaViewerLogCategory_INFO);
+    }
     VmbError_t error = m_pCam->EndCapture();
     if (VmbErrorSuccess == error)
         error = m_pCam->FlushQueue();
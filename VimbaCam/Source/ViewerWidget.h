@@ -22,7 +22,13 @@ class ViewerWidget :  public QWidget
 public:
 protected:
 private:
-    static const unsigned int           BUFFER_COUNT = 7;
+    static const unsigned int           BUFFER_COUNT = 7;           // fewest frames announced, whatever the rate and payload
+    static const unsigned int           BUFFER_WINDOW_MS = 200;     // frames announced to cover this long at the current frame rate
+    static const unsigned int           MAX_BUFFER_WINDOW_MS = 1600;// the window doubles up to this while frames get lost
+    static const unsigned int           BUFFER_MEMORY_BUDGET_MB = 1024; // memory the announced frames may take
+    static const int                    BUFFER_CHECK_INTERVAL = 1000; // ms between the checks for lost frames while capturing
+    static const int                    BUFFER_DECAY_INTERVAL = 60000; // ms of capturing without losses after which the window halves again
+    static const unsigned int           LEASE_BUFFER_COUNT = 6; // frames the consumer queues may hold, leased in zero-copy mode or pooled copies otherwise
     static const unsigned int           IMAGES_COUNT = 50;
     QTimer* m_Timer;
     QString                             m_sCameraID;
@@ -39,10 +45,13 @@ private:
     QDialog*                            m_DiagController;
     QDialog*                            m_DiagInfomation;
     QDialog*                            m_DiagRSlider;
+    QDialog*                            m_DiagLatency;
+    QPlainTextEdit*                     m_LatencyText;
+    QTimer*                             m_LatencyTimer;
     RangeSlider*                        m_RSliderV;
     QSpinBox*                           m_upperSB;
     QSpinBox*                           m_lowerSB;
-    QString                             m_sSliderFormat;
+    int                                 m_nSliderBitDepth;
 
     MainInformationWindow*              m_InformationWindow;
     ControllerTreeWindow*               m_Controller;
@@ -84,16 +93,26 @@ private:
     QAction*                            m_aStartStopCap;
     QAction*                            m_aDiagCtrler;
     QAction*                            m_aDiagInfo;
+    QAction*                            m_aDiagLatency;
     QAction*                            m_aSetCurrScrROI;
     QAction*                            m_aResetFullROI;
     QAction*                            m_aPlotTracer;
     QAction*                            m_aPlotFitter;
     QAction*                            m_aPlotFitter2D;
+    QAction*                            m_aWarmStart;
     QAction*                            m_aCscale;
     QAction*                            m_aManualCscale;
+    QAction*                            m_aZeroCopy;
+    QAction*                            m_aDisplayRate;
     QAction*                            m_aSaveCamSetting;
     QAction*                            m_aLoadCamSetting;
     QAction*                            m_aSaveImg;
+    QAction*                            m_aSaveShots;
+    QAction*                            m_aRecordRaw;
+    QAction*                            m_aRecordUnbuffered;
+    QAction*                            m_aPretrigger;
+    QAction*                            m_aPretriggerDump;
+    QAction*                            m_aBurst;
     QAction*                            m_aCamlist;
     QAction*                            m_aDisconnect;
 
@@ -112,6 +131,7 @@ private:
     QFileDialog*                        m_saveFileDialog; // save an image
 
     bool                                m_bIsDisplayEveryFrame;
+    double                              m_dDisplayRate;     /* plot updates per second in continuous mode, 0 follows the screen refresh rate */
 
     /* Filter Pattern */
     LineEditCompleter*                  m_FilterPatternLineEdit;
@@ -134,7 +154,13 @@ private:
     //tFrameInfo                          m_FullBitDepthImage;
     //bool                                m_LibTiffAvailable;
 
-    unsigned int                        m_FrameBufferCount;
+    unsigned int                        m_FrameBufferCount;         // frames announced, without the zero-copy lease frames
+    unsigned int                        m_nBufferWindowMs;          // time the frame buffers cover, grows with lost frames
+    VmbInt64_t                          m_nAnnouncedPayload;        // payload size of the announced frames
+    quint64                             m_nBufferLosses;            // incomplete and underrun frames at the last check
+    AVT::VmbAPI::FeaturePtr             m_pUnderrunFeature;         // StatFrameUnderrun, resolved through the feature cache per capture, null without
+    QElapsedTimer                       m_BufferCheckTimer;
+    QElapsedTimer                       m_LossFreeTimer;            // capturing since the last lost frame or decay of the window
 
     /*tab extension*/
     //QVector<TabExtensionInterface*>     m_tabExtensionInterface; // Closed source injected
@@ -165,6 +191,9 @@ private:
     VmbError_t  releaseBuffer();
     void        checkDisplayInterval();
     bool        isStreamingAvailable();
+    unsigned int frameBufferCount(VmbInt64_t nPayload);
+    quint64     bufferLosses();
+    void        checkFrameBuffers();
     //void        changeEvent(QEvent* event);
     //bool        isDestPathWritable();
     //bool        checkUsedName(const QStringList& files);
@@ -214,8 +243,7 @@ private slots:
     void onFullBitDepthImageReady(tFrameInfo mFullImageInfo);
     
     void onSetEventMessage(const QStringList& sMsg);
-    void onSetCurrentFPS(const QString& sFPS);
-    void onSetFrameCounter(const unsigned int& nNumberOfFrames);
+    void onFrameStatistics(const tFrameStatistics& statistics);
     void onFeedLogger(const QString& sMessage);
     void onResetFPS();
     VmbError_t onPrepareCapture();
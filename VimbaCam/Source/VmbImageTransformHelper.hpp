@@ -1,7 +1,7 @@
 #ifndef VMB_IMAGE_TRANSFORM_HELPER_H_
 #define VMB_IMAGE_TRANSFORM_HELPER_H_
 
-#include "VimbaImageTransform\Include\VmbTransform.h"
+#include "VimbaImageTransform/Include/VmbTransform.h"
 #include <exception>
 #include <string>
 
@@ -0,0 +1,296 @@
+
+#include "memcpy_threaded.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define COPY_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    const size_t CALIBRATION_SIZE       = 32 * 1024 * 1024;  // large enough to be well above any L3
+    const size_t MIN_CHUNK              = 256 * 1024;        // smaller chunks do not pay for the wake up
+    const size_t MAX_COPY_THREADS       = 8;
+
+    /** pin the calling thread to one core, counting down from the last core so core 0 stays free for the driver*/
+    void pinThread( size_t index )
+    {
+        const unsigned int cores = std::max( 1u, std::thread::hardware_concurrency() );
+        const unsigned int core  = cores - 1 - static_cast<unsigned int>( index % cores );
+#ifdef _WIN32
+        SetThreadAffinityMask( GetCurrentThread(), DWORD_PTR( 1 ) << core );
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        CPU_SET( core, &set );
+        pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+#else
+        (void)core;
+#endif
+    }
+
+    /** GB/s for copying len bytes with f, best of a few runs*/
+    template <typename FUNC>
+    double measure( size_t len, FUNC f )
+    {
+        double best = 0.0;
+        for( int run = 0; run < 3; ++run )
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            f();
+            const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+            if( seconds > 0.0 )
+            {
+                best = std::max( best, len / seconds / 1.0e9 );
+            }
+        }
+        return best;
+    }
+}
+
+void stream_copy( void *dst, const void *src, size_t len )
+{
+#ifdef COPY_HAS_SSE2
+    char        *d = static_cast<char*>( dst );
+    const char  *s = static_cast<const char*>( src );
+    /* align the destination, streaming stores need 16 byte alignment */
+    const size_t head = std::min( len, ( 16 - ( reinterpret_cast<uintptr_t>( d ) & 15 ) ) & 15 );
+    std::memcpy( d, s, head );
+    d   += head;
+    s   += head;
+    len -= head;
+    const size_t blocks = len / 64;
+    for( size_t i = 0; i < blocks; ++i )
+    {
+        const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s ) );
+        const __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + 16 ) );
+        const __m128i c = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + 32 ) );
+        const __m128i e = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + 48 ) );
+        _mm_stream_si128( reinterpret_cast<__m128i*>( d ), a );
+        _mm_stream_si128( reinterpret_cast<__m128i*>( d + 16 ), b );
+        _mm_stream_si128( reinterpret_cast<__m128i*>( d + 32 ), c );
+        _mm_stream_si128( reinterpret_cast<__m128i*>( d + 48 ), e );
+        d += 64;
+        s += 64;
+    }
+    _mm_sfence();
+    std::memcpy( d, s, len - blocks * 64 );
+#else
+    std::memcpy( dst, src, len );
+#endif
+}
+
+CopyThreadPool& CopyThreadPool::Instance()
+{
+    static CopyThreadPool pool;
+    return pool;
+}
+
+CopyThreadPool::CopyThreadPool()
+    : m_Generation( 0 )
+    , m_Pending( 0 )
+    , m_JobStreaming( false )
+    , m_Quit( false )
+    , m_Calibrated( false )
+    , m_ThreadCount( 1 )
+    , m_SplitThreshold( static_cast<size_t>( -1 ) )
+    , m_UseStreaming( false )
+    , m_MemcpyBandwidth( 0.0 )
+    , m_PoolBandwidth( 0.0 )
+{
+    /* tens of MB allocated and copied a few times, not on the thread that happens to be first */
+    m_Calibration = std::thread( &CopyThreadPool::calibrate, this );
+}
+
+CopyThreadPool::~CopyThreadPool()
+{
+    m_Calibration.join();
+    stopThreads();
+}
+
+void CopyThreadPool::waitCalibrated()
+{
+    std::unique_lock<std::mutex> local_lock( m_CalibrationLock );
+    m_CalibrationDone.wait( local_lock, [this]() { return isCalibrated(); } );
+}
+
+void CopyThreadPool::startThreads( size_t count )
+{
+    m_Chunks.resize( count + 1 );
+    for( size_t i = 0; i < count; ++i )
+    {
+        m_Threads.push_back( std::thread( &CopyThreadPool::worker, this, i + 1 ) );
+    }
+}
+
+void CopyThreadPool::stopThreads()
+{
+    {
+        std::lock_guard<std::mutex> local_lock( m_Lock );
+        m_Quit = true;
+    }
+    m_JobAvailable.notify_all();
+    for( size_t i = 0; i < m_Threads.size(); ++i )
+    {
+        m_Threads[i].join();
+    }
+    m_Threads.clear();
+}
+
+void CopyThreadPool::worker( size_t index )
+{
+    pinThread( index );
+    size_t generation = 0;
+    for( ;; )
+    {
+        Chunk chunk;
+        bool  streaming;
+        {
+            std::unique_lock<std::mutex> local_lock( m_Lock );
+            m_JobAvailable.wait( local_lock, [this, generation]() { return m_Quit || m_Generation != generation; } );
+            if( m_Quit )
+            {
+                return;
+            }
+            generation  = m_Generation;
+            chunk       = m_Chunks[index];
+            streaming   = m_JobStreaming;
+        }
+        if( chunk.m_Size != 0 )
+        {
+            copyChunk( chunk.m_Dst, chunk.m_Src, chunk.m_Size, streaming );
+        }
+        {
+            std::lock_guard<std::mutex> local_lock( m_Lock );
+            if( --m_Pending == 0 )
+            {
+                m_JobDone.notify_one();
+            }
+        }
+    }
+}
+
+void CopyThreadPool::copyChunk( char *dst, const char *src, size_t len, bool streaming ) const
+{
+    if( streaming )
+    {
+        stream_copy( dst, src, len );
+    }
+    else
+    {
+        std::memcpy( dst, src, len );
+    }
+}
+
+void CopyThreadPool::copySplit( char *dst, const char *src, size_t len, size_t threads, bool streaming )
+{
+    /* chunks are multiples of 64 bytes so every thread streams whole cache lines */
+    const size_t chunk_len = ( len / threads ) & ~size_t( 63 );
+    {
+        std::lock_guard<std::mutex> local_lock( m_Lock );
+        for( size_t i = 1; i < m_Chunks.size(); ++i )
+        {
+            Chunk &chunk = m_Chunks[i];
+            chunk.m_Dst  = dst + i * chunk_len;
+            chunk.m_Src  = src + i * chunk_len;
+            chunk.m_Size = i < threads ? ( i + 1 == threads ? len - i * chunk_len : chunk_len ) : 0;
+        }
+        m_Pending       = m_Threads.size();
+        m_JobStreaming  = streaming;
+        ++m_Generation;
+    }
+    m_JobAvailable.notify_all();
+    copyChunk( dst, src, chunk_len, streaming );
+    std::unique_lock<std::mutex> local_lock( m_Lock );
+    m_JobDone.wait( local_lock, [this]() { return m_Pending == 0; } );
+}
+
+void CopyThreadPool::copy( void *dst, const void *src, size_t len, size_t maxThreads )
+{
+    if( !isCalibrated() )
+    {
+        std::memcpy( dst, src, len );
+        return;
+    }
+    size_t threads = m_ThreadCount;
+    if( maxThreads != 0 )
+    {
+        threads = std::min( threads, maxThreads );
+    }
+    threads = std::min( threads, std::max<size_t>( 1, len / MIN_CHUNK ) );
+    if( len <= m_SplitThreshold || threads < 2 )
+    {
+        std::memcpy( dst, src, len );
+        return;
+    }
+    std::lock_guard<std::mutex> call_lock( m_CallLock );
+    copySplit( static_cast<char*>( dst ), static_cast<const char*>( src ), len, threads, m_UseStreaming );
+}
+
+/* calibration thread: measures memcpy against split copies with and without streaming stores,
+*  then picks the fastest thread count and the smallest size where splitting wins.
+*  copy does not touch the pool before m_Calibrated, the split copies here have it to themselves */
+void CopyThreadPool::calibrate()
+{
+    const size_t cores = std::max( 1u, std::thread::hardware_concurrency() );
+    const size_t max_threads = std::min( MAX_COPY_THREADS, std::max<size_t>( 1, cores / 2 ) );
+    startThreads( max_threads - 1 );
+    std::vector<char> src( CALIBRATION_SIZE, 1 );
+    std::vector<char> dst( CALIBRATION_SIZE, 0 );   // touched, so page faults do not count
+
+    const double memcpyBandwidth = measure( CALIBRATION_SIZE, [&]() { std::memcpy( dst.data(), src.data(), CALIBRATION_SIZE ); } );
+    double best = memcpyBandwidth;
+    size_t threadCount = 1;
+    bool useStreaming = false;
+    for( size_t threads = 2; threads <= max_threads; ++threads )
+    {
+        for( int streaming = 0; streaming < 2; ++streaming )
+        {
+            const double bandwidth = measure( CALIBRATION_SIZE, [&]() { copySplit( dst.data(), src.data(), CALIBRATION_SIZE, threads, streaming != 0 ); } );
+            if( bandwidth > best * 1.05 )   // only switch for a clear win
+            {
+                best            = bandwidth;
+                threadCount     = threads;
+                useStreaming    = streaming != 0;
+            }
+        }
+    }
+    size_t splitThreshold = static_cast<size_t>( -1 );
+    if( threadCount > 1 )
+    {
+        for( size_t len = 2 * MIN_CHUNK; len <= CALIBRATION_SIZE; len *= 2 )
+        {
+            const double single = measure( len, [&]() { std::memcpy( dst.data(), src.data(), len ); } );
+            const double split  = measure( len, [&]() { copySplit( dst.data(), src.data(), len, threadCount, useStreaming ); } );
+            if( split > single )
+            {
+                splitThreshold = len / 2;
+                break;
+            }
+        }
+    }
+    m_MemcpyBandwidth   = memcpyBandwidth;
+    m_PoolBandwidth     = best;
+    m_ThreadCount       = threadCount;
+    m_UseStreaming      = useStreaming;
+    m_SplitThreshold    = splitThreshold;
+    {
+        std::lock_guard<std::mutex> local_lock( m_CalibrationLock );
+        m_Calibrated.store( true, std::memory_order_release );
+    }
+    m_CalibrationDone.notify_all();
+}
@@ -1,61 +1,97 @@
+
+
 #ifndef MEMCPY_THREADED_H_
 #define MEMCPY_THREADED_H_
 
 #include <cstring>
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/** copy with non temporal (streaming) stores, the destination does not go through the cache.
+* falls back to memcpy where SSE2 is not available
+*/
+void stream_copy( void *dst, const void *src, size_t len );
 
-#include <QFuture>
-#include <QFutureSynchronizer>
-#include <QtConcurrentRun>
-/** runable for memcopy/memmove 
+/** persistent pool of pinned copy threads.
+* the threads are started once and wait for copy jobs, the calling thread copies the first chunk itself.
+* the number of threads, the size above which a copy gets split and whether streaming stores pay off
+* are measured once, on a thread of its own started by the first Instance() call. copies before the
+* measurement is done are plain memcpy, the caller is never held up by it.
 */
-struct copy_runable
+class CopyThreadPool
 {
-    void*       m_Src;      // source data pointer
-    void*       m_Dst;      // destination data pointer
-    size_t      m_Size;     // size to copy
-    /** run will execute the memcopy.
-    */
-    void run( ) const
+    /** one chunk of a copy job*/
+    struct Chunk
     {
-        std::memmove( m_Dst, m_Src, m_Size );
-    }
+        char*           m_Dst;      // destination data pointer
+        const char*     m_Src;      // source data pointer
+        size_t          m_Size;     // size to copy
+    };
+    std::vector<std::thread>    m_Threads;
+    std::vector<Chunk>          m_Chunks;           // one per worker thread
+    std::mutex                  m_Lock;             // guards the job state below
+    std::condition_variable     m_JobAvailable;
+    std::condition_variable     m_JobDone;
+    size_t                      m_Generation;       // incremented for every job
+    size_t                      m_Pending;          // workers still copying the current job
+    bool                        m_JobStreaming;     // current job uses streaming stores
+    bool                        m_Quit;
+    std::mutex                  m_CallLock;         // one copy job at a time
+    std::thread                 m_Calibration;      // runs calibrate once
+    std::atomic<bool>           m_Calibrated;       // the members below are set, released by calibrate
+    std::mutex                  m_CalibrationLock;
+    std::condition_variable     m_CalibrationDone;
+
+    size_t                      m_ThreadCount;      // threads used for a split copy, including the caller
+    size_t                      m_SplitThreshold;   // copies up to this size are done by the caller alone
+    bool                        m_UseStreaming;     // streaming stores were faster for large copies
+    double                      m_MemcpyBandwidth;  // GB/s of a plain memcpy measured at startup
+    double                      m_PoolBandwidth;    // GB/s of the chosen split copy measured at startup
+
+    CopyThreadPool();
+    ~CopyThreadPool();
+    CopyThreadPool( const CopyThreadPool& );
+    CopyThreadPool& operator=( const CopyThreadPool& );
+
+    void    startThreads    ( size_t count );
+    void    stopThreads     ();
+    void    worker          ( size_t index );
+    void    calibrate       ();
+    void    copySplit       ( char *dst, const char *src, size_t len, size_t threads, bool streaming );
+    void    copyChunk       ( char *dst, const char *src, size_t len, bool streaming ) const;
+public:
+    static CopyThreadPool& Instance();
+
+    /** copy len bytes, splitting across at most maxThreads threads (0 for the measured count)*/
+    void    copy            ( void *dst, const void *src, size_t len, size_t maxThreads = 0 );
+
+    /** the measurement is done, the values below are valid*/
+    bool    isCalibrated    () const { return m_Calibrated.load( std::memory_order_acquire ); }
+    /** block until the measurement is done*/
+    void    waitCalibrated  ();
+    size_t  threadCount     () const { return m_ThreadCount; }
+    size_t  splitThreshold  () const { return m_SplitThreshold; }
+    bool    useStreaming    () const { return m_UseStreaming; }
+    double  memcpyBandwidth () const { return m_MemcpyBandwidth; }
+    double  poolBandwidth   () const { return m_PoolBandwidth; }
 };
-/** thread function for a copy
+
+/** multi threaded mem copy with the measured thread count
 */
-inline void copy_fun(copy_runable* prm)
+inline void memcpy_threaded( void *dst, const void *src, size_t len )
 {
-    prm->run();
+    CopyThreadPool::Instance().copy( dst, src, len );
 }
-/** multi threaded mem copy
+/** multi threaded mem copy, using at most THREAD_COUNT threads
 */
 template <size_t THREAD_COUNT>
-inline void memcpy_threaded( void *dst,void*src, size_t len)
+inline void memcpy_threaded( void *dst, const void *src, size_t len )
 {
-    if( len <= 0x200000) // if within L3 cache size use memcopy
-    {
-        std::memmove( dst, src, len);
-        return;
-    }
-    size_t                      copy_len = len/THREAD_COUNT;
-    copy_runable                prm[THREAD_COUNT];
-    QFutureSynchronizer<void>   RoadBlock;
-    for( size_t i = 0; i < THREAD_COUNT; ++ i)
-    {
-        prm[i].m_Src    = src;
-        prm[i].m_Dst    = dst;
-        prm[i].m_Size   = copy_len;
-
-        RoadBlock.addFuture( QtConcurrent::run( copy_fun, &prm[i]) );
-
-        src             = (char*)src + copy_len;
-        dst             = (char*)dst + copy_len;
-        len            -= copy_len;
-        if( len < copy_len)
-        {
-            copy_len = len;
-        }
-    }
-    RoadBlock.waitForFinished();
+    CopyThreadPool::Instance().copy( dst, src, len, THREAD_COUNT );
 }
 
-#endif
\ No newline at end of file
+#endif
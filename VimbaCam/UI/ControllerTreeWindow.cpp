@@ -1,7 +1,9 @@
 ﻿//Description: All about features control tree
 
 /* define this to use std::numeric_limits */
+#ifndef NOMINMAX
 #define NOMINMAX
+#endif
 
 #include <limits>
 #include <iostream>
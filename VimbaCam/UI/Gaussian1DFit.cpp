@@ -1,4 +1,5 @@
 #include "Gaussian1DFit.h"
+#include "FitWorkspaceCache.h"
 
 
 
@@ -24,11 +25,6 @@ Gaussian1DFit::Gaussian1DFit(size_t n, double* datax, double* datay,
     confid95 = gsl_vector_alloc(numOfPara);
     p0 = gsl_vector_alloc(numOfPara);
     set_initialP(a0, b0, c0, d0);
-
-    work = gsl_multifit_nlinear_alloc(
-        gsl_multifit_nlinear_trust, &fdf_params, n, numOfPara);
-    f = gsl_multifit_nlinear_residual(work);
-    p = gsl_multifit_nlinear_position(work);
 }
 
 double Gaussian1DFit::gaussian
@@ -207,9 +203,9 @@ void Gaussian1DFit::set_data(size_t n, double* datax, double* datay, bool free)
     fit_data.y = datay;
 
     fdf.n = n;
-    if (free) { gsl_multifit_nlinear_free(work); }
-    work = gsl_multifit_nlinear_alloc(
-        gsl_multifit_nlinear_trust, &fdf_params, n, numOfPara);
+    /* the workspace goes back to the cache and comes out again unless the size changed */
+    if (free) { FitWorkspaceCache::release(fdf_params, work); }
+    work = FitWorkspaceCache::acquire(fdf_params, n, numOfPara);
     f = gsl_multifit_nlinear_residual(work);
     p = gsl_multifit_nlinear_position(work);
 }
@@ -224,7 +220,7 @@ void Gaussian1DFit::set_initialP(double a0, double b0, double c0, double d0)
 
 Gaussian1DFit::~Gaussian1DFit()
 {
-    gsl_multifit_nlinear_free(work);
+    FitWorkspaceCache::release(fdf_params, work);
     gsl_vector_free(p0);   
     gsl_matrix_free(covar);
 }
\ No newline at end of file
@@ -53,6 +53,15 @@ public:
     void set_data(double* datay);
     void set_data(size_t n, double* datax, double* datay, bool free = true);
     void set_initialP(double a0, double b0, double c0, double d0);
+    void set_initialP(const QVector<double>& para) { set_initialP(para.at(0), para.at(1), para.at(2), para.at(3)); }
+
+    int getInfo() const { return info; }
+    /* the last solve_system stopped on one of the tolerances, not on max_iter or a failed first step */
+    bool converged() const { return info >= 1 && info <= 3; }
+    size_t getIterations() const { return gsl_multifit_nlinear_niter(work); }
+    double getRss() const { return rss; }
+    /* no time budget, for FitWarmStart which treats both fits alike */
+    bool expired() const { return false; }
 
     static double gaussian(const double a, const double b, const double c, const double d, const double t);
     QVector<double> calcFittedGaussian();
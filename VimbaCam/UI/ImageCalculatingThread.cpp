@@ -2,6 +2,7 @@
 #include <utility>
 #include <numeric>
 #include <array>
+#include <tuple>
 
 using AVT::VmbAPI::Frame;
 using AVT::VmbAPI::FramePtr;
@@ -23,24 +24,43 @@ ImageCalculatingThread::ImageCalculatingThread(
     , m_pQCPleftGraph(pleft)
     , m_width(0)
     , m_height(0)
+    , m_heightMax(0)
+    , m_widthMax(0)
     , m_offsetX(0)
     , m_offsetY(0)
-    , m_format("")
+    , m_format(VmbPixelFormatMono8)
+    , m_bitDepth(8)
+    , m_sFormat("")
     , m_exposureTime(0.0)
+    , m_cameraGain(0.0)
     , m_firstStart(true)
-    , m_dataValid(false)
     , m_Stopping(false)
     , m_mousePos(0, 0)
     , m_doFitting(true)
     , m_doFitting2D(false)
+    , m_doWarmStart(true)
+    , m_plotPending(false)
+    , m_displayInterval(0.0)
     , m_gfitBottom(5, NULL, NULL, 0, 0, 0, 0) /*5 is greater than fit param 4, otherwise will break*/
     , m_gfitLeft(5, NULL, NULL, 0, 0, 0, 0)
     , m_gfit2D(16, 4, 4, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, 100) /* emulating 4*4 matrix */
 {
     m_pProcessingThread = QSharedPointer<ImageProcessingThread>(SP_ACCESS(m_pFrameObs)->ImageProcessThreadPtr());
-    /*get the max width and height*/
+    m_pLatencyStats = SP_ACCESS(m_pFrameObs)->latencyStats();
+    m_pDropStats = SP_ACCESS(m_pFrameObs)->dropStats();
+    m_pFeatureCache = SP_ACCESS(m_pFrameObs)->featureCache();
+    m_pShots = ShotResultsPtr(new ShotResults());
+    /*the fit queue holds two frames, the render queue only the latest, older ones are dropped.
+    a frame pushed out of the fit queue still leaves its moments in the shot results*/
+    m_pFitStage = QSharedPointer<AnalysisStage>(new AnalysisStage(2,
+        [this](AnalysisFramePtr& pFrame) { fitFrame(pFrame); },
+        [this](AnalysisFramePtr& pFrame) { recordShot(*pFrame); dropFrame(FrameDrop_Fit, pFrame); }));
+    m_pRenderStage = QSharedPointer<AnalysisStage>(new AnalysisStage(1,
+        [this](AnalysisFramePtr& pFrame) { renderFrame(pFrame); },
+        [this](AnalysisFramePtr& pFrame) { dropFrame(FrameDrop_Display, pFrame); }));
+    /*get the max width and height, there is no camera behind simulated frames*/
     FeaturePtr pFeat;
-    if (VmbErrorSuccess == m_pCam->GetFeatureByName("HeightMax", pFeat))
+    if (!SP_ISNULL(m_pCam) && VmbErrorSuccess == m_pCam->GetFeatureByName("HeightMax", pFeat))
     {
         VmbInt64_t  nValue64 = 0;
         if (VmbErrorSuccess == pFeat->GetValue(nValue64))
@@ -48,7 +68,7 @@ ImageCalculatingThread::ImageCalculatingThread(
             m_heightMax = nValue64;
         }
     }
-    if (VmbErrorSuccess == m_pCam->GetFeatureByName("WidthMax", pFeat))
+    if (!SP_ISNULL(m_pCam) && VmbErrorSuccess == m_pCam->GetFeatureByName("WidthMax", pFeat))
     {
         VmbInt64_t  nValue64 = 0;
         if (VmbErrorSuccess == pFeat->GetValue(nValue64))
@@ -61,9 +81,6 @@ ImageCalculatingThread::ImageCalculatingThread(
     updateExposureTime();
     updateXYOffset();
 
-    m_doubleCrxX.reserve(m_widthMax);
-    m_doubleCrxY.reserve(m_heightMax);
-
 }
 
 ImageCalculatingThread::~ImageCalculatingThread()
@@ -78,58 +95,63 @@ void ImageCalculatingThread::updateMousePos(QMouseEvent* event)
 
 void ImageCalculatingThread::updateExposureTime()
 {
-    FeaturePtr pFeat;
+    if (SP_ISNULL(m_pCam))
+    {
+        return;
+    }
     double  dValue = 0;
-    if (VmbErrorSuccess == m_pCam->GetFeatureByName("ExposureTimeAbs", pFeat))
+    auto tmp = m_pFeatureCache->GetValue("ExposureTimeAbs", dValue);
+    if (VmbErrorNotFound == tmp)
     {
-        auto tmp = pFeat->GetValue(dValue);
-        if (VmbErrorSuccess != tmp)
-        {
-            emit logging("Failed to get Exposure time, error code: " + QString::number(tmp));
-            return;
-        }
-        m_exposureTime = dValue;
+        return;
     }
+    if (VmbErrorSuccess != tmp)
+    {
+        emit logging("Failed to get Exposure time, error code: " + QString::number(tmp));
+        return;
+    }
+    m_exposureTime = dValue;
 }
 
 void ImageCalculatingThread::updateCameraGain()
 {
-    FeaturePtr pFeat;
+    if (SP_ISNULL(m_pCam))
+    {
+        return;
+    }
     double  dValue = 0;
-    if (VmbErrorSuccess == m_pCam->GetFeatureByName("Gain", pFeat))
+    auto tmp = m_pFeatureCache->GetValue("Gain", dValue);
+    if (VmbErrorNotFound == tmp)
     {
-        auto tmp = pFeat->GetValue(dValue);
-        if (VmbErrorSuccess != tmp)
-        {
-            emit logging("Failed to get Gain, error code: " + QString::number(tmp));
-            return;
-        }
-        m_cameraGain = dValue;
+        return;
     }
+    if (VmbErrorSuccess != tmp)
+    {
+        emit logging("Failed to get Gain, error code: " + QString::number(tmp));
+        return;
+    }
+    m_cameraGain = dValue;
 }
 
 void ImageCalculatingThread::updateXYOffset()
 {
-    FeaturePtr pFeat;
+    if (SP_ISNULL(m_pCam))
+    {
+        return;
+    }
     VmbInt64_t xlower = 0;
     VmbInt64_t ylower = 0;
-    if (VmbErrorSuccess == m_pCam->GetFeatureByName("OffsetX", pFeat))
+    auto tmp = m_pFeatureCache->GetValue("OffsetX", xlower);
+    if (VmbErrorSuccess != tmp && VmbErrorNotFound != tmp)
     {
-        auto tmp = pFeat->GetValue(xlower);
-        if (VmbErrorSuccess != tmp)
-        {
-            emit logging("image calculating thread get XY offset failed for X, error code: " + QString::number(tmp));
-            return;
-        }
+        emit logging("image calculating thread get XY offset failed for X, error code: " + QString::number(tmp));
+        return;
     }
-    if (VmbErrorSuccess == m_pCam->GetFeatureByName("OffsetY", pFeat))
+    tmp = m_pFeatureCache->GetValue("OffsetY", ylower);
+    if (VmbErrorSuccess != tmp && VmbErrorNotFound != tmp)
     {
-        auto tmp = pFeat->GetValue(ylower);
-        if (VmbErrorSuccess != tmp)
-        {
-            emit logging("image calculating thread get XY offset failed for Y, error code: " + QString::number(tmp));
-            return;
-        }
+        emit logging("image calculating thread get XY offset failed for Y, error code: " + QString::number(tmp));
+        return;
     }
 
     m_offsetX = xlower;
@@ -159,62 +181,123 @@ void ImageCalculatingThread::StartProcessing()
 {
     m_Stopping = false;
     m_firstStart = true;
-    m_dataValid = false;
+    {
+        QMutexLocker guard(&m_PlotTraceLock);
+        m_plotPending = false;
+    }
+    m_displayTimer.invalidate();
+    m_pShots->Clear();
     updateXYOffset();
     updateExposureTime();
+    m_gfit2D.setCancelled(false);
+    for (auto* warm : { &m_warmBottom, &m_warmLeft, &m_warm2D })
+    {
+        warm->resetCounters();
+    }
+    /*downstream first, so no stage pushes into a stopped one*/
+    m_pRenderStage->StartProcessing();
+    m_pFitStage->StartProcessing();
+    m_pProcessingThread->analysisQueue().StartProcessing();
     start();
 }
 
 void ImageCalculatingThread::StopProcessing()
 {
-
-    m_pProcessingThread->mutex().lock();
     m_Stopping = true;
-    m_pProcessingThread->mutex().unlock();
+    /*a 2D fit in progress ends after its current evaluation instead of running out its budget*/
+    m_gfit2D.setCancelled(true);
+    /*upstream first, frames still queued are dropped*/
+    m_pProcessingThread->analysisQueue().StopProcessing();
+    wait();
+    m_pFitStage->StopProcessing();
+    m_pRenderStage->StopProcessing();
+    /*the fit stage is joined, refits of the last frame while stopped get a full solve*/
+    m_gfit2D.setCancelled(false);
 
-    m_pProcessingThread->calcWait().wakeOne();
-    m_pProcessingThread->calcWait().wakeOne();
-    
-    
     m_firstStart = true;
-    m_dataValid = false;
     updateXYOffset();
     updateExposureTime();
 
-    wait();
+    /*the stages are stopped, the counters hold still*/
+    if (m_warmBottom.fitCount() > 0)
+    {
+        emit logging(m_warmBottom.summary("1D fit x") + ", " + m_warmLeft.summary("y"));
+    }
+    if (m_warm2D.fitCount() > 0)
+    {
+        emit logging(m_warm2D.summary("2D fit"));
+    }
+}
+
+void ImageCalculatingThread::retireFrame(AnalysisFramePtr& pFrame)
+{
+    m_pLatencyStats->Record(pFrame->m_Trace);
+    m_pProcessingThread->framePool().Recycle(pFrame);
+}
+
+void ImageCalculatingThread::dropFrame(FrameDropReason reason, AnalysisFramePtr& pFrame)
+{
+    m_pDropStats->Count(reason);
+    retireFrame(pFrame);
 }
 
-/*should only be called in the run, with the guard of mutex and everything properly initialized*/
-void ImageCalculatingThread::calcCrossSectionXY()
+/*reductions stage only, frame holds the samples vec1d and gets the sums and keys.
+sums are integer, a 16 bit row or column can not overflow 64 bit*/
+template <class T>
+void ImageCalculatingThread::calcCrossSectionXY(const QVector<T>& vec1d, AnalysisFrame& frame)
 {
-    m_doubleCrxX.clear();
-    m_doubleCrxY.clear();
-    for (size_t i = 0; i < m_height; i++)
+    const int height = frame.m_Height;
+    const int width = frame.m_Width;
+    frame.m_CrxY.resize(height);
+    for (size_t i = 0; i < height; i++)
     {
-        m_doubleCrxY.insert(i, std::accumulate(m_doubleQVector.begin() + i * m_width,
-            m_doubleQVector.begin() + (i + 1) * m_width, 0));
+        frame.m_CrxY[i] = std::accumulate(vec1d.begin() + i * width,
+            vec1d.begin() + (i + 1) * width, quint64(0));
     } 
     double i = 0.0;
-    m_leftKey = QVector<double>(m_height, m_offsetY);
-    std::for_each(m_leftKey.begin(), m_leftKey.end(), [i](auto& key) mutable {key = key + i; i++; });
-    m_pQCPleftGraph->setData(m_leftKey, m_doubleCrxY, true);
+    frame.m_KeyY.fill(frame.m_OffsetY, height);
+    std::for_each(frame.m_KeyY.begin(), frame.m_KeyY.end(), [i](auto& key) mutable {key = key + i; i++; });
 
-    for (size_t i = 0; i < m_width; i++)
+    /*column sums row by row, the image is walked in memory order*/
+    m_colSums.fill(0, width);
+    quint64* sums = m_colSums.data();
+    for (size_t j = 0; j < height; j++)
     {
-        double tmp = 0.0;
-        //std::for_each_n(m_doubleQVector.begin(), m_height, [](auto& n) {tmp += n; });
-        for (size_t j = 0; j < m_height; j++)
+        const T* row = vec1d.constData() + j * width;
+        for (size_t i = 0; i < width; i++)
         {
-            tmp += m_doubleQVector[i + j * m_width];
+            sums[i] += row[i];
         }
-        m_doubleCrxX.insert(i, tmp);
     }
+    frame.m_CrxX.resize(width);
+    std::copy(m_colSums.begin(), m_colSums.end(), frame.m_CrxX.begin());
     double ii = 0.0;
-    m_bottomKey = QVector<double>(m_width, m_offsetX);
-    std::for_each(m_bottomKey.begin(), m_bottomKey.end(), [ii](auto& key) mutable {key = key + ii; ii++; });
-    m_pQCPbottomGraph->setData(m_bottomKey, m_doubleCrxX, true);
-    
+    frame.m_KeyX.fill(frame.m_OffsetX, width);
+    std::for_each(frame.m_KeyX.begin(), frame.m_KeyX.end(), [ii](auto& key) mutable {key = key + ii; ii++; });
+}
 
+void ImageCalculatingThread::plotCrossSectionXY(AnalysisFrame& frame)
+{
+    m_pQCPleftGraph->setData(frame.m_KeyY, frame.m_CrxY, true);
+    m_pQCPbottomGraph->setData(frame.m_KeyX, frame.m_CrxX, true);
+}
+
+/*the plot is only updated when the gui replotted the previous update and the display interval passed*/
+bool ImageCalculatingThread::displayDue()
+{
+    {
+        QMutexLocker guard(&m_PlotTraceLock);
+        if (m_plotPending)
+        {
+            return false;
+        }
+    }
+    if (m_displayTimer.isValid() && m_displayTimer.elapsed() < m_displayInterval)
+    {
+        return false;
+    }
+    m_displayTimer.start();
+    return true;
 }
 
 void ImageCalculatingThread::setDefaultView()
@@ -252,11 +335,10 @@ QVector<double> ImageCalculatingThread::rawImageDefinite()
     QVector<double> tmp;
     while (time.elapsed() < 300)
     {
-        if (!m_doubleQVector.isEmpty())
+        QMutexLocker guard(&m_PlotLock);
+        if (!m_pLastFrame.isNull() && !m_pLastFrame->m_Samples.isEmpty())
         {
-            m_pProcessingThread->mutex().lock();
-            tmp = QVector(m_doubleQVector);
-            m_pProcessingThread->mutex().unlock();
+            widen_samples(m_pLastFrame->m_Samples, tmp);
             return tmp;
         }
     }
@@ -264,227 +346,431 @@ QVector<double> ImageCalculatingThread::rawImageDefinite()
     
 }
 
+FrameTrace ImageCalculatingThread::takePlotTrace()
+{
+    QMutexLocker guard(&m_PlotTraceLock);
+    FrameTrace trace = m_PlotTrace;
+    m_PlotTrace.Clear();
+    m_plotPending = false;
+    return trace;
+}
+
+/*when stopped the last rendered frame is refitted, while running the fit stage picks the flag up with the next frame*/
 void ImageCalculatingThread::toggleDoFitting(bool dofit)
 {
     m_doFitting = dofit;
-    if (m_Stopping) { fit1dGaussian(); }
+    if (m_Stopping)
+    {
+        QMutexLocker guard(&m_PlotLock);
+        if (!m_pLastFrame.isNull())
+        {
+            fit1dGaussian(*m_pLastFrame);
+            plotFit1D(m_pLastFrame->m_Shot);
+        }
+    }
+}
+
+/*takes effect with the next fit, the seeds are kept while it is off*/
+void ImageCalculatingThread::toggleWarmStart(bool warm)
+{
+    m_doWarmStart = warm;
 }
 
 void ImageCalculatingThread::toggleDoFitting2D(bool dofit)
 {
-    m_pProcessingThread->mutex().lock();
     m_doFitting2D = dofit;
-    if (m_Stopping) { fit2dGaussian(); }
-    m_pProcessingThread->mutex().unlock();
+    if (m_Stopping)
+    {
+        QMutexLocker guard(&m_PlotLock);
+        if (!m_pLastFrame.isNull())
+        {
+            fit2dGaussian(*m_pLastFrame);
+            plotFit2D(m_pLastFrame->m_Shot);
+            plotMoments(m_pLastFrame->m_Shot);
+        }
+    }
+}
+
+/*fitted parameters or their confidence into a shot result, a short vector leaves the rest at 0*/
+static void copyPara(const QVector<double>& para, double* pTo, int nCount)
+{
+    std::copy_n(para.constBegin(), std::min(nCount, para.size()), pTo);
 }
 
-void ImageCalculatingThread::fit1dGaussian()
+void ImageCalculatingThread::fit1dGaussian(AnalysisFrame& frame)
 {
+    tShotResult& shot = frame.m_Shot;
+    shot.m_Fitted1D = false;
     if (m_doFitting)
     {
-        m_gfitBottom.set_data(m_width, m_bottomKey.begin(), m_doubleCrxX.begin());
-        m_gfitLeft.set_data(m_height, m_leftKey.begin(), m_doubleCrxY.begin());
+        m_gfitBottom.set_data(frame.m_Width, frame.m_KeyX.data(), frame.m_CrxX.data());
+        m_gfitLeft.set_data(frame.m_Height, frame.m_KeyY.data(), frame.m_CrxY.data());
 
-        auto [xmin_it, xmax_it] = std::minmax_element(m_doubleCrxX.begin(), m_doubleCrxX.end());
+        auto [xmin_it, xmax_it] = std::minmax_element(frame.m_CrxX.constBegin(), frame.m_CrxX.constEnd());
         double a0x = *xmax_it - *xmin_it;
-        double b0x = m_bottomKey.at(xmax_it - m_doubleCrxX.begin());/*although this return a const reference, can nontheless force a copy ctor to get a copy of the returned value*/
-        double c0x = 0.5 * m_width;
+        double b0x = frame.m_KeyX.at(xmax_it - frame.m_CrxX.constBegin());/*although this return a const reference, can nontheless force a copy ctor to get a copy of the returned value*/
+        double c0x = 0.5 * frame.m_Width;
         double d0x = *xmin_it;
 
-        auto [ymin_it, ymax_it] = std::minmax_element(m_doubleCrxY.begin(), m_doubleCrxY.end());
+        auto [ymin_it, ymax_it] = std::minmax_element(frame.m_CrxY.constBegin(), frame.m_CrxY.constEnd());
         double a0y = *ymax_it - *ymin_it;
-        double b0y = m_leftKey.at(ymax_it - m_doubleCrxY.begin());/*although this return a const reference, can nontheless force a copy ctor to get a copy of the returned value*/
-        double c0y = 0.5 * m_height;
+        double b0y = frame.m_KeyY.at(ymax_it - frame.m_CrxY.constBegin());/*although this return a const reference, can nontheless force a copy ctor to get a copy of the returned value*/
+        double c0y = 0.5 * frame.m_Height;
         double d0y = *ymin_it;
-        m_gfitBottom.set_initialP(a0x, b0x, c0x, d0x);
-        m_gfitLeft.set_initialP(a0y, b0y, c0y, d0y);
-
-        QVector<double> fittedx, fittedy;
-        QFuture<void> resultx = QtConcurrent::run([this, &fittedx]() {
-            m_gfitBottom.solve_system();
-            fittedx = std::move(m_gfitBottom.calcFittedGaussian());
-            m_pQCP->graph(2)->setData(m_bottomKey, fittedx, true);
-            QVector<double> fitParax = m_gfitBottom.fittedPara();
-            QVector<double> confi95x = m_gfitBottom.confidence95Interval();
-            m_pQCP->axisRect(2)->axis(QCPAxis::atBottom)->setLabel(
-                QString::fromWCharArray(L"\u03bc") + QString(": %1 +/- %2, ").
-                arg(fitParax.at(1) - m_offsetX, 0, 'f', 2).arg(confi95x.at(1), 0, 'f', 2) +
-                QString::fromWCharArray(L"\u03c3") + QString(": %3 +/- %4").
-                arg(fitParax.at(2), 0, 'f', 2).arg(confi95x.at(2), 0, 'f', 2));
+        const QVector<double> coldX = { a0x, b0x, c0x, d0x };
+        const QVector<double> coldY = { a0y, b0y, c0y, d0y };
+        const QRect roi(frame.m_OffsetX, frame.m_OffsetY, frame.m_Width, frame.m_Height);
+        const bool warm = m_doWarmStart;
+
+        QFuture<void> resultx = QtConcurrent::run([this, &shot, &coldX, &roi, warm]() {
+            m_warmBottom.solve(m_gfitBottom, warm, roi, coldX);
+            copyPara(m_gfitBottom.fittedPara(), shot.m_FitParaX, tShotResult::FIT1D_PARAMS);
+            copyPara(m_gfitBottom.confidence95Interval(), shot.m_Confi95X, tShotResult::FIT1D_PARAMS);
             });
-        QFuture<void> resulty = QtConcurrent::run([this, &fittedy]() {
-            m_gfitLeft.solve_system();
-            fittedy = std::move(m_gfitLeft.calcFittedGaussian());
-            m_pQCP->graph(3)->setData(m_leftKey, fittedy, true);
-            QVector<double> fitParay = m_gfitLeft.fittedPara();
-            QVector<double> confi95y = m_gfitLeft.confidence95Interval();
-            m_pQCP->axisRect(0)->axis(QCPAxis::atLeft)->setLabel(
-                QString::fromWCharArray(L"\u03bc") + QString(": %1 +/- %2, ").
-                arg(fitParay.at(1) - m_offsetY, 0, 'f', 2).arg(confi95y.at(1), 0, 'f', 2) +
-                QString::fromWCharArray(L"\u03c3") + QString(": %3 +/- %4").
-                arg(fitParay.at(2), 0, 'f', 2).arg(confi95y.at(2), 0, 'f', 2));
+        QFuture<void> resulty = QtConcurrent::run([this, &shot, &coldY, &roi, warm]() {
+            m_warmLeft.solve(m_gfitLeft, warm, roi, coldY);
+            copyPara(m_gfitLeft.fittedPara(), shot.m_FitParaY, tShotResult::FIT1D_PARAMS);
+            copyPara(m_gfitLeft.confidence95Interval(), shot.m_Confi95Y, tShotResult::FIT1D_PARAMS);
             });
 
         resultx.waitForFinished();
         resulty.waitForFinished();
+        shot.m_Fitted1D = true;
     }
-    
 
 }
 
+/*the fitted curves are only computed here, for the shots that are shown*/
+static void fittedCurve(const double* para, int offset, int count, QVector<double>& keys, QVector<double>& curve)
+{
+    keys.resize(count);
+    curve.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        keys[i] = offset + i;
+        curve[i] = Gaussian1DFit::gaussian(para[0], para[1], para[2], para[3], keys[i]);
+    }
+}
 
-void ImageCalculatingThread::fit2dGaussian()
+void ImageCalculatingThread::plotFit1D(const tShotResult& shot)
 {
-    if (m_doFitting2D)
+    if (!shot.m_Fitted1D)
     {
-        m_gfit2D.set_data(m_width * m_height, m_width, m_height,
-            m_bottomKey.begin(), m_leftKey.begin(), m_doubleQVector.begin());
+        return;
+    }
+    QVector<double> keys, curve;
+    fittedCurve(shot.m_FitParaX, shot.m_OffsetX, shot.m_Width, keys, curve);
+    m_pQCP->graph(2)->setData(keys, curve, true);
+    m_pQCP->axisRect(2)->axis(QCPAxis::atBottom)->setLabel(
+        QString::fromWCharArray(L"\u03bc") + QString(": %1 +/- %2, ").
+        arg(shot.m_FitParaX[1] - shot.m_OffsetX, 0, 'f', 2).arg(shot.m_Confi95X[1], 0, 'f', 2) +
+        QString::fromWCharArray(L"\u03c3") + QString(": %3 +/- %4").
+        arg(shot.m_FitParaX[2], 0, 'f', 2).arg(shot.m_Confi95X[2], 0, 'f', 2));
+    fittedCurve(shot.m_FitParaY, shot.m_OffsetY, shot.m_Height, keys, curve);
+    m_pQCP->graph(3)->setData(keys, curve, true);
+    m_pQCP->axisRect(0)->axis(QCPAxis::atLeft)->setLabel(
+        QString::fromWCharArray(L"\u03bc") + QString(": %1 +/- %2, ").
+        arg(shot.m_FitParaY[1] - shot.m_OffsetY, 0, 'f', 2).arg(shot.m_Confi95Y[1], 0, 'f', 2) +
+        QString::fromWCharArray(L"\u03c3") + QString(": %3 +/- %4").
+        arg(shot.m_FitParaY[2], 0, 'f', 2).arg(shot.m_Confi95Y[2], 0, 'f', 2));
+}
 
-        auto [zmin_it, zmax_it] = std::minmax_element(m_doubleQVector.begin(), m_doubleQVector.end());
-        double A0 = *zmax_it - *zmin_it;
-        double x00 = m_bottomKey.at((zmax_it - m_doubleQVector.begin()) % m_width);/*although this return a const reference, can nontheless force a copy ctor to get a copy of the returned value*/
-        double y00 = m_leftKey.at((zmax_it - m_doubleQVector.begin()) / m_width);
-        double a0 = 1. / (0.25 * m_width * m_width);
-        double b0 = 0.1 / (0.5 * m_width * m_height);
-        double c0 = 1. / (0.25 * m_height * m_height);
-        double D0 = *zmin_it;
 
-        m_gfit2D.set_initialP(A0, x00, y00, a0, b0, c0, D0);
+void ImageCalculatingThread::fit2dGaussian(AnalysisFrame& frame)
+{
+    tShotResult& shot = frame.m_Shot;
+    shot.m_Fitted2D = false;
+    shot.m_FitError.clear();
+    if (m_doFitting2D && !frame.m_Samples.isEmpty())
+    {
+        const int width = frame.m_Width;
+        const int height = frame.m_Height;
+        /*the fitter works in double, the only place the frame is widened*/
+        widen_samples(frame.m_Samples, m_doubleQVector);
+        m_gfit2D.set_data(width * height, width, height,
+            frame.m_KeyX.data(), frame.m_KeyY.data(), m_doubleQVector.data());
+
+        /*cold guess: the gaussian with the beam's second moments, the peak and the frame size if nothing is above the noise*/
+        QVector<double> cold;
+        if (!beam_moments_gaussian(shot.m_Moments, cold))
+        {
+            auto [zmin_it, zmax_it] = std::minmax_element(m_doubleQVector.constBegin(), m_doubleQVector.constEnd());
+            double A0 = *zmax_it - *zmin_it;
+            double x00 = frame.m_KeyX.at((zmax_it - m_doubleQVector.constBegin()) % width);/*although this return a const reference, can nontheless force a copy ctor to get a copy of the returned value*/
+            double y00 = frame.m_KeyY.at((zmax_it - m_doubleQVector.constBegin()) / width);
+            double a0 = 1. / (0.25 * width * width);
+            double b0 = 0.1 / (0.5 * width * height);
+            double c0 = 1. / (0.25 * height * height);
+            double D0 = *zmin_it;
+            cold = { A0, x00, y00, a0, b0, c0, D0 };
+        }
+
+        const QRect roi(frame.m_OffsetX, frame.m_OffsetY, width, height);
 
         /*fiting*/
         try {
-            m_gfit2D.solve_system();
+            m_warm2D.solve(m_gfit2D, m_doWarmStart, roi, cold);
         }
         catch (const std::exception& e) {
-            emit logging("Exception from the thread: " + QString(e.what()));
+            shot.m_FitError = "2D fit failed: " + QString(e.what());
             return;
         }
 
-        //QVector<double> fitted2D;
-        //fitted2D = std::move(m_gfit2D.calcFittedGaussian());
-        QVector<double> fitParaz = m_gfit2D.fittedPara();
-        QVector<double> confi95z = m_gfit2D.confidence95Interval();
+        copyPara(m_gfit2D.fittedPara(), shot.m_FitPara2D, tShotResult::FIT2D_PARAMS);
+        copyPara(m_gfit2D.confidence95Interval(), shot.m_Confi95_2D, tShotResult::FIT2D_PARAMS);
+        shot.m_FitInfo2D = m_gfit2D.getInfo();
+        shot.m_FitExpired2D = m_gfit2D.expired();
+        std::tie(shot.m_ErrMajor, shot.m_ErrMinor) = m_gfit2D.MajorMinor95();
+        shot.m_Fitted2D = true;
+    }
+}
 
-        const double a = fitParaz[3], b = fitParaz[4], c = fitParaz[5], Delta = sqrt(4 * b * b + (a - c) * (a - c));
-        const double sigMajor = 1 / sqrt(a + c - Delta);
-        const double sigMinor = 1 / sqrt(a + c + Delta);
+void ImageCalculatingThread::plotFit2D(const tShotResult& shot)
+{
+    if (!shot.m_FitError.isEmpty())
+    {
+        emit logging(shot.m_FitError);
+        return;
+    }
+    if (!shot.m_Fitted2D)
+    {
+        return;
+    }
+    const double* fitParaz = shot.m_FitPara2D;
+    const double* confi95z = shot.m_Confi95_2D;
+    const int width = shot.m_Width;
+    const int height = shot.m_Height;
 
-        auto [errMajor, errMinor] = m_gfit2D.MajorMinor95();
+    const double a = fitParaz[3], b = fitParaz[4], c = fitParaz[5], Delta = sqrt(4 * b * b + (a - c) * (a - c));
+    const double sigMajor = 1 / sqrt(a + c - Delta);
+    const double sigMinor = 1 / sqrt(a + c + Delta);
 
-        if (m_gfit2D.getInfo() != 1 || fitParaz[1] < m_offsetX || fitParaz[2] < m_offsetY)
-        {
-            emit logging(QString("muX: %1 +/- %2, sigmaX: %3 +/- %4").
-                arg(fitParaz.at(1) - m_offsetX, 0, 'f', 2).arg(confi95z.at(1), 0, 'f', 2).
-                arg(sigMajor, 0, 'f', 2).arg(errMajor, 0, 'f', 2) +
-                ", " +
-                QString("muY: %1 +/- %2, sigmaY: %3 +/- %4").
-                arg(fitParaz.at(2) - m_offsetY, 0, 'f', 2).arg(confi95z.at(2), 0, 'f', 2).
-                arg(sigMinor, 0, 'f', 2).arg(errMinor, 0, 'f', 2));
-            return;
-        }
-        m_pQCP->axisRect(1)->axis(QCPAxis::atTop)->setLabel(
-            QString::fromWCharArray(L"\u03bc") + QString("XY: (%1 +/- %2, %3 +/- %4)").
-            arg(fitParaz.at(1) - m_offsetX, 5, 'f', 2).arg(confi95z.at(1), 5, 'f', 2).
-            arg(fitParaz.at(2) - m_offsetY, 5, 'f', 2).arg(confi95z.at(2), 5, 'f', 2) + ", " +
-            QString::fromWCharArray(L"\u03c3") + QString("MajMin: (%1 +/- %2, %3 +/- %4)").
-            arg(sigMajor, 5, 'f', 2).arg(errMajor, 5, 'f', 2).
-            arg(sigMinor, 5, 'f', 2).arg(errMinor, 5, 'f', 2)
-        );
-
-        /*parametric plot*/
-        const int pointCount = 100;
-        QVector<QCPCurveData> parametric(pointCount);
-        for (size_t i = 0; i < pointCount; i++)
-        {
-            const double phi = i / (double)(pointCount - 1) * 2 * M_PI;
-            /*0.135 of the peak, i.e. exp(-2)*/
-            const double r = sqrt(2.) / sqrt(a * cos(phi) * cos(phi) + b * sin(2 * phi) + c * sin(phi) * sin(phi));
-            parametric[i] = QCPCurveData(i, r * cos(phi) + fitParaz[1], r * sin(phi) + fitParaz[2]);
-        }
-        reinterpret_cast<QCPCurve*>(m_pQCP->axisRect(1)->plottables().at(2))->data()->set(parametric, true);
+    const double errMajor = shot.m_ErrMajor;
+    const double errMinor = shot.m_ErrMinor;
 
-        /*cross hair*/
-        std::array<double, 2> kMajor = { a - c - Delta, 2. * b };
-        std::array<double, 2> kMinor = { a - c + Delta, 2 * b };
-        {
-            double norm = std::inner_product(kMajor.begin(), kMajor.end(), kMajor.begin(), 0.0);
-            std::for_each(kMajor.begin(), kMajor.end(), [norm](auto& tmp) {tmp /= sqrt(norm); });
-            norm = std::inner_product(kMinor.begin(), kMinor.end(), kMinor.begin(), 0.0);
-            std::for_each(kMinor.begin(), kMinor.end(), [norm](auto& tmp) {tmp /= sqrt(norm); });
-        }
-        QVector<QCPCurveData> hair(6);
-        {
-            double centerx = fitParaz[1];
-            double centery = fitParaz[2];
-            hair[0] = (QCPCurveData(0, -m_width * kMajor[0] + centerx, -m_height * kMajor[1] + centery));
-            hair[1] = (QCPCurveData(1, m_width * kMajor[0] + centerx, m_height * kMajor[1] + centery));
-            hair[2] = (QCPCurveData(2, qQNaN(), qQNaN()));
-            hair[3] = (QCPCurveData(3, -m_width * kMinor[0] + centerx, -m_height * kMinor[1] + centery));
-            hair[4] = (QCPCurveData(4, m_width * kMinor[0] + centerx, m_height * kMinor[1] + centery));
-            hair[5] = (QCPCurveData(5, qQNaN(), qQNaN()));
-        }
-        reinterpret_cast<QCPCurve*>(m_pQCP->axisRect(1)->plottables().at(1))->data()->set(hair, true);
+    if (shot.m_FitInfo2D != 1 || fitParaz[1] < shot.m_OffsetX || fitParaz[2] < shot.m_OffsetY)
+    {
+        emit logging((shot.m_FitExpired2D ? QString("2D fit stopped at its time budget, ") : QString()) +
+            QString("muX: %1 +/- %2, sigmaX: %3 +/- %4").
+            arg(fitParaz[1] - shot.m_OffsetX, 0, 'f', 2).arg(confi95z[1], 0, 'f', 2).
+            arg(sigMajor, 0, 'f', 2).arg(errMajor, 0, 'f', 2) +
+            ", " +
+            QString("muY: %1 +/- %2, sigmaY: %3 +/- %4").
+            arg(fitParaz[2] - shot.m_OffsetY, 0, 'f', 2).arg(confi95z[2], 0, 'f', 2).
+            arg(sigMinor, 0, 'f', 2).arg(errMinor, 0, 'f', 2));
+        return;
+    }
+    m_pQCP->axisRect(1)->axis(QCPAxis::atTop)->setLabel(
+        QString::fromWCharArray(L"\u03bc") + QString("XY: (%1 +/- %2, %3 +/- %4)").
+        arg(fitParaz[1] - shot.m_OffsetX, 5, 'f', 2).arg(confi95z[1], 5, 'f', 2).
+        arg(fitParaz[2] - shot.m_OffsetY, 5, 'f', 2).arg(confi95z[2], 5, 'f', 2) + ", " +
+        QString::fromWCharArray(L"\u03c3") + QString("MajMin: (%1 +/- %2, %3 +/- %4)").
+        arg(sigMajor, 5, 'f', 2).arg(errMajor, 5, 'f', 2).
+        arg(sigMinor, 5, 'f', 2).arg(errMinor, 5, 'f', 2)
+    );
+
+    /*parametric plot*/
+    const int pointCount = 100;
+    QVector<QCPCurveData> parametric(pointCount);
+    for (size_t i = 0; i < pointCount; i++)
+    {
+        const double phi = i / (double)(pointCount - 1) * 2 * M_PI;
+        /*0.135 of the peak, i.e. exp(-2)*/
+        const double r = sqrt(2.) / sqrt(a * cos(phi) * cos(phi) + b * sin(2 * phi) + c * sin(phi) * sin(phi));
+        parametric[i] = QCPCurveData(i, r * cos(phi) + fitParaz[1], r * sin(phi) + fitParaz[2]);
+    }
+    reinterpret_cast<QCPCurve*>(m_pQCP->axisRect(1)->plottables().at(2))->data()->set(parametric, true);
 
+    /*cross hair*/
+    std::array<double, 2> kMajor = { a - c - Delta, 2. * b };
+    std::array<double, 2> kMinor = { a - c + Delta, 2 * b };
+    {
+        double norm = std::inner_product(kMajor.begin(), kMajor.end(), kMajor.begin(), 0.0);
+        std::for_each(kMajor.begin(), kMajor.end(), [norm](auto& tmp) {tmp /= sqrt(norm); });
+        norm = std::inner_product(kMinor.begin(), kMinor.end(), kMinor.begin(), 0.0);
+        std::for_each(kMinor.begin(), kMinor.end(), [norm](auto& tmp) {tmp /= sqrt(norm); });
+    }
+    QVector<QCPCurveData> hair(6);
+    {
+        double centerx = fitParaz[1];
+        double centery = fitParaz[2];
+        hair[0] = (QCPCurveData(0, -width * kMajor[0] + centerx, -height * kMajor[1] + centery));
+        hair[1] = (QCPCurveData(1, width * kMajor[0] + centerx, height * kMajor[1] + centery));
+        hair[2] = (QCPCurveData(2, qQNaN(), qQNaN()));
+        hair[3] = (QCPCurveData(3, -width * kMinor[0] + centerx, -height * kMinor[1] + centery));
+        hair[4] = (QCPCurveData(4, width * kMinor[0] + centerx, height * kMinor[1] + centery));
+        hair[5] = (QCPCurveData(5, qQNaN(), qQNaN()));
+    }
+    reinterpret_cast<QCPCurve*>(m_pQCP->axisRect(1)->plottables().at(1))->data()->set(hair, true);
 
 
-        /*double check to make sure kill the label when runing, that is due to the slowness
-        of the calc such that when the m_doFitting is set to false, the current fit is not yet
-        finished but already in processing, when it is done, it still set the label*/
-        if(!m_Stopping && !m_doFitting2D)
-        {
-            m_pQCP->axisRect(1)->axis(QCPAxis::atTop)->setLabel("");
-        }
 
+    /*double check to make sure kill the label when runing, that is due to the slowness
+    of the calc such that when the m_doFitting is set to false, the current fit is not yet
+    finished but already in processing, when it is done, it still set the label*/
+    if(!m_Stopping && !m_doFitting2D)
+    {
+        m_pQCP->axisRect(1)->axis(QCPAxis::atTop)->setLabel("");
+    }
 
+}
 
+/*D4sigma ellipse and principal axes from the second moments, drawn where the 2D fit draws its own while that is off*/
+void ImageCalculatingThread::plotMoments(const tShotResult& shot)
+{
+    const tBeamMoments& moments = shot.m_Moments;
+    if (m_doFitting2D || !moments.m_bValid)
+    {
+        return;
     }
+    const int width = shot.m_Width;
+    const int height = shot.m_Height;
+    const double centerx = moments.m_dCentroidX;
+    const double centery = moments.m_dCentroidY;
+    const double cosAngle = cos(moments.m_dAngle);
+    const double sinAngle = sin(moments.m_dAngle);
+
+    m_pQCP->axisRect(1)->axis(QCPAxis::atTop)->setLabel(
+        QString::fromWCharArray(L"\u03bc") + QString("XY: (%1, %2), D4").
+        arg(centerx - shot.m_OffsetX, 5, 'f', 2).arg(centery - shot.m_OffsetY, 5, 'f', 2) +
+        QString::fromWCharArray(L"\u03c3") + QString("MajMin: (%1, %2), angle: %3").
+        arg(moments.m_dMajor, 5, 'f', 2).arg(moments.m_dMinor, 5, 'f', 2).
+        arg(qRadiansToDegrees(moments.m_dAngle), 5, 'f', 1) + QString::fromWCharArray(L"\u00b0")
+    );
+
+    /*the D4sigma ellipse is the 1/e^2 contour of a gaussian, the one the 2D fit draws*/
+    const int pointCount = 100;
+    QVector<QCPCurveData> parametric(pointCount);
+    for (int i = 0; i < pointCount; i++)
+    {
+        const double phi = i / (double)(pointCount - 1) * 2 * M_PI;
+        const double u = 0.5 * moments.m_dMajor * cos(phi);
+        const double v = 0.5 * moments.m_dMinor * sin(phi);
+        parametric[i] = QCPCurveData(i, u * cosAngle - v * sinAngle + centerx, u * sinAngle + v * cosAngle + centery);
+    }
+    reinterpret_cast<QCPCurve*>(m_pQCP->axisRect(1)->plottables().at(2))->data()->set(parametric, true);
+
+    QVector<QCPCurveData> hair(6);
+    hair[0] = (QCPCurveData(0, -width * cosAngle + centerx, -height * sinAngle + centery));
+    hair[1] = (QCPCurveData(1, width * cosAngle + centerx, height * sinAngle + centery));
+    hair[2] = (QCPCurveData(2, qQNaN(), qQNaN()));
+    hair[3] = (QCPCurveData(3, width * sinAngle + centerx, -height * cosAngle + centery));
+    hair[4] = (QCPCurveData(4, -width * sinAngle + centerx, height * cosAngle + centery));
+    hair[5] = (QCPCurveData(5, qQNaN(), qQNaN()));
+    reinterpret_cast<QCPCurve*>(m_pQCP->axisRect(1)->plottables().at(1))->data()->set(hair, true);
+}
 
+/*reductions stage: cross sections of every converted frame, then on to the fit stage*/
+void ImageCalculatingThread::run()
+{
+    AnalysisFramePtr pFrame;
+    while (m_pProcessingThread->analysisQueue().WaitData(pFrame))
+    {
+        pFrame->m_Trace.Mark(FrameStage_Handoff);
+        if (2 == pFrame->m_Samples.m_bytesPerSample)
+        {
+            calcCrossSectionXY(pFrame->m_Samples.m_uint16, *pFrame);
+        }
+        else
+        {
+            calcCrossSectionXY(pFrame->m_Samples.m_uint8, *pFrame);
+        }
+        pFrame->m_Shot.m_Moments = beam_moments(pFrame->m_Samples, pFrame->m_Width, pFrame->m_Height, pFrame->m_OffsetX, pFrame->m_OffsetY);
+        pFrame->m_Trace.Mark(FrameStage_Projected);
+        /*a burst frame waits for the fits instead of pushing an older one out, the burst is fed at the pace of the analysis*/
+        if (pFrame->m_Metadata.m_bBurst)
+        {
+            m_pFitStage->PushWait(pFrame);
+        }
+        else
+        {
+            m_pFitStage->Push(pFrame);
+        }
+    }
 }
 
+/*fit stage: fits of every frame it gets, recorded whether the frame is shown or not, then on to the render stage*/
+void ImageCalculatingThread::fitFrame(AnalysisFramePtr& pFrame)
+{
+    AnalysisFrame& frame = *pFrame;
+    fit1dGaussian(frame);
+    fit2dGaussian(frame);
+    frame.m_Trace.Mark(FrameStage_Fitted);
+    recordShot(frame);
+    m_pRenderStage->Push(pFrame);
+}
 
+/*fit stage, or the reductions stage for a frame its push dropped out of the fit queue*/
+void ImageCalculatingThread::recordShot(AnalysisFrame& frame)
+{
+    tShotResult& shot = frame.m_Shot;
+    shot.m_Metadata = frame.m_Metadata;
+    shot.m_nAnalysed = FrameTrace::Now();
+    shot.m_Width = frame.m_Width;
+    shot.m_Height = frame.m_Height;
+    shot.m_OffsetX = frame.m_OffsetX;
+    shot.m_OffsetY = frame.m_OffsetY;
+    shot.SetCentroid();
+    m_pShots->Record(shot);
+}
 
-void ImageCalculatingThread::run()
+/*render stage: fills the plot from a frame at the display rate, all other frames end here*/
+void ImageCalculatingThread::renderFrame(AnalysisFramePtr& pFrame)
 {
-    while (!m_Stopping)
+    if (!displayDue())
+    {
+        /*analysed, the plot shows a later frame*/
+        dropFrame(FrameDrop_Display, pFrame);
+        return;
+    }
+    AnalysisFrame& frame = *pFrame;
     {
-        
-        m_pProcessingThread->mutex().lock();
-        //m_doubleQVector.clear();
+        QMutexLocker guard(&m_PlotLock);
+        m_width = frame.m_Width;
+        m_height = frame.m_Height;
+        m_offsetX = frame.m_OffsetX;
+        m_offsetY = frame.m_OffsetY;
+        /*the labels show the settings the plotted frame was taken with*/
+        m_exposureTime = frame.m_Metadata.m_dExposureTime;
+        m_cameraGain = frame.m_Metadata.m_dGain;
+        if (m_format != frame.m_Format || m_sFormat.isEmpty())
         {
-            m_pProcessingThread->calcWait().wait(&m_pProcessingThread->mutex(),2000);
-
-            if (!m_Stopping)//protect it from overwrite when stop
-            { 
-                m_doubleQVector.swap(m_pProcessingThread->doubleVec());
-                m_width = m_pProcessingThread->width();
-                m_height = m_pProcessingThread->height();
-                m_format = m_pProcessingThread->format();
-                m_dataValid = true;
-            }
+            m_format = frame.m_Format;
+            m_sFormat = Helper::convertFormatToString(m_format);
         }
-        m_pProcessingThread->mutex().unlock();
-        
-
-        if (m_dataValid && !m_Stopping && !m_doubleQVector.isEmpty())
+        m_bitDepth = frame.m_BitDepth;
+        if (2 == frame.m_Samples.m_bytesPerSample)
         {
-            //m_doubleQVector = QVector<double>(m_uint16QVector.begin(), m_uint16QVector.end());
-            updateXYOffset();
-            calcCrossSectionXY();
-            assignValue(m_doubleQVector, m_format, m_height, m_width, m_offsetX, m_offsetY);
-            fit1dGaussian();
-            fit2dGaussian();
-            if (m_firstStart)
-            {
-                setDefaultView();
-                emit currentFormat(m_format);
-                m_firstStart = false;
-            }
-            m_dataValid = false;
-            emit imageReadyForPlot();
-            
+            assignValue(frame.m_Samples.m_uint16, m_sFormat, m_height, m_width, m_offsetX, m_offsetY);
         }
-        
-        m_pProcessingThread->procWait().wakeOne();
-
+        else
+        {
+            assignValue(frame.m_Samples.m_uint8, m_sFormat, m_height, m_width, m_offsetX, m_offsetY);
+        }
+        plotCrossSectionXY(frame);
+        /*the overlays are the results of this frame, the shot ring is for recording and export only*/
+        plotFit1D(frame.m_Shot);
+        plotFit2D(frame.m_Shot);
+        plotMoments(frame.m_Shot);
+        if (m_firstStart)
+        {
+            setDefaultView();
+            emit currentFormat(m_sFormat, m_bitDepth);
+            m_firstStart = false;
+        }
+        /*kept for saving and refits, the one shown before goes back to the pool*/
+        if (!m_pLastFrame.isNull())
+        {
+            m_pProcessingThread->framePool().Recycle(m_pLastFrame);
+        }
+        m_pLastFrame = pFrame;
+    }
+    pFrame.clear();
+    frame.m_Trace.Mark(FrameStage_Rendered);
+    {
+        QMutexLocker guard(&m_PlotTraceLock);
+        m_PlotTrace = frame.m_Trace;
+        m_plotPending = true;
     }
+    emit imageReadyForPlot();
 }
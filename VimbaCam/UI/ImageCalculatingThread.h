@@ -1,5 +1,6 @@
 #pragma once
 #include <QThread>
+#include <QElapsedTimer>
 #include <qtconcurrentrun.h>
 #include <VimbaCPP/Include/VimbaSystem.h>
 #include "FrameObserver.h"
@@ -7,7 +8,10 @@
 #include "ExternLib/qcustomplot/qcustomplot.h"
 #include "Gaussian1DFit.h"
 #include "Gaussian2DFit.h"
+#include "FitWarmStart.h"
+#include "ShotResults.h"
 #include <utility>
+#include <atomic>
 
 class ImageCalculatingThread :
     public QThread
@@ -21,35 +25,50 @@ private:
     QSharedPointer<QCPColorMap>               m_pQCPColormap;
     QSharedPointer<QCPGraph>                  m_pQCPbottomGraph;
     QSharedPointer<QCPGraph>                  m_pQCPleftGraph;
-    QVector<ushort>                           m_uint16QVector;
-    QVector<double>                           m_doubleQVector;
-    QVector<double>                           m_doubleCrxX;
-    QVector<double>                           m_doubleCrxY;
-    QVector<double>                           m_bottomKey;
-    QVector<double>                           m_leftKey;
+    QSharedPointer<AnalysisStage>             m_pFitStage;      /*fits, fed by run with the reduced frames*/
+    QSharedPointer<AnalysisStage>             m_pRenderStage;   /*plot data, fed by the fit stage*/
+    AnalysisFramePtr                          m_pLastFrame;     /*last rendered frame, for saving and refits when stopped, guarded by m_PlotLock*/
+    mutable QMutex                            m_PlotLock;       /*held while the plot and the members the gui reads are written, and by the gui while it replots*/
+    QVector<double>                           m_doubleQVector;  /*samples widened for the 2d fit, only filled when it runs*/
+    QVector<quint64>                          m_colSums;        /*column sums of the reductions stage*/
     int                                       m_height;
     int                                       m_width;
     int                                       m_heightMax;
     int                                       m_widthMax;
     int                                       m_offsetX;
     int                                       m_offsetY;
-    QString                                   m_format;
-    double                                    m_exposureTime;
-    double                                    m_cameraGain;
+    VmbPixelFormatType                        m_format;         /*mono format of the analysis data*/
+    VmbUint32_t                               m_bitDepth;
+    QString                                   m_sFormat;        /*m_format for display, only rebuilt when the format changes*/
+    std::atomic<double>                       m_exposureTime;   /*written by the render stage and, while it is stopped, the gui thread*/
+    std::atomic<double>                       m_cameraGain;
 
     bool                                      m_firstStart;
-    bool                                      m_dataValid;
 
     bool                                      m_Stopping;
 
     bool                                      m_doFitting;
     bool                                      m_doFitting2D;
+    bool                                      m_doWarmStart;    /*fits start from the last converged parameters*/
 
     QPoint                                    m_mousePos;
 
     Gaussian1DFit                             m_gfitBottom;
     Gaussian1DFit                             m_gfitLeft;
     Gaussian2DFit                             m_gfit2D;
+    FitWarmStart                              m_warmBottom;
+    FitWarmStart                              m_warmLeft;
+    FitWarmStart                              m_warm2D;
+
+    FrameTrace                                m_PlotTrace;      /*stage timestamps of the frame waiting for the replot*/
+    bool                                      m_plotPending;    /*plot data handed to the gui and not yet replotted, guarded by m_PlotTraceLock*/
+    QMutex                                    m_PlotTraceLock;
+    std::atomic<double>                       m_displayInterval; /*ms between two plot updates, 0 plots whenever the gui is ready, set by the gui thread*/
+    QElapsedTimer                             m_displayTimer;   /*since the last plot update*/
+    FrameLatencyStatsPtr                      m_pLatencyStats;
+    FrameDropStatsPtr                         m_pDropStats;
+    FeatureCachePtr                           m_pFeatureCache;
+    ShotResultsPtr                            m_pShots;         /*results of every analysed frame, the plot shows the latest*/
 public:
     ImageCalculatingThread(const SP_DECL(FrameObserver)& ,
         const CameraPtr&,
@@ -67,9 +86,24 @@ public:
     void assignValue(const QVector<T>& vec1d, const QString& sFormat, const int& Height, const int& Width, const int& offsetX, const int& offsetY);
 
 private:
-    void calcCrossSectionXY();
-    void fit1dGaussian();
-    void fit2dGaussian();
+    /*stages: run reduces, then fitFrame and renderFrame on their own workers*/
+    void fitFrame(AnalysisFramePtr& pFrame);
+    void renderFrame(AnalysisFramePtr& pFrame);
+    /*a frame leaves the pipeline, its trace is recorded and the buffers go back to the pool*/
+    void retireFrame(AnalysisFramePtr& pFrame);
+    void dropFrame(FrameDropReason reason, AnalysisFramePtr& pFrame);
+    /*the frame's moments and fits go to the shot results*/
+    void recordShot(AnalysisFrame& frame);
+
+    template <class T>
+    void calcCrossSectionXY(const QVector<T>& vec1d, AnalysisFrame& frame);
+    void plotCrossSectionXY(AnalysisFrame& frame);
+    void fit1dGaussian(AnalysisFrame& frame);
+    void fit2dGaussian(AnalysisFrame& frame);
+    void plotFit1D(const tShotResult& shot);
+    void plotFit2D(const tShotResult& shot);
+    void plotMoments(const tShotResult& shot);
+    bool displayDue();
 
 public:
     virtual void run() override;
@@ -81,21 +115,27 @@ public:
     std::pair<int, int> maxWidthHeight() const { return std::pair(m_widthMax, m_heightMax); }
     std::pair<int, int> WidthHeight() const { return std::pair(m_width, m_height); }
     std::pair<int, int> offsetXY() const { return std::pair(m_offsetX, m_offsetY); }
-    const QString& format() const { return m_format; }
+    const QString& format() const { return m_sFormat; }
+    VmbUint32_t bitDepth() const { return m_bitDepth; }
     const double exposureTime() const { return m_exposureTime; }
     const double cameraGain() const { return m_cameraGain; }
     QVector<double> rawImageDefinite();  /*used in save image*/
-    QMutex& mutex() const { return m_pProcessingThread->mutex(); }
+    QMutex& mutex() const { return m_PlotLock; }
+    FrameTrace takePlotTrace();  /*trace of the frame announced by imageReadyForPlot, to be taken after the replot, which allows the next plot update*/
+    void setDisplayInterval(double dInterval) { m_displayInterval = dInterval; }  /*ms, the analysis itself runs on every frame*/
+    const FrameLatencyStatsPtr& latencyStats() const { return m_pLatencyStats; }
+    const ShotResultsPtr& shotResults() const { return m_pShots; }  /*every frame the fit stage analysed since the start*/
 
 signals:
     void imageReadyForPlot();
     void logging(const QString& sMessage);
-    void currentFormat(QString format);
+    void currentFormat(QString format, int bitDepth);
 
 public slots:
     
     void updateMousePos(QMouseEvent* event);
     void toggleDoFitting(bool dofit);
     void toggleDoFitting2D(bool dofit);
+    void toggleWarmStart(bool warm);
 };
 